@@ -15,9 +15,52 @@
 #define BLINKDETECTMODULE_H_
 
 
+#include "gpioOut.h"
+
+
+/**************************** Data Types ******************************/
+
+typedef struct
+{
+	const char *source;		// frame source specification, see frameSource_create()
+	bool replay;			// process frames as fast as possible and report frames/sec
+	gpioOutBackendType gpio;	// how the blink indicator line is driven
+	bool trackFace;			// search for the face around its last position only
+	bool trackEyes;			// follow the eye by template matching between detections
+	bool parallelEyes;		// run the two eye detectors side by side
+	int faceRateHz;			// face localisation rate on its own thread, 0 runs it on every frame
+	bool frameTap;			// publish debug frames for blinkViewer
+	int fps;				// detector frame rate on a live source, 0 follows the source
+} blinkDetectOptionsType;
+
+
+/************************ Function Prototypes *************************/
 
 //void *blinkDetect_task(void *arg);
-int blinkDetect_task( void );
+int blinkDetect_task(const blinkDetectOptionsType *options);
+
+
+
+/*
+** blinkDetect_stop
+**
+** Description
+**  Asks blinkDetect_task to finish the current frame and return.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Async-signal-safe, may be called from a signal handler.
+**
+**/
+void blinkDetect_stop(void);
 
 
 
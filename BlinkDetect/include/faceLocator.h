@@ -0,0 +1,93 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Asynchronous face localisation for the blink detector. The
+				face cascade runs on its own thread at a low rate and
+				publishes the latest face rectangle; the detector thread
+				classifies the eye state inside it on every frame.
+ ============================================================================
+ */
+
+
+#ifndef FACELOCATOR_H_
+#define FACELOCATOR_H_
+
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdint.h>
+#include "opencv2/core/core.hpp"
+
+
+/************************ Macros **************************************/
+
+#define FACE_LOCATOR_DEFAULT_HZ		5
+#define FACE_LOCATOR_MAX_AGE_MS		1000	// older faces are not used
+
+
+/**************************** Data Types ******************************/
+
+
+typedef bool (*faceDetectFunc)(cv::Mat& im, cv::Rect& face);
+
+
+
+/*
+** FaceLocator
+**
+** Description
+**  Owns the face localisation thread. The detector offers every frame
+**  with submit(); the frame is only copied when the thread is idle
+**  and its period has elapsed, otherwise it is dropped, so submit()
+**  never waits for the face cascade. The result of the last run is
+**  read with latest().
+**
+**/
+class FaceLocator
+{
+public:
+	FaceLocator(faceDetectFunc detect, int rateHz);
+	~FaceLocator();
+
+	bool start();
+	void stop();
+
+	// detector side
+	void submit(const cv::Mat& gray, uint64_t stampNs);
+	bool latest(cv::Rect& face, uint64_t nowNs);
+
+	unsigned long located() const		{ return locatedCount.load(std::memory_order_relaxed); }
+	unsigned long submitted() const		{ return submittedCount.load(std::memory_order_relaxed); }
+
+private:
+	void run();
+
+	faceDetectFunc detect;
+	const uint64_t periodNs;
+	std::thread worker;
+	std::atomic<bool> running;
+
+	// frame handed to the thread, guarded by lock
+	std::mutex lock;
+	std::condition_variable wake;
+	cv::Mat pending;
+	uint64_t pendingStamp;
+	bool havePending;
+	std::atomic<bool> wanted;				// the thread is idle and due for a frame
+	uint64_t nextRunNs;						// detector side only
+
+	// published result, guarded by lock
+	cv::Rect face;
+	uint64_t faceStamp;						// capture time of the frame the face was found in
+
+	std::atomic<unsigned long> locatedCount;
+	std::atomic<unsigned long> submittedCount;
+};
+
+
+
+
+#endif /*FACELOCATOR_H_*/
@@ -0,0 +1,136 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Dedicated capture thread for the blink detector. Frames are
+				grabbed on their own thread into a fixed pool of
+				preallocated cv::Mat buffers and handed to the detector
+				through a single-producer/single-consumer ring.
+ ============================================================================
+ */
+
+
+#ifndef FRAMECAPTURE_H_
+#define FRAMECAPTURE_H_
+
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include <semaphore.h>
+#include "opencv2/core/core.hpp"
+
+#include "frameSource.h"
+#include "pipelineStats.h"
+
+
+/************************ Macros **************************************/
+
+#define FRAME_RING_SLOTS		4
+#define FRAME_RING_NO_SLOT		(~0UL)		// held when the consumer has no slot
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct
+{
+	cv::Mat image;				// frame as delivered by the source
+	unsigned long seq;			// capture sequence number
+	struct timespec stamp;		// CLOCK_MONOTONIC time the frame was grabbed
+	pipelineFrameType timing;	// grab and retrieve times of the frame
+} frameSlotType;
+
+
+
+/*
+** FrameRing
+**
+** Description
+**  Single-producer/single-consumer ring of preallocated frames. The
+**  producer fills the slot returned by beginWrite() and publishes it
+**  with commitWrite(). The consumer holds one slot between acquire()
+**  and release().
+**
+**  In the default (live) mode the consumer always takes the newest
+**  frame and discards the stale ones. When the ring is full the
+**  producer overwrites the oldest unread frame, never the one the
+**  consumer holds, so a new frame is always stored. Both kinds of
+**  loss are counted as drops. In lossless mode (offline sources)
+**  every frame is delivered in order and the producer waits for
+**  space.
+**
+**/
+class FrameRing
+{
+public:
+	FrameRing(size_t slots, bool lossless);
+	~FrameRing();
+
+	void preallocate(cv::Size size, int type);
+
+	// producer side
+	frameSlotType *beginWrite();
+	void commitWrite();
+	void close();
+
+	// consumer side
+	frameSlotType *acquire();
+	void release();
+
+	unsigned long drops() const			{ return dropCount.load(std::memory_order_relaxed); }
+
+private:
+	std::vector<frameSlotType> slot;
+	const bool lossless;
+
+	std::atomic<unsigned long> head;		// next slot to publish, owned by the producer
+	std::atomic<unsigned long> tail;		// oldest unread slot
+	std::atomic<unsigned long> held;		// slot the consumer is using, or FRAME_RING_NO_SLOT
+	std::atomic<bool> closed;
+	unsigned long writing;					// slot being filled, producer only
+	unsigned long nextSeq;					// frame the consumer expects next
+
+	sem_t filled;							// posted on every commit
+	sem_t freed;							// posted on every release (lossless only)
+
+	std::atomic<unsigned long> dropCount;	// frames overwritten or skipped unread
+};
+
+
+
+/*
+** FrameCapture
+**
+** Description
+**  Owns the capture thread. The thread grabs frames from the source
+**  into the ring until stop() is called or the source runs dry.
+**
+**/
+class FrameCapture
+{
+public:
+	FrameCapture(FrameSource *source, size_t slots);
+	~FrameCapture();
+
+	bool start();
+	void stop();
+
+	FrameRing& ring()					{ return frames; }
+	unsigned long captured() const		{ return capturedCount.load(std::memory_order_relaxed); }
+
+private:
+	void run();
+
+	FrameSource *source;
+	FrameRing frames;
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<unsigned long> capturedCount;
+};
+
+
+
+
+#endif /*FRAMECAPTURE_H_*/
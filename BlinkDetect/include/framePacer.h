@@ -0,0 +1,90 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Frame scheduler of the blink detector. Paces the detector
+				loop on absolute deadlines of the monotonic clock, so the
+				frame rate no longer depends on a GUI event wait.
+ ============================================================================
+ */
+
+
+#ifndef FRAMEPACER_H_
+#define FRAMEPACER_H_
+
+
+#include <stdint.h>
+
+
+/************************ Macros **************************************/
+
+#define FRAME_PACER_DEFAULT_FPS		15		// matches PIPELINE_FRAME_DEADLINE_MS
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct {
+
+	uint64_t periodNs;		// 0 runs at the rate frames arrive
+	uint64_t nextNs;		// deadline of the next frame
+	unsigned long late;		// periods skipped because a frame overran
+
+} framePacer_t;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** framePacer_init
+**
+** Description
+**  Sets the frame rate the detector loop is held to.
+**
+** Input Arguments:
+**  pacer		pointer to framePacer_t object
+**  fps			frames per second, 0 for no pacing
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void framePacer_init(framePacer_t *pacer, int fps);
+
+
+
+/*
+** framePacer_wait
+**
+** Description
+**  Sleeps until the start of the next frame period. A frame that
+**  overran its period does not make the following ones early: the
+**  periods it overran are skipped, not caught up.
+**
+** Input Arguments:
+**  pacer		pointer to framePacer_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Number of periods skipped
+**
+** Special Considerations:
+**  Returns at once without pacing. The sleep ends early on a signal.
+**
+**/
+unsigned long framePacer_wait(framePacer_t *pacer);
+
+
+
+
+#endif /*FRAMEPACER_H_*/
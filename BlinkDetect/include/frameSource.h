@@ -0,0 +1,102 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Frame source layer for the blink detector. Abstracts where
+				the grayscale frames come from so the vision pipeline can
+				run from the Pi camera, a V4L2 device, a recorded video
+				file or a directory of still frames.
+ ============================================================================
+ */
+
+
+#ifndef FRAMESOURCE_H_
+#define FRAMESOURCE_H_
+
+
+#include <string>
+#include "opencv2/core/core.hpp"
+
+
+/************************ Macros **************************************/
+
+// resolution the detector works at, sources deliver it when they can
+#define DETECT_FRAME_WIDTH		320
+#define DETECT_FRAME_HEIGHT		240
+
+
+/**************************** Data Types ******************************/
+
+
+/*
+** FrameSource
+**
+** Description
+**  Interface implemented by every frame source. The grab/retrieve split
+**  mirrors the raspicam and cv::VideoCapture API: grab() latches the
+**  next frame, retrieve() converts it into a single channel (CV_8UC1)
+**  image.
+**
+**  Live sources are paced by the hardware. Offline sources (video file,
+**  image directory) hand out frames as fast as they are requested and
+**  report the end of the stream by failing grab().
+**
+**  Zero-copy sources make retrieve() point the image at their own
+**  capture buffer instead of copying into it. The buffer belongs to
+**  the source until it is handed back with release().
+**
+**/
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	virtual bool open() = 0;
+	virtual bool grab() = 0;
+	virtual bool retrieve(cv::Mat& frame) = 0;
+	virtual void close() = 0;
+
+	virtual bool isZeroCopy() const		{ return false; }
+	virtual void release(const cv::Mat& frame)	{ (void)frame; }
+
+	virtual bool isLive() const = 0;
+	virtual const char *name() const = 0;
+};
+
+
+
+/************************ Function Prototypes *************************/
+
+
+/*
+** frameSource_create
+**
+** Description
+**  Creates a frame source from a textual specification:
+**    "raspicam"          Raspberry Pi camera (default)
+**    "v4l2[:<index>]"    V4L2 capture device, /dev/video<index>
+**    "v4l2mmap[:<index>]" V4L2 device, Y plane at the detector resolution,
+**                        zero-copy from the driver buffers
+**    "video:<path>"      recorded video file
+**    "images:<dir>"      directory of .pgm/.png frames, in name order
+**
+** Input Arguments:
+**  spec    source specification
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  A new (not yet opened) frame source, or NULL if the specification
+**  is invalid or the backend was not compiled in. Release with delete.
+**
+** Special Considerations:
+**  None
+**
+**/
+FrameSource *frameSource_create(const std::string& spec);
+
+
+
+
+#endif /*FRAMESOURCE_H_*/
@@ -0,0 +1,202 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Debug frame tap of the blink detector. The detector copies
+				the frame it just processed, with the face and eye
+				rectangles and its decisions, into a single shared memory
+				slot that a separate viewer process renders. Publishing
+				never waits: while the viewer holds the slot the frame is
+				dropped, and nothing is copied when no viewer is attached.
+ ============================================================================
+ */
+
+
+#ifndef FRAMETAP_H_
+#define FRAMETAP_H_
+
+
+#include <stdint.h>
+#include "opencv2/core/core.hpp"
+
+
+/************************ Macros **************************************/
+
+#define FRAME_TAP_NAME				"/blinkDtap"
+#define FRAME_TAP_MAX_PIXELS		(640 * 480)		// largest frame the slot holds
+#define FRAME_TAP_VIEWER_TIMEOUT_MS	1000			// viewer gone if silent this long
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct {
+
+	int32_t x, y, width, height;	// image coordinates, all 0 if none
+
+} frameTapRectType;
+
+
+// What the detector saw on the frame
+typedef struct {
+
+	uint32_t seq;					// frames published, assigned by the tap
+	uint32_t blinkCount;			// blinks since the detector started
+	uint64_t captureNs;				// CLOCK_MONOTONIC time the frame was grabbed
+	frameTapRectType face;			// face the eyes were searched in
+	frameTapRectType eye;			// eye found by the classifier
+	frameTapRectType trackedEye;	// eye followed by template matching
+	frameTapRectType hybridRegion;	// region the hybrid detector searched
+	uint8_t eyeClassifier;			// classifier found an open eye
+	uint8_t eyeHybrid;				// hybrid detector found an open eye
+	uint8_t hybridJoined;			// hybrid result arrived in time
+	uint8_t blink;					// a blink was reported on this frame
+
+} frameTapOverlayType;
+
+
+typedef struct frameTapShm frameTapShmType;
+
+typedef struct {
+
+	frameTapShmType *shm;
+	unsigned long published;		// frames copied into the slot (detector)
+	unsigned long dropped;			// frames dropped, the viewer held the slot (detector)
+	uint32_t readSeq;				// next frame to read (viewer)
+	uint64_t writingNs;				// since when the slot is seen being written, 0 if not (viewer)
+
+} frameTap_t;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** frameTap_open
+**
+** Description
+**  Maps the shared memory slot, creating it if it does not exist yet.
+**  The detector and the viewer may open in any order.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  None
+**
+**/
+int frameTap_open(frameTap_t *tap);
+
+
+
+/*
+** frameTap_wanted
+**
+** Description
+**  Tells the detector whether a viewer is attached, so it can skip
+**  building the overlay when nobody looks.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**  nowNs		CLOCK_MONOTONIC time
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if a viewer read the slot in the last FRAME_TAP_VIEWER_TIMEOUT_MS
+**
+** Special Considerations:
+**  One shared memory load.
+**
+**/
+int frameTap_wanted(frameTap_t *tap, uint64_t nowNs);
+
+
+
+/*
+** frameTap_publish
+**
+** Description
+**  Copies a frame and its overlay into the slot and wakes the viewer.
+**  An unread older frame is replaced; a frame arriving while the
+**  viewer copies the slot out is dropped.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**  frame		CV_8UC1 frame, at most FRAME_TAP_MAX_PIXELS
+**  overlay		what the detector saw, the seq field is filled in
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the frame was published, 0 if it was dropped.
+**
+** Special Considerations:
+**  Single producer. Never blocks.
+**
+**/
+int frameTap_publish(frameTap_t *tap, const cv::Mat& frame, frameTapOverlayType *overlay);
+
+
+
+/*
+** frameTap_read
+**
+** Description
+**  Waits for a frame newer than the last one read and copies it out
+**  of the slot. Also tells the detector a viewer is attached.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**  timeoutMs	maximum time to wait
+**
+** Output Arguments:
+**  frame		copy of the frame
+**  overlay		what the detector saw
+**
+** Function Return:
+**  1 if a frame was read, 0 on timeout.
+**
+** Special Considerations:
+**  Single viewer.
+**
+**/
+int frameTap_read(frameTap_t *tap, cv::Mat& frame, frameTapOverlayType *overlay, int timeoutMs);
+
+
+
+/*
+** frameTap_close
+**
+** Description
+**  Unmaps the slot. The shared memory object is left in place for the
+**  other side.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void frameTap_close(frameTap_t *tap);
+
+
+
+
+#endif /*FRAMETAP_H_*/
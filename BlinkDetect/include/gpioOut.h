@@ -0,0 +1,118 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : GPIO output line for the blink detector. The line is opened
+				once and then driven with a single write per change, so
+				the per-frame path never forks a shell.
+ ============================================================================
+ */
+
+
+#ifndef GPIOOUT_H_
+#define GPIOOUT_H_
+
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	GPIO_OUT_SYSFS,			// /sys/class/gpio/gpioN/value
+	GPIO_OUT_CHARDEV,		// /dev/gpiochip0 line handle
+	GPIO_OUT_MOCK			// no hardware, only records the writes
+} gpioOutBackendType;
+
+
+typedef struct {
+
+	gpioOutBackendType backend;
+	int pin;
+	int fd;					// value file or line handle, -1 if none
+	int state;				// last level written, -1 if unknown
+	unsigned long writes;	// level changes driven on the line
+
+} gpioOut_t;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** gpioOut_open
+**
+** Description
+**  Configures the pin as an output and keeps its handle open for
+**  the following set/clear calls.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**  pin			BCM GPIO number
+**  backend		how to drive the pin
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioOut_open(gpioOut_t *line, int pin, gpioOutBackendType backend);
+
+
+
+/*
+** gpioOut_set / gpioOut_clear
+**
+** Description
+**  Drives the line high / low. Nothing is written if the line is
+**  already at that level, otherwise exactly one write (sysfs) or one
+**  ioctl (chardev) is issued.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioOut_set(gpioOut_t *line);
+void gpioOut_clear(gpioOut_t *line);
+
+
+
+/*
+** gpioOut_close
+**
+** Description
+**  Releases the line handle.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioOut_close(gpioOut_t *line);
+
+
+
+
+#endif /*GPIOOUT_H_*/
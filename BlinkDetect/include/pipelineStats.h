@@ -0,0 +1,162 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Per-stage latency instrumentation for the vision pipeline.
+				Stage timings go into lock-free fixed-bucket histograms
+				that are dumped periodically as p50/p95/p99 together
+				with the achieved frame rate.
+ ============================================================================
+ */
+
+
+#ifndef PIPELINESTATS_H_
+#define PIPELINESTATS_H_
+
+
+#include <stdint.h>
+
+
+/************************ Macros **************************************/
+
+#define PIPELINE_STATS_PERIOD_SEC		10		// dump interval
+#define PIPELINE_FRAME_DEADLINE_MS		66		// frame budget (15 fps)
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	STAGE_GRAB,
+	STAGE_RETRIEVE,
+	STAGE_RESIZE,
+	STAGE_EQUALIZE,
+	STAGE_FACE_DETECT,
+	STAGE_EYE_TRACK,
+	STAGE_EYES_CLASSIFIER,
+	STAGE_EYES_HYBRID,
+	STAGE_EYES_JOIN,		// detector thread waiting for the hybrid detector
+	STAGE_FRAME,			// detector time per frame, resize to decision
+	STAGE_CAPTURE_TO_DECISION,	// frame grabbed to blink decision
+	NUM_PIPELINE_STAGES
+} pipelineStageType;
+
+
+// Stage times of one frame. Travels with the frame from the capture
+// thread (frame slot) and the hybrid worker (job) to the detector,
+// which charges a deadline miss with it.
+typedef struct {
+
+	uint64_t stageNs[NUM_PIPELINE_STAGES];
+
+} pipelineFrameType;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** pipelineStats_now
+**
+** Description
+**  Reads the monotonic clock.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+uint64_t pipelineStats_now(void);
+
+
+
+/*
+** pipelineStats_record
+**
+** Description
+**  Records the time elapsed since start for the given stage. The
+**  return value can be passed as the start of the next stage.
+**
+** Input Arguments:
+**  stage		pipeline stage
+**  start		stage start time, from pipelineStats_now()
+**  frame		stage times of the frame to add it to, NULL for none
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Current time in nanoseconds
+**
+** Special Considerations:
+**  Wait-free, may be called from any thread. frame belongs to the
+**  caller.
+**
+**/
+uint64_t pipelineStats_record(pipelineStageType stage, uint64_t start, pipelineFrameType *frame = NULL);
+
+
+
+/*
+** pipelineStats_frameDone
+**
+** Description
+**  Closes a frame. The frame time is recorded and, if it is over the
+**  deadline, the miss is charged to the slowest stage of that frame,
+**  on whichever thread it ran. The statistics are dumped when the
+**  reporting period has elapsed.
+**
+** Input Arguments:
+**  frame			stage times of the frame
+**  frameStart		time the frame processing started
+**  captureStart	time the frame was grabbed
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Call from the detector thread only.
+**
+**/
+void pipelineStats_frameDone(const pipelineFrameType *frame, uint64_t frameStart, uint64_t captureStart);
+
+
+
+/*
+** pipelineStats_dump
+**
+** Description
+**  Prints the statistics gathered since the last dump and starts a
+**  new reporting period.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void pipelineStats_dump(void);
+
+
+
+
+#endif /*PIPELINESTATS_H_*/
@@ -0,0 +1,88 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Small persistent worker pool for the vision pipeline. The
+				threads are started once and run short per-frame jobs, so
+				no thread is created on the frame path.
+ ============================================================================
+ */
+
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <stdint.h>
+
+
+/**************************** Data Types ******************************/
+
+
+
+/*
+** WorkerPool
+**
+** Description
+**  Fixed set of worker threads. post() hands a job to an idle worker
+**  and never queues: when every worker is still busy the job is
+**  refused, so a late job cannot pile up work behind it.
+**
+**/
+class WorkerPool
+{
+public:
+	WorkerPool(int threads);
+	~WorkerPool();
+
+	bool post(const std::function<void()>& job);
+
+	unsigned long refused() const		{ return refusedCount.load(std::memory_order_relaxed); }
+
+private:
+	void run();
+
+	std::vector<std::thread> worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::vector<std::function<void()> > jobs;	// at most one per idle worker
+	int idle;
+	bool running;
+
+	std::atomic<unsigned long> refusedCount;
+};
+
+
+
+/*
+** JobLatch
+**
+** Description
+**  Joins the jobs of one frame. Every posted job calls done() once;
+**  the frame waits for them with waitUntil(), bounded by its deadline.
+**
+**/
+class JobLatch
+{
+public:
+	JobLatch(int jobs);
+
+	void done();
+	bool waitUntil(uint64_t deadlineNs);
+
+private:
+	std::mutex lock;
+	std::condition_variable finished;
+	int pending;
+};
+
+
+
+
+#endif /*WORKERPOOL_H_*/
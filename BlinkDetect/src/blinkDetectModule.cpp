@@ -15,33 +15,80 @@
 
 
 #include <iostream>
+#include <memory>
+#include <algorithm>
 #include "opencv2/objdetect/objdetect.hpp"
+#ifndef HEADLESS
 #include "opencv2/highgui/highgui.hpp"
+#endif
 #include "opencv2/imgproc/imgproc.hpp"
-#include "opencv2/videoio.hpp"
-#include <raspicam/raspicamtypes.h>
-#include <raspicam/raspicam_cv.h>
 
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+
+#include "../include/blinkDetectModule.h"
+#include "../include/frameSource.h"
+#include "../include/frameCapture.h"
+#include "../include/pipelineStats.h"
+#include "../include/faceLocator.h"
+#include "../include/workerPool.h"
+#include "../include/framePacer.h"
+#include "../include/frameTap.h"
+#include "../../DrowsyDetect/include/blinkChannel.h"
 
 
 
 /************************ Macros **************************************/
 
 #define BUFFER_SIZE		3
+#define BLINK_GPIO_PIN	24
+
+// debug drawing needs highgui and a display, the headless build
+// compiles it out
+#ifdef HEADLESS
+#define DEBUG_DRAW(statement)
+#else
+#define DEBUG_DRAW(statement)	statement
+#endif
+
+
+/**************************** Data Types ******************************/
+
+// Hybrid detector job of one frame. Shared with the worker, so a job
+// that misses its deadline still has somewhere to finish into.
+struct hybridJobType
+{
+	hybridJobType(const cv::Mat& faceROI) : latch(1), faceROI(faceROI), eyeFound(false), eyeOpen(0), hybridNs(0) {}
+
+	JobLatch latch;
+	cv::Mat faceROI;
+	bool eyeFound;
+	float eyeOpen;
+	uint64_t hybridNs;			// time the worker spent on it
+};
 
 
 /********************* LOCAL Function Prototypes **********************/
 
-void trackEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect);
-double detectEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect);
+double trackEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect);
+void captureEyeTemplate(cv::Mat& im, cv::Rect& eye, cv::Mat& tpl);
+double detectEye(cv::Mat& im, cv::Rect& face, cv::Mat& tpl, cv::Rect& rect);
 double findEyes_contours(cv::Mat frame_gray, cv::Rect face);
-bool findEyes_classifier(cv::Mat frame_gray, cv::Rect face);
-bool findEyes_hybrid(cv::Mat frame_gray, cv::Rect face);
+bool findEyes_classifier(cv::Mat eyeROI, cv::Rect *eye = NULL);
+bool findEyes_hybrid(cv::Mat faceROI, float *eyeOpen = NULL);
+static cv::Rect hybridEyeRegion(cv::Size face);
+static void hybridJob(std::shared_ptr<hybridJobType> job);
+static frameTapRectType tapRect(const cv::Rect& r);
+static void eyeSample(uint64_t captureNs, float eyeOpen);
+static void eyeSamplesFlush(void);
+bool detectFace(cv::Mat& im, cv::Rect& face);
+static double elapsedSeconds(const struct timespec *start);
 
 /*************************** Globals **********************************/
 
@@ -51,9 +98,42 @@ cv::CascadeClassifier eye_cascade;
 cv::CascadeClassifier eye_cascade_EYE;
 
 
-// named pipe variables
-static int fd_fifo = -1;
-static const char myfifo[] = "/tmp/blinkDfifo";
+// blink events to the sensor fusion
+static blinkChannel_t blinkEvents;
+static uint64_t frameCaptureNs = 0;		// capture time of the frame being processed
+static pipelineFrameType frameTiming;		// stage times of the frame being processed
+
+// blinks detected since start-up
+static int blinkCount = 0;
+
+// eye-openness samples not yet published
+static blinkEventType eyeBatch;
+
+// debug frames for an out-of-process viewer
+static frameTap_t frameTap;
+static frameTapOverlayType tapOverlay;		// filled in by detectEye
+
+// set by blinkDetect_stop()
+static volatile sig_atomic_t stopRequested = 0;
+
+// blink indicator output
+static gpioOut_t blinkGpio;
+
+// face tracking state
+static bool faceTracking = false;
+static cv::Rect lastFace;
+static int framesSinceFullScan = 0;
+static unsigned long faceFullScans = 0;
+static unsigned long faceTrackedFrames = 0;
+
+// eye tracking state
+static bool eyeTracking = false;
+static unsigned long eyeTrackedFrames = 0;
+static unsigned long eyeTemplateCaptures = 0;
+
+// eye detectors running side by side, NULL runs them one after the other
+static WorkerPool *eyeWorkers = NULL;
+static unsigned long eyeJoinMisses = 0;
 
 // Debugging
 static const bool kPlotVectorField = false;
@@ -82,6 +162,21 @@ static const float kPostProcessThreshold = 0.97;
 // Eye Corner
 static const bool kEnableEyeCorner = false;
 
+// Face tracking
+static const int kFaceTrackPaddingPercent = 30;		// search window growth around the last face
+static const int kFaceTrackSizePercent = 20;		// allowed face size change between frames
+static const int kFaceFullScanInterval = 30;		// frames between forced full-frame scans
+
+// Eye tracking
+static const int kEyeTrackPyramidLevel = 1;			// template matching runs at 1/2^level scale
+static const double kEyeTrackMaxScore = 0.2;		// worst CV_TM_SQDIFF_NORMED score still tracked
+
+// Eye detectors
+static const int kEyeWorkerThreads = 1;				// the classifier runs on the detector thread
+static const int kEyeJoinDeadlineMs = 40;			// longest wait for the hybrid detector
+static const int kEyeOpenFullHits = 8;				// open-eye cascade hits that score fully open
+static const int kEyeBatchMaxMs = 200;				// oldest eye sample held back from the fusion
+
 /************************** Namespaces ********************************/
 
 using namespace std;
@@ -100,8 +195,12 @@ using namespace cv;
 **  Main function of the blink detect module. This module calls 
 **  the other functions required to detect the blink of the eye.
 **
+**  In replay mode the frames are processed as fast as the pipeline
+**  allows, the GPIO and the blink channel are left alone and the achieved
+**  frames/sec is reported when the source runs out of frames.
+**
 ** Input Arguments:
-**  None
+**  options		frame source and run mode
 **
 ** Output Arguments:
 **  None
@@ -115,38 +214,45 @@ using namespace cv;
 **/
 
 //void *blinkDetect_task(void *arg)
-int blinkDetect_task()
+int blinkDetect_task(const blinkDetectOptionsType *options)
 {
 	// welcome message
 	cout << "blinkdetect: Task Started " << endl;
 	
+	faceTracking = options->trackFace;
+	eyeTracking = options->trackEyes;
 	
-	int ret = system("echo \"24\" > /sys/class/gpio/export");
-	ret = system("echo \"out\" > /sys/class/gpio/gpio24/direction");
-	ret = system("echo \"out\" > /sys/class/gpio/gpio24/direction");
-	
+	// the blink indicator is only driven on the target, replay records it
+	if (!gpioOut_open(&blinkGpio, BLINK_GPIO_PIN, options->replay ? GPIO_OUT_MOCK : options->gpio))
+	{
+		cerr << "blinkdetect: Error opening GPIO " << BLINK_GPIO_PIN << endl;
+		gpioOut_open(&blinkGpio, BLINK_GPIO_PIN, GPIO_OUT_MOCK);
+	}
 	
+	if (options->frameTap && !frameTap_open(&frameTap))
+	{
+		cerr << "blinkdetect: Error opening the frame tap " << FRAME_TAP_NAME << endl;
+	}
 	
-
-//cout << "blinkdetect: opening pipe 1" << endl;
-    // create the FIFO (named pipe) 
-    mkfifo(myfifo, 0666);
-//cout << "blinkdetect: opening pipe 2" << endl;
-    // open the named pipe as write only
-    fd_fifo = open(myfifo, O_WRONLY);
-    //fd_fifo = open(myfifo, O_RDWR);
- //cout << "blinkdetect: opening pipe 3" << endl;   
+	if (!options->replay)
+	{
+		// open the blink event channel to the sensor fusion
+		if (!blinkChannel_open(&blinkEvents))
+		{
+			cerr << "blinkdetect: Error opening the blink channel " << BLINK_CHANNEL_NAME << endl;
+		}
+	}
     
    
     
 #if 0   
-	char buffer[5]; 
-	cout << "blinkdetect: testing FIFO " << endl;
+	blinkEventType event = { 0, BLINK_EVENT_BLINK, 0, 0, 1.0f, 0.0f, 0 };
+	cout << "blinkdetect: testing blink channel " << endl;
     for(int i = 0; i < 5; i++)
     {
-		snprintf(buffer,5, "%2d", i+2);
-		write(fd_fifo, buffer, sizeof(buffer));
-		//fprintf(fd_fifo, "%2d", i+1);
+		event.captureNs = pipelineStats_now();
+		event.blinkCount = i + 2;
+		blinkChannel_publish(&blinkEvents, &event);
 		sleep(2);
 	}
 	
@@ -167,22 +273,24 @@ int blinkDetect_task()
 	
 	
 	
-    // Open webcam
-    cv::Mat image_cam;
-    raspicam::RaspiCam_Cv Camera;
-    Camera.set( CV_CAP_PROP_FORMAT, CV_8UC1 );   
-    
+    // Open the frame source (camera by default)
+    FrameSource *Camera = frameSource_create(options->source);
+    if (Camera == NULL)
+    {
+		return 0;
+	}
     
-    cout<<"blinkdetect: Opening Camera..."<<endl;
-    int cam_open = Camera.open();
-    if (!cam_open) 
+    cout<<"blinkdetect: Opening frame source " << Camera->name() << "..."<<endl;
+    if (!Camera->open()) 
     {
-		cerr<<"blinkdetect: Error opening the camera"<<endl;
+		cerr<<"blinkdetect: Error opening the frame source"<<endl;
+		delete Camera;
 		return 0;
 	}
 	if (face_cascade.empty() || eye_cascade.empty() || eye_cascade_EYE.empty())
 	{
 		cerr<< "blinkdetect: Error in template load." << endl;
+		delete Camera;
 		return 0;
 	}
     
@@ -198,46 +306,171 @@ int blinkDetect_task()
 	cv::Mat eye_tpl;
 	cv::Rect eye_bb;
 	
-	Size size(320,240);
+	Size size(DETECT_FRAME_WIDTH, DETECT_FRAME_HEIGHT);
 	cv::Mat image;
 
 	
 	cout << "blinkdetect: Let's begin!" << endl;
 	
+	// frames are grabbed on their own thread, the detector always
+	// works on the newest one (every one for offline sources)
+	FrameCapture capture(Camera, FRAME_RING_SLOTS);
+	capture.start();
+	
+	// the face is located on its own thread at a low rate, the eye
+	// state is classified inside the latest face on every frame
+	FaceLocator *locator = NULL;
+	if (options->faceRateHz > 0)
+	{
+		locator = new FaceLocator(detectFace, options->faceRateHz);
+		locator->start();
+	}
+	
+	if (options->parallelEyes)
+	{
+		eyeWorkers = new WorkerPool(kEyeWorkerThreads);
+	}
+	
+	// live frames are paced by the frame scheduler, replay runs flat out
+	framePacer_t pacer;
+	framePacer_init(&pacer, options->replay ? 0 : options->fps);
+	
+	unsigned long frames = 0;
+	unsigned long framesWithoutFace = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
-	while (cv::waitKey(15) != 'q')
+	while (!stopRequested)
 	{
+		framePacer_wait(&pacer);
+		
 		//cap >> frame;
-		Camera.grab();
-		Camera.retrieve (image_cam);
-		if (image_cam.empty())
+		frameSlotType *frame = capture.ring().acquire();
+		if (frame == NULL)
 		{
-			cout << "blinkdetect: ERROR -- No image read from camera -- terminating" << endl;
+			if (!Camera->isLive())
+			{
+				cout << "blinkdetect: end of stream" << endl;
+			}
+			else
+			{
+				cout << "blinkdetect: ERROR -- No image read from camera -- terminating" << endl;
+			}
 			break;
 		}
 			
-		// Resizing the image to a smaller size
-		resize(image_cam, image, size); 
+		uint64_t frameStart = pipelineStats_now();
+		uint64_t captureStart = frame->stamp.tv_sec * 1000000000ULL + frame->stamp.tv_nsec;
+		frameTiming = frame->timing;
+		
+		// Resizing the image to a smaller size, unless the source
+		// already delivers the detector resolution
+		cv::Mat input = frame->image;
+		if (input.size() != size)
+		{
+			resize(frame->image, image, size); 
+			input = image;
+		}
+		uint64_t t = pipelineStats_record(STAGE_RESIZE, frameStart, &frameTiming);
 
 		// Convert to grayscale and 
-		// adjust the image contrast using histogram equalization
+		// adjust the image contrast using histogram equalization,
+		// then hand the buffer back to the capture thread
 		cv::Mat gray;
 		//cv::cvtColor(image, gray, CV_BGR2GRAY);
-		cv::equalizeHist(image, gray);
+		cv::equalizeHist(input, gray);
+		capture.ring().release();
+		pipelineStats_record(STAGE_EQUALIZE, t, &frameTiming);
 				
-		
-		system("echo \"0\" > /sys/class/gpio/gpio24/value");
+		gpioOut_clear(&blinkGpio);
+				
+		// Find the face
+		cv::Rect face;
+		bool faceFound;
+		if (locator != NULL)
+		{
+			locator->submit(gray, captureStart);
+			faceFound = locator->latest(face, captureStart);
+		}
+		else
+		{
+			t = pipelineStats_now();
+			faceFound = detectFace(gray, face);
+			pipelineStats_record(STAGE_FACE_DETECT, t, &frameTiming);
+		}
+		if (!faceFound)
+		{
+			face = cv::Rect();
+			framesWithoutFace++;
+		}
 				
 		// Find the eyes
-		detectEye(gray, eye_tpl, eye_bb);	
+		frameCaptureNs = captureStart;
+		memset(&tapOverlay, 0, sizeof(tapOverlay));
+		detectEye(gray, face, eye_tpl, eye_bb);	
+		frames++;
+		
+		// show a viewer what the detector saw, if one is attached
+		if (frameTap_wanted(&frameTap, captureStart))
+		{
+			tapOverlay.captureNs = captureStart;
+			tapOverlay.blinkCount = blinkCount;
+			frameTap_publish(&frameTap, gray, &tapOverlay);
+		}
+		
+		pipelineStats_frameDone(&frameTiming, frameStart, captureStart);
+	}
 	
+	capture.stop();
+	if (locator != NULL)
+	{
+		locator->stop();
+	}
+	pipelineStats_dump();
+	
+	// report the achieved throughput
+	double seconds = elapsedSeconds(&start);
+	cout << "blinkdetect: " << frames << " frames in " << seconds << " s ("
+		 << ((seconds > 0) ? frames / seconds : 0) << " frames/sec), "
+		 << blinkCount << " blinks" << endl;
+	if (pacer.periodNs != 0)
+	{
+		cout << "blinkdetect: paced at " << options->fps << " frames/sec, "
+			 << pacer.late << " periods overrun" << endl;
+	}
+	cout << "blinkdetect: " << capture.captured() << " frames captured, "
+		 << capture.ring().drops() << " frames dropped" << endl;
+	cout << "blinkdetect: face " << faceTrackedFrames << " frames tracked, "
+		 << faceFullScans << " full-frame scans, "
+		 << framesWithoutFace << " frames without a face" << endl;
+	if (locator != NULL)
+	{
+		cout << "blinkdetect: face located " << locator->located() << " times at "
+			 << options->faceRateHz << " Hz" << endl;
+		delete locator;
 	}
+	if (options->frameTap)
+	{
+		cout << "blinkdetect: frame tap " << frameTap.published << " frames shown, "
+			 << frameTap.dropped << " dropped" << endl;
+	}
+	cout << "blinkdetect: eye " << eyeTrackedFrames << " frames tracked, "
+		 << eyeTemplateCaptures << " template captures" << endl;
+	if (eyeWorkers != NULL)
+	{
+		cout << "blinkdetect: eyes " << eyeJoinMisses << " frames without a hybrid result" << endl;
+		delete eyeWorkers;
+		eyeWorkers = NULL;
+	}
+	
+	Camera->close();
+	delete Camera;
 #endif	
 	// close
-	close(fd_fifo);
-	
-	// remove the FIFO 
-    unlink(myfifo);
+	frameTap_close(&frameTap);
+	gpioOut_close(&blinkGpio);
+	eyeSamplesFlush();
+	blinkChannel_close(&blinkEvents);
 
 	return 0;
 }
@@ -245,21 +478,96 @@ int blinkDetect_task()
 
 
 
+/*
+** blinkDetect_stop
+**
+** Description
+**  Asks blinkDetect_task to finish the current frame and return.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Async-signal-safe, may be called from a signal handler.
+**
+**/
+void blinkDetect_stop(void)
+{
+	stopRequested = 1;
+}
+
+
+
+
+/*
+** elapsedSeconds
+**
+** Description
+**  Seconds elapsed on the monotonic clock since the given time.
+**
+** Input Arguments:
+**  start		start time, from clock_gettime(CLOCK_MONOTONIC)
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Elapsed time in seconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static double elapsedSeconds(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+
+
  
  
 /*
 ** detectEye
 **
 ** Description
-**  Finds the face on an image frame using face cascade
+**  Looks for the eyes inside the face found by the face cascade,
+**  either on this frame or, with the face locator running, on a
+**  recent one.
+**
+**  The two eye detectors share one face ROI. With the worker pool
+**  running, the hybrid detector runs on a worker while the
+**  classifier runs here, and its result is awaited for at most
+**  kEyeJoinDeadlineMs. A frame without a hybrid result makes no blink
+**  decision.
+**
+**  Every frame also hands its eye openness, scored by the hybrid
+**  detector where the classifier sees the eye, to eyeSample().
+**
+**  With eye tracking enabled the eye found by the classifier is kept
+**  as a template and followed by template matching on the next
+**  frames. While the track holds, the eye classifier only searches
+**  around the tracked eye instead of the whole face. When the match
+**  score degrades the track is dropped and the eye is detected again.
 **
 ** Input Arguments:
 **  im    The source image
-**  tpl   Will be filled with the face template, if detection is successful
-**  rect  Will be filled with the face bounding box, will be updated with the new location of the face
+**  face  The face bounding box, empty if there is no face
+**  tpl   Will be filled with the eye template, if detection is successful
+**  rect  Will be filled with the eye bounding box, will be updated with the new location of the eye
 **
 ** Output Arguments:
-**  rect  The face bounding box, will be updated with the new location of the face
+**  rect  The eye bounding box, will be updated with the new location of the eye
 **
 ** Function Return:
 **  None
@@ -268,30 +576,135 @@ int blinkDetect_task()
 **  None
 **
 **/
-double detectEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect)
+double detectEye(cv::Mat& im, cv::Rect& face, cv::Mat& tpl, cv::Rect& rect)
 {
 	bool ret1 = false, ret2 = false;
-	static int counter = 1;
+	float eyeOpen = -1.0f;
 	double sum = 0;	
-	std::vector<cv::Rect> faces;
-	face_cascade.detectMultiScale(im, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, cv::Size(30,30));
+	uint64_t t = pipelineStats_now();
 
 	// Find the face first, then look for the eyes
 	//for (unsigned int i = 0; i < faces.size(); i++)
-	if (faces.size() > 0)
+	if (face.area() > 0)
 	{
-		//sum = findEyes_contours(im, faces[0]);
-		ret1 = findEyes_classifier(im, faces[0]);	
-		ret2 = findEyes_hybrid(im, faces[0]);	
+		// one face ROI for both detectors
+		cv::Mat faceROI = im(face);
+		
+		std::shared_ptr<hybridJobType> job;
+		if (eyeWorkers != NULL)
+		{
+			job = std::make_shared<hybridJobType>(faceROI);
+			if (!eyeWorkers->post(std::bind(hybridJob, job)))
+			{
+				// the last frame's job is still running late
+				job.reset();
+			}
+		}
+		uint64_t posted = t;
+		tapOverlay.face = tapRect(face);
+		tapOverlay.hybridRegion = tapRect(hybridEyeRegion(face.size()) + face.tl());
+		
+		// follow the eye from the previous frame
+		cv::Rect eyeRegion = face;
+		if (eyeTracking && rect.area() > 0)
+		{
+			trackEye(im, tpl, rect);
+			t = pipelineStats_record(STAGE_EYE_TRACK, t, &frameTiming);
+			
+			if (rect.area() > 0)
+			{
+				// classify only around the tracked eye
+				eyeRegion = cv::Rect(rect.x - rect.width / 2, rect.y - rect.height / 2,
+									 rect.width * 2, rect.height * 2);
+				eyeRegion &= cv::Rect(0, 0, im.cols, im.rows);
+				eyeTrackedFrames++;
+			}
+		}
+		
+		//sum = findEyes_contours(im, face);
+		cv::Rect eye;
+		ret1 = findEyes_classifier((eyeRegion == face) ? faceROI : im(eyeRegion), &eye);	
+		t = pipelineStats_record(STAGE_EYES_CLASSIFIER, t, &frameTiming);
+		
+		// (re)acquire the eye template
+		if (eyeTracking && rect.area() == 0 && ret1)
+		{
+			rect = cv::Rect(eye.x + eyeRegion.x, eye.y + eyeRegion.y, eye.width, eye.height);
+			captureEyeTemplate(im, rect, tpl);
+		}
+		if (ret1)
+		{
+			tapOverlay.eye = tapRect(eye + eyeRegion.tl());
+		}
+		tapOverlay.trackedEye = tapRect(rect);
+		tapOverlay.eyeClassifier = ret1;
+		
+		bool joined = true;
+		if (eyeWorkers == NULL)
+		{
+			ret2 = findEyes_hybrid(faceROI, &eyeOpen);	
+			pipelineStats_record(STAGE_EYES_HYBRID, t, &frameTiming);
+		}
+		else
+		{
+			joined = (job != NULL) && job->latch.waitUntil(posted + kEyeJoinDeadlineMs * 1000000ULL);
+			pipelineStats_record(STAGE_EYES_JOIN, t, &frameTiming);
+			if (joined)
+			{
+				ret2 = job->eyeFound;
+				eyeOpen = job->eyeOpen;
+				frameTiming.stageNs[STAGE_EYES_HYBRID] += job->hybridNs;
+			}
+			else
+			{
+				eyeJoinMisses++;
+			}
+		}
 		
-		if (ret1 == true && ret2 == false)
+		if (joined)
 		{
-			//cerr << "blink # " << counter << endl;
-			system("echo \"1\" > /sys/class/gpio/gpio24/value");
-			write(fd_fifo, (void *)&counter, sizeof(counter));
-			counter++;
+			// the worker is done with the frame, safe to draw on it
+			DEBUG_DRAW(cv::rectangle(faceROI, hybridEyeRegion(faceROI.size()), CV_RGB(0,255,0)));
 		}
+		
+		tapOverlay.eyeHybrid = ret2;
+		tapOverlay.hybridJoined = joined;
+		
+		// the openness only means something where the eye is seen
+		if (!joined || !ret1)
+		{
+			eyeOpen = -1.0f;
+		}
+		
+		if (joined && ret1 == true && ret2 == false)
+		{
+			tapOverlay.blink = 1;
+			//cerr << "blink # " << blinkCount << endl;
+			gpioOut_set(&blinkGpio);
+			blinkCount++;
+			
+			// keep the event behind the samples of the frames before it
+			eyeSamplesFlush();
+			
+			// stamped with the capture time so the fusion side sees
+			// when the eye closed, not when we got around to it
+			blinkEventType event;
+			event.kind = BLINK_EVENT_BLINK;
+			event.captureNs = frameCaptureNs;
+			event.blinkCount = blinkCount;
+			event.eyeOpenClassifier = ret1 ? 1.0f : 0.0f;
+			event.eyeOpenHybrid = ret2 ? 1.0f : 0.0f;
+			event.samples = 0;
+			blinkChannel_publish(&blinkEvents, &event);
+		}
+	}
+	else
+	{
+		// no face, drop the eye track
+		rect = cv::Rect();
 	}
+	
+	eyeSample(frameCaptureNs, eyeOpen);
 
 	return sum;
 }
@@ -299,6 +712,81 @@ double detectEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect)
 
 
 
+/*
+** detectFace
+**
+** Description
+**  Finds the face on an image frame using the face cascade. With face
+**  tracking enabled the cascade only searches a padded window around
+**  the previous face, at sizes close to the previous one. The whole
+**  frame is scanned when the face is lost and every
+**  kFaceFullScanInterval frames, to pick up a new or moved face.
+**
+**  Runs on the face locator thread when the face is located
+**  asynchronously, on the detector thread otherwise.
+**
+** Input Arguments:
+**  im    The source image
+**
+** Output Arguments:
+**  face  The face bounding box, in image coordinates
+**
+** Function Return:
+**  true if a face was found
+**
+** Special Considerations:
+**  None
+**
+**/
+bool detectFace(cv::Mat& im, cv::Rect& face)
+{
+	std::vector<cv::Rect> faces;
+	
+	if (faceTracking && lastFace.area() > 0 && framesSinceFullScan < kFaceFullScanInterval)
+	{
+		// search window: the last face grown on every side
+		int padX = lastFace.width * kFaceTrackPaddingPercent / 100;
+		int padY = lastFace.height * kFaceTrackPaddingPercent / 100;
+		cv::Rect window(lastFace.x - padX, lastFace.y - padY,
+						lastFace.width + 2 * padX, lastFace.height + 2 * padY);
+		window &= cv::Rect(0, 0, im.cols, im.rows);
+		
+		cv::Size minSize(lastFace.width * (100 - kFaceTrackSizePercent) / 100,
+						 lastFace.height * (100 - kFaceTrackSizePercent) / 100);
+		cv::Size maxSize(lastFace.width * (100 + kFaceTrackSizePercent) / 100,
+						 lastFace.height * (100 + kFaceTrackSizePercent) / 100);
+		
+		face_cascade.detectMultiScale(im(window), faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, minSize, maxSize);
+		framesSinceFullScan++;
+		
+		if (faces.size() > 0)
+		{
+			face = cv::Rect(faces[0].x + window.x, faces[0].y + window.y, faces[0].width, faces[0].height);
+			lastFace = face;
+			faceTrackedFrames++;
+			return true;
+		}
+		// tracking lost -- reacquire on the whole frame
+	}
+	
+	face_cascade.detectMultiScale(im, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, cv::Size(30,30));
+	framesSinceFullScan = 0;
+	faceFullScans++;
+	
+	if (faces.size() > 0)
+	{
+		face = faces[0];
+		lastFace = face;
+		return true;
+	}
+	
+	lastFace = cv::Rect();
+	return false;
+}
+
+
+
+
 
 /*
 ** findEyes_contours
@@ -370,7 +858,7 @@ double findEyes_contours(cv::Mat frame_gray, cv::Rect face)
     {
         cv::drawContours(contourImage, contours, idx, colors[idx % 3]);
     }
-	cv::imshow("Contours", contourImage);		
+	DEBUG_DRAW(cv::imshow("Contours", contourImage));		
 	
 	// Get contours info
 	//cout << "# of contour points: " << contours[0].size() << endl ;
@@ -406,12 +894,11 @@ double findEyes_contours(cv::Mat frame_gray, cv::Rect face)
 **  Find eyes based on a face image using cascade classifiers for eyes
 **
 ** Input Arguments:
-**  frame_gray    	grayscale image from the camera
-**  Rect			rectangle indicating location of face
+**  eyeROI			grayscale face, or the part of it around the tracked eye
 **  
 **
 ** Output Arguments:
-**  None
+**  eye				if not NULL, the first eye found, relative to eyeROI
 **
 ** Function Return:
 **  1
@@ -420,23 +907,26 @@ double findEyes_contours(cv::Mat frame_gray, cv::Rect face)
 **  None
 **
 **/
-bool findEyes_classifier(cv::Mat frame_gray, cv::Rect face) 
+bool findEyes_classifier(cv::Mat eyeROI, cv::Rect *eye) 
 {
 	bool eyeDetected = false;
 	
-	cv::Mat faceROI = frame_gray(face);
-	//cv::imshow("face", faceROI);	
+	//cv::imshow("face", eyeROI);	
 
 	
 	std::vector<cv::Rect> eyes;
 	try
 	{
-		eye_cascade.detectMultiScale(faceROI, eyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE); //, cv::Size(5,5));
+		eye_cascade.detectMultiScale(eyeROI, eyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE); //, cv::Size(5,5));
 		if (eyes.size() > 0)
 		{
 			//cv::Mat eyeDetected = faceROI(eyes[0]);
 			//cv::imshow("Left Eye", eyeDetected);
 			//cv::waitKey(5);
+			if (eye != NULL)
+			{
+				*eye = eyes[0];
+			}
 			eyeDetected = true;
 		}
 		else
@@ -464,41 +954,26 @@ bool findEyes_classifier(cv::Mat frame_gray, cv::Rect face)
 **  relative measurements for eyes
 **
 ** Input Arguments:
-**  frame_gray    	grayscale image from the camera
-**  Rect			rectangle indicating location of face
+**  faceROI    		grayscale face
 **  
 **
 ** Output Arguments:
-**  None
+**  eyeOpen			eye openness, 0 (closed) to 1 (open): the hits of the
+**					open-eye cascade on the eye, relative to kEyeOpenFullHits
 **
 ** Function Return:
-**  1
+**  true if an open eye was found
 **
 ** Special Considerations:
-**  None
+**  Only reads the face, it may run next to the other detector.
 **
 **/
-bool findEyes_hybrid(cv::Mat frame_gray, cv::Rect face) 
+bool findEyes_hybrid(cv::Mat faceROI, float *eyeOpen) 
 {
-	
-	// Size constants
-	static const int eyeTop = 25;
-	static const int eyeSide = 13;
-	static const int eyeHeight = 30;
-	static const int eyeWidth = 35;
 	bool eyeDetected = false;
-	cv::Mat faceROI = frame_gray(face);
 	
-	
-	//-- Find eye regions and draw them
-	int eye_region_width = face.width * (eyeWidth/100.0);
-	int eye_region_height = face.width * (eyeHeight/100.0);
-	int eye_region_top = face.height * (eyeTop/100.0);
-	
-	cv::Rect leftEyeRegion(face.width*(eyeSide/100.0),eye_region_top,eye_region_width,eye_region_height);
-	//cv::Rect rightEyeRegion(face.width - eye_region_width - face.width*(eyeSide/100.0),eye_region_top,eye_region_width,eye_region_height);
-	
-	cv::rectangle(faceROI, leftEyeRegion, CV_RGB(0,255,0));
+	//-- Find eye regions
+	cv::Rect leftEyeRegion = hybridEyeRegion(faceROI.size());
 	
 	//cv::Mat eyeL = faceROI(leftEyeRegion);
 	
@@ -510,15 +985,26 @@ bool findEyes_hybrid(cv::Mat frame_gray, cv::Rect face)
 	//cv::imshow("Left Eye", eyeL);	
 
 	std::vector<cv::Rect> eyes;
+	std::vector<int> hits;
+	if (eyeOpen != NULL)
+	{
+		*eyeOpen = 0.0f;
+	}
 	try
 	{
-		eye_cascade_EYE.detectMultiScale(eyeL, eyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE); //, cv::Size(5,5));
+		// the hits merged into each eye grow with how open it is
+		eye_cascade_EYE.detectMultiScale(eyeL, eyes, hits, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE); //, cv::Size(5,5));
 		if (eyes.size() > 0)
 		{
 			//cv::Mat eyeDetected = eyeL(eyes[0]);
 			//cv::imshow("Left Eye", eyeDetected);
 			//cerr << "size: "<< eyeDetected.size() << endl;
 			eyeDetected = true;
+			if (eyeOpen != NULL)
+			{
+				int most = *std::max_element(hits.begin(), hits.end());
+				*eyeOpen = std::min(1.0f, (float)most / kEyeOpenFullHits);
+			}
 		}
 		else
 		{
@@ -536,6 +1022,177 @@ bool findEyes_hybrid(cv::Mat frame_gray, cv::Rect face)
 
 
 
+/*
+** hybridEyeRegion
+**
+** Description
+**  Region of the face the hybrid detector looks for the left eye in,
+**  from the relative measurements of a face.
+**
+** Input Arguments:
+**  face			size of the face
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The eye region, relative to the face
+**
+** Special Considerations:
+**  None
+**
+**/
+static cv::Rect hybridEyeRegion(cv::Size face)
+{
+	// Size constants
+	static const int eyeTop = 25;
+	static const int eyeSide = 13;
+	static const int eyeHeight = 30;
+	static const int eyeWidth = 35;
+	
+	int eye_region_width = face.width * (eyeWidth/100.0);
+	int eye_region_height = face.width * (eyeHeight/100.0);
+	int eye_region_top = face.height * (eyeTop/100.0);
+	
+	//cv::Rect rightEyeRegion(face.width - eye_region_width - face.width*(eyeSide/100.0),eye_region_top,eye_region_width,eye_region_height);
+	return cv::Rect(face.width*(eyeSide/100.0),eye_region_top,eye_region_width,eye_region_height);
+}
+
+
+
+
+/*
+** hybridJob
+**
+** Description
+**  Runs the hybrid detector of one frame on a worker.
+**
+** Input Arguments:
+**  job				the frame's face and the result slot
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Runs on the worker pool. Only uses eye_cascade_EYE, which nothing
+**  else touches while the job runs.
+**
+**/
+static void hybridJob(std::shared_ptr<hybridJobType> job)
+{
+	uint64_t t = pipelineStats_now();
+	job->eyeFound = findEyes_hybrid(job->faceROI, &job->eyeOpen);
+	job->hybridNs = pipelineStats_record(STAGE_EYES_HYBRID, t) - t;
+	job->latch.done();
+}
+
+
+
+/*
+** tapRect
+**
+** Description
+**  Converts a rectangle to the frame tap overlay layout.
+**
+** Input Arguments:
+**  r				rectangle, in image coordinates
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The overlay rectangle
+**
+** Special Considerations:
+**  None
+**
+**/
+static frameTapRectType tapRect(const cv::Rect& r)
+{
+	frameTapRectType t = { r.x, r.y, r.width, r.height };
+	return t;
+}
+
+
+
+/*
+** eyeSample
+**
+** Description
+**  Queues the eye openness of a frame for the sensor fusion. The
+**  samples go out in batches of up to BLINK_EYE_BATCH frames, one
+**  channel wake-up per batch; a batch is sent early once its oldest
+**  sample is kEyeBatchMaxMs old.
+**
+** Input Arguments:
+**  captureNs		capture time of the frame
+**  eyeOpen			0 (closed) to 1 (open), negative if the eye was not seen
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Detector thread only.
+**
+**/
+static void eyeSample(uint64_t captureNs, float eyeOpen)
+{
+	if (eyeBatch.samples == 0)
+	{
+		eyeBatch.kind = BLINK_EVENT_EYE_SAMPLES;
+		eyeBatch.captureNs = captureNs;
+	}
+	
+	blinkEyeSampleType *s = &eyeBatch.sample[eyeBatch.samples++];
+	s->offsetUs = (uint32_t)((captureNs - eyeBatch.captureNs) / 1000ULL);
+	s->eyeOpen = eyeOpen;
+	
+	if (eyeBatch.samples == BLINK_EYE_BATCH ||
+		captureNs - eyeBatch.captureNs >= kEyeBatchMaxMs * 1000000ULL)
+	{
+		eyeSamplesFlush();
+	}
+}
+
+
+
+/*
+** eyeSamplesFlush
+**
+** Description
+**  Publishes the queued eye samples, if any.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Detector thread only.
+**
+**/
+static void eyeSamplesFlush(void)
+{
+	if (eyeBatch.samples == 0)
+	{
+		return;
+	}
+	blinkChannel_publish(&blinkEvents, &eyeBatch);
+	eyeBatch.samples = 0;
+}
+
+
+
 ////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////
 
@@ -598,8 +1255,7 @@ double findEyes_ORIGINAL(cv::Mat frame_gray, cv::Rect face)
 		eye_cascade.detectMultiScale(faceROI, eyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE); //, cv::Size(5,5));
 		if (eyes.size() > 0)
 		{
-			cv::Mat eyeDetected = faceROI(eyes[0]);
-			cv::imshow("Left Eye", eyeDetected);
+			DEBUG_DRAW(cv::imshow("Left Eye", faceROI(eyes[0])));
 			//cv::waitKey(5);
 		}
 	}
@@ -761,42 +1417,99 @@ double findEyes_ORIGINAL(cv::Mat frame_gray, cv::Rect face)
 **
 ** Description
 **  Perform template matching to search the user's eye in the given image.
+**  The search window is three times the size of the eye, centred on it
+**  (one eye width and height of margin on every side), and the matching
+**  runs on a reduced pyramid level (kEyeTrackPyramidLevel) to keep the
+**  cost per frame small.
 **
 ** Input Arguments:
 **  im    The source image
-**  tpl   The eye template
+**  tpl   The eye template, captured with captureEyeTemplate()
 **  rect  The eye bounding box, will be updated with the new location of the eye
 **
 ** Output Arguments:
-**  rect  The eye bounding box, will be updated with the new location of the eye
+**  rect  The eye bounding box, will be updated with the new location of the eye,
+**        or cleared if the eye was lost
 **
 ** Function Return:
-**  None
+**  Best CV_TM_SQDIFF_NORMED score (0 is a perfect match)
 **
 ** Special Considerations:
 **  None
 **
 **/
-void trackEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect)
+double trackEye(cv::Mat& im, cv::Mat& tpl, cv::Rect& rect)
 {
 	cv::Size size(rect.width * 2, rect.height * 2);
 	cv::Rect window(rect + size - cv::Point(size.width/2, size.height/2));
 	
 	window &= cv::Rect(0, 0, im.cols, im.rows);
 
-	cv::Mat dst(window.width - tpl.rows + 1, window.height - tpl.cols + 1, CV_32FC1);
+	// bring the search window down to the template's pyramid level
+	cv::Mat search = im(window);
+	for (int i = 0; i < kEyeTrackPyramidLevel; i++)
+	{
+		cv::Mat reduced;
+		cv::pyrDown(search, reduced);
+		search = reduced;
+	}
 	
-	cv::matchTemplate(im(window), tpl, dst, CV_TM_SQDIFF_NORMED);
+	if (tpl.empty() || search.cols < tpl.cols || search.rows < tpl.rows)
+	{
+		rect.x = rect.y = rect.width = rect.height = 0;
+		return 1.0;
+	}
+
+	cv::Mat dst;
+	cv::matchTemplate(search, tpl, dst, CV_TM_SQDIFF_NORMED);
 
 	double minval, maxval;
 	cv::Point minloc, maxloc;
 	cv::minMaxLoc(dst, &minval, &maxval, &minloc, &maxloc);
 
-	if (minval <= 0.2)
+	if (minval <= kEyeTrackMaxScore)
 	{
-		rect.x = window.x + minloc.x;
-		rect.y = window.y + minloc.y;
+		rect.x = window.x + (minloc.x << kEyeTrackPyramidLevel);
+		rect.y = window.y + (minloc.y << kEyeTrackPyramidLevel);
 	}
 	else
 		rect.x = rect.y = rect.width = rect.height = 0;
+	
+	return minval;
+}
+
+
+
+
+/*
+** captureEyeTemplate
+**
+** Description
+**  Stores the eye image as the tracking template, reduced to the
+**  pyramid level trackEye() matches at.
+**
+** Input Arguments:
+**  im    The source image
+**  eye   The eye bounding box
+**
+** Output Arguments:
+**  tpl   The eye template
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void captureEyeTemplate(cv::Mat& im, cv::Rect& eye, cv::Mat& tpl)
+{
+	tpl = im(eye).clone();
+	for (int i = 0; i < kEyeTrackPyramidLevel; i++)
+	{
+		cv::Mat reduced;
+		cv::pyrDown(tpl, reduced);
+		tpl = reduced;
+	}
+	eyeTemplateCaptures++;
 }
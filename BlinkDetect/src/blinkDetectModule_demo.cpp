@@ -28,6 +28,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 
+#include "../include/blinkDetectModule.h"
+
 
 
 /************************ Macros **************************************/
@@ -122,7 +124,7 @@ using namespace cv;
 **/
 
 //void *blinkDetect_task(void *arg)
-int blinkDetect_task()
+int blinkDetect_task(const blinkDetectOptionsType *options)
 {
 	// welcome message
 	cout << "blinkdetect: Task Started " << endl;
@@ -0,0 +1,138 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Debug viewer of the blink detector. Renders the frames the
+				detector publishes on its frame tap (blinkDetect -T),
+				with the face and eye rectangles and the decisions drawn
+				on top, in a process of its own so the drawing costs the
+				detector nothing.
+ ============================================================================
+ */
+
+
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "../include/frameTap.h"
+
+
+/************************ Macros **************************************/
+
+#define VIEWER_WINDOW		"blinkViewer"
+#define VIEWER_SCALE		2			// frames are drawn this many times larger
+
+
+/********************* LOCAL Function Prototypes **********************/
+
+static void drawRect(cv::Mat& image, const frameTapRectType& r, const cv::Scalar& color);
+
+
+/************************** Namespaces ********************************/
+
+using namespace std;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+
+
+// Main function, defines the entry point for the program.
+int main( int argc, char** argv )
+{
+	frameTap_t tap;
+	frameTapOverlayType overlay;
+	cv::Mat gray, image;
+	unsigned long shown = 0;
+	uint32_t lastSeq = 0;
+	unsigned long missed = 0;
+
+	if (!frameTap_open(&tap))
+	{
+		cerr << "blinkViewer: Error opening the frame tap " << FRAME_TAP_NAME << endl;
+		return 1;
+	}
+
+	cout << "blinkViewer: waiting for frames, start blinkDetect with -T, 'q' quits" << endl;
+	cv::namedWindow(VIEWER_WINDOW, CV_WINDOW_AUTOSIZE);
+
+	while (cv::waitKey(1) != 'q')
+	{
+		if (!frameTap_read(&tap, gray, &overlay, 200))
+		{
+			continue;
+		}
+
+		// frames the detector published while we were drawing
+		if (shown != 0 && overlay.seq > lastSeq + 1)
+		{
+			missed += overlay.seq - lastSeq - 1;
+		}
+		lastSeq = overlay.seq;
+		shown++;
+
+		cv::cvtColor(gray, image, CV_GRAY2BGR);
+		drawRect(image, overlay.face, CV_RGB(0, 255, 0));
+		drawRect(image, overlay.hybridRegion, overlay.hybridJoined ? CV_RGB(0, 255, 255) : CV_RGB(128, 128, 128));
+		drawRect(image, overlay.trackedEye, CV_RGB(255, 255, 0));
+		drawRect(image, overlay.eye, CV_RGB(0, 0, 255));
+
+		cv::resize(image, image, cv::Size(), VIEWER_SCALE, VIEWER_SCALE, cv::INTER_NEAREST);
+
+		char text[128];
+		snprintf(text, sizeof(text), "#%u  classifier %s  hybrid %s  blinks %u",
+				 overlay.seq, overlay.eyeClassifier ? "open" : "-",
+				 !overlay.hybridJoined ? "late" : (overlay.eyeHybrid ? "open" : "-"),
+				 overlay.blinkCount);
+		cv::putText(image, text, cv::Point(8, 20), cv::FONT_HERSHEY_SIMPLEX, 0.5, CV_RGB(255, 255, 255));
+		if (overlay.blink)
+		{
+			cv::putText(image, "BLINK", cv::Point(8, 44), cv::FONT_HERSHEY_SIMPLEX, 0.8, CV_RGB(255, 0, 0), 2);
+		}
+
+		cv::imshow(VIEWER_WINDOW, image);
+	}
+
+	cout << "blinkViewer: " << shown << " frames shown, " << missed << " skipped" << endl;
+	frameTap_close(&tap);
+
+	return 0;
+}
+
+
+
+
+/*
+** drawRect
+**
+** Description
+**  Draws an overlay rectangle, scaled to the displayed image.
+**
+** Input Arguments:
+**  image		frame being drawn, at detector resolution
+**  r			rectangle, nothing is drawn if it is empty
+**  color		line color
+**
+** Output Arguments:
+**  image		frame with the rectangle
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void drawRect(cv::Mat& image, const frameTapRectType& r, const cv::Scalar& color)
+{
+	if (r.width > 0 && r.height > 0)
+	{
+		cv::rectangle(image, cv::Rect(r.x, r.y, r.width, r.height), color);
+	}
+}
@@ -0,0 +1,247 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Asynchronous face localisation for the blink detector. The
+				face cascade runs on its own thread at a low rate and
+				publishes the latest face rectangle; the detector thread
+				classifies the eye state inside it on every frame.
+ ============================================================================
+ */
+
+
+
+#include "../include/faceLocator.h"
+#include "../include/pipelineStats.h"
+
+
+/************************** Namespaces ********************************/
+
+using namespace std;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+FaceLocator::FaceLocator(faceDetectFunc detect, int rateHz)
+	: detect(detect), periodNs(1000000000ULL / (rateHz > 0 ? rateHz : 1)), running(false),
+	  pendingStamp(0), havePending(false), wanted(false), nextRunNs(0),
+	  faceStamp(0), locatedCount(0), submittedCount(0)
+{
+}
+
+
+FaceLocator::~FaceLocator()
+{
+	stop();
+}
+
+
+
+/*
+** FaceLocator::start
+**
+** Description
+**  Starts the face localisation thread.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  true if the thread was started
+**
+** Special Considerations:
+**  None
+**
+**/
+bool FaceLocator::start()
+{
+	if (running.exchange(true))
+	{
+		return false;
+	}
+	wanted.store(true, std::memory_order_release);
+	worker = std::thread(&FaceLocator::run, this);
+	return true;
+}
+
+
+
+/*
+** FaceLocator::stop
+**
+** Description
+**  Stops the face localisation thread and waits for it to exit.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void FaceLocator::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running.store(false);
+	}
+	wake.notify_one();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+}
+
+
+
+/*
+** FaceLocator::submit
+**
+** Description
+**  Offers a frame to the face localisation thread. The frame is
+**  copied only if the thread is idle and a period has passed since
+**  the last frame it took, measured on the capture stamps.
+**
+** Input Arguments:
+**  gray		equalized grayscale frame
+**  stampNs		capture time of the frame
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Call from the detector thread only. Costs one atomic load on the
+**  frames that are not taken.
+**
+**/
+void FaceLocator::submit(const cv::Mat& gray, uint64_t stampNs)
+{
+	if (!wanted.load(std::memory_order_acquire) || stampNs < nextRunNs)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		gray.copyTo(pending);
+		pendingStamp = stampNs;
+		havePending = true;
+		wanted.store(false, std::memory_order_relaxed);
+	}
+	wake.notify_one();
+
+	nextRunNs = stampNs + periodNs;
+	submittedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+/*
+** FaceLocator::latest
+**
+** Description
+**  Returns the face found by the last run of the face cascade.
+**
+** Input Arguments:
+**  nowNs		capture time of the frame being processed
+**
+** Output Arguments:
+**  face		the face bounding box, in image coordinates
+**
+** Function Return:
+**  true if a face was found and is no older than
+**  FACE_LOCATOR_MAX_AGE_MS
+**
+** Special Considerations:
+**  None
+**
+**/
+bool FaceLocator::latest(cv::Rect& face, uint64_t nowNs)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (this->face.area() == 0 || nowNs > faceStamp + FACE_LOCATOR_MAX_AGE_MS * 1000000ULL)
+	{
+		return false;
+	}
+	face = this->face;
+	return true;
+}
+
+
+
+/*
+** FaceLocator::run
+**
+** Description
+**  Face localisation loop. Waits for a frame, runs the face cascade on
+**  it and publishes the result.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Runs on the face localisation thread. The face tracking state of
+**  the detect function is only touched from here.
+**
+**/
+void FaceLocator::run()
+{
+	cv::Mat work;
+
+	while (true)
+	{
+		uint64_t stamp;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (running.load() && !havePending)
+			{
+				wake.wait(guard);
+			}
+			if (!running.load())
+			{
+				break;
+			}
+			// the two buffers trade places, neither is reallocated
+			cv::swap(work, pending);
+			stamp = pendingStamp;
+			havePending = false;
+		}
+
+		cv::Rect found;
+		uint64_t t = pipelineStats_now();
+		if (!detect(work, found))
+		{
+			found = cv::Rect();
+		}
+		pipelineStats_record(STAGE_FACE_DETECT, t);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			face = found;
+			faceStamp = stamp;
+		}
+		locatedCount.fetch_add(1, std::memory_order_relaxed);
+		wanted.store(true, std::memory_order_release);
+	}
+}
@@ -0,0 +1,457 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Dedicated capture thread for the blink detector. Frames are
+				grabbed on their own thread into a fixed pool of
+				preallocated cv::Mat buffers and handed to the detector
+				through a single-producer/single-consumer ring.
+ ============================================================================
+ */
+
+
+
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+
+#include "../include/frameCapture.h"
+#include "../include/pipelineStats.h"
+
+
+/************************** Namespaces ********************************/
+
+using namespace std;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+FrameRing::FrameRing(size_t slots, bool lossless)
+	: slot(slots), lossless(lossless), head(0), tail(0), held(FRAME_RING_NO_SLOT),
+	  closed(false), writing(0), nextSeq(0), dropCount(0)
+{
+	sem_init(&filled, 0, 0);
+	sem_init(&freed, 0, 0);
+}
+
+
+FrameRing::~FrameRing()
+{
+	sem_destroy(&filled);
+	sem_destroy(&freed);
+}
+
+
+
+/*
+** FrameRing::preallocate
+**
+** Description
+**  Allocates the image buffer of every slot so the capture loop never
+**  allocates once it is running.
+**
+** Input Arguments:
+**  size		frame size delivered by the source
+**  type		frame type delivered by the source
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Must only be called by the producer, before the slots are published.
+**
+**/
+void FrameRing::preallocate(cv::Size size, int type)
+{
+	for (size_t i = 0; i < slot.size(); i++)
+	{
+		slot[i].image.create(size, type);
+	}
+}
+
+
+
+/*
+** FrameRing::beginWrite
+**
+** Description
+**  Returns the next free slot for the producer to fill.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The slot to fill, or NULL if the ring is closed (lossless mode).
+**
+** Special Considerations:
+**  In lossless mode this blocks until the consumer frees a slot. In
+**  live mode it never blocks: a full ring gives up its oldest unread
+**  frame, and the position of the slot the consumer holds is skipped
+**  and left empty. The ring needs at least two slots.
+**
+**/
+frameSlotType *FrameRing::beginWrite()
+{
+	unsigned long h = head.load(std::memory_order_relaxed);
+	size_t n = slot.size();
+
+	if (lossless)
+	{
+		while (h - tail.load(std::memory_order_acquire) >= n)
+		{
+			if (closed.load(std::memory_order_acquire))
+			{
+				return NULL;
+			}
+			while (sem_wait(&freed) < 0 && errno == EINTR);
+		}
+	}
+	else
+	{
+		for (;;)
+		{
+			unsigned long t = tail.load(std::memory_order_acquire);
+			unsigned long c = held.load(std::memory_order_relaxed);
+
+			if (c != FRAME_RING_NO_SLOT && (h - c) % n == 0)
+			{
+				h++;
+				continue;
+			}
+			if (h - t < n)
+			{
+				break;
+			}
+
+			// full, drop the oldest unread frame. The consumer moves tail
+			// past the slot it takes, so this never crosses held; if it
+			// got there first the claim fails and we look again
+			tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel);
+		}
+	}
+
+	writing = h;
+	return &slot[h % n];
+}
+
+
+
+/*
+** FrameRing::commitWrite
+**
+** Description
+**  Publishes the slot returned by the last beginWrite() to the consumer.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void FrameRing::commitWrite()
+{
+	head.store(writing + 1, std::memory_order_release);
+	sem_post(&filled);
+}
+
+
+
+/*
+** FrameRing::close
+**
+** Description
+**  Marks the end of the stream and wakes up both sides.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void FrameRing::close()
+{
+	closed.store(true, std::memory_order_release);
+	sem_post(&filled);
+	sem_post(&freed);
+}
+
+
+
+/*
+** FrameRing::acquire
+**
+** Description
+**  Waits for a frame and hands it to the consumer. In live mode the
+**  newest frame is returned and any older unread frames are dropped.
+**  Frames lost either way leave a gap in the capture sequence numbers,
+**  which is what the drop counter adds up.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The slot holding the frame, or NULL once the ring is closed and
+**  drained. The slot stays valid until release().
+**
+** Special Considerations:
+**  None
+**
+**/
+frameSlotType *FrameRing::acquire()
+{
+	for (;;)
+	{
+		unsigned long t = tail.load(std::memory_order_acquire);
+		unsigned long h = head.load(std::memory_order_acquire);
+
+		if (h == t)
+		{
+			if (closed.load(std::memory_order_acquire))
+			{
+				return NULL;
+			}
+			while (sem_wait(&filled) < 0 && errno == EINTR);
+			continue;
+		}
+
+		if (lossless)
+		{
+			held.store(t, std::memory_order_relaxed);
+			break;
+		}
+
+		// take the newest frame and give the stale ones back. Held is
+		// published before the claim so the producer skips the slot;
+		// the claim fails if the producer overwrote a frame meanwhile
+		held.store(h - 1, std::memory_order_relaxed);
+		if (tail.compare_exchange_strong(t, h, std::memory_order_acq_rel))
+		{
+			break;
+		}
+	}
+
+	frameSlotType *frame = &slot[held.load(std::memory_order_relaxed) % slot.size()];
+	dropCount.fetch_add(frame->seq - nextSeq, std::memory_order_relaxed);
+	nextSeq = frame->seq + 1;
+
+	return frame;
+}
+
+
+
+/*
+** FrameRing::release
+**
+** Description
+**  Returns the slot obtained with acquire() to the producer.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void FrameRing::release()
+{
+	if (lossless)
+	{
+		tail.store(held.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		sem_post(&freed);
+	}
+	held.store(FRAME_RING_NO_SLOT, std::memory_order_release);
+}
+
+
+
+
+
+
+FrameCapture::FrameCapture(FrameSource *source, size_t slots)
+	: source(source), frames(slots, !source->isLive()), running(false), capturedCount(0)
+{
+}
+
+
+FrameCapture::~FrameCapture()
+{
+	stop();
+}
+
+
+
+/*
+** FrameCapture::start
+**
+** Description
+**  Starts the capture thread.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  true if the thread was started
+**
+** Special Considerations:
+**  None
+**
+**/
+bool FrameCapture::start()
+{
+	if (running.exchange(true))
+	{
+		return false;
+	}
+	worker = std::thread(&FrameCapture::run, this);
+	return true;
+}
+
+
+
+/*
+** FrameCapture::stop
+**
+** Description
+**  Stops the capture thread and waits for it to exit.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void FrameCapture::stop()
+{
+	running.store(false);
+	frames.close();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+}
+
+
+
+/*
+** FrameCapture::run
+**
+** Description
+**  Capture loop. Grabs every frame from the source so the sensor never
+**  stalls, and retrieves it into the ring, over the oldest unread frame
+**  if the ring is full. Frames of a zero-copy source stay in the
+**  source's buffer until their slot is reused.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Runs on the capture thread.
+**
+**/
+void FrameCapture::run()
+{
+	unsigned long seq = 0;
+	bool allocated = false;
+	bool zeroCopy = source->isZeroCopy();
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		pipelineFrameType timing;
+		memset(&timing, 0, sizeof(timing));
+
+		uint64_t t = pipelineStats_now();
+		if (!source->grab())
+		{
+			break;
+		}
+		t = pipelineStats_record(STAGE_GRAB, t, &timing);
+
+		struct timespec stamp;
+		stamp.tv_sec = t / 1000000000ULL;
+		stamp.tv_nsec = t % 1000000000ULL;
+
+		frameSlotType *slot = frames.beginWrite();
+		if (slot == NULL)
+		{
+			// ring closed
+			break;
+		}
+
+		// a zero-copy slot still points at the driver buffer of the
+		// frame it held last, the consumer is done with it
+		if (zeroCopy && !slot->image.empty())
+		{
+			source->release(slot->image);
+			slot->image = cv::Mat();
+		}
+
+		if (!source->retrieve(slot->image))
+		{
+			break;
+		}
+		pipelineStats_record(STAGE_RETRIEVE, t, &timing);
+
+		// the first frame tells us the geometry of the buffers, the
+		// zero-copy sources bring their own
+		if (!allocated && !zeroCopy)
+		{
+			frames.preallocate(slot->image.size(), slot->image.type());
+			allocated = true;
+		}
+
+		slot->seq = seq++;
+		slot->stamp = stamp;
+		slot->timing = timing;
+		frames.commitWrite();
+		capturedCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	frames.close();
+}
@@ -0,0 +1,102 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Frame scheduler of the blink detector. Paces the detector
+				loop on absolute deadlines of the monotonic clock, so the
+				frame rate no longer depends on a GUI event wait.
+ ============================================================================
+ */
+
+
+
+#include <time.h>
+
+#include "../include/framePacer.h"
+#include "../include/pipelineStats.h"
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** framePacer_init
+**
+** Description
+**  Sets the frame rate the detector loop is held to.
+**
+** Input Arguments:
+**  pacer		pointer to framePacer_t object
+**  fps			frames per second, 0 for no pacing
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void framePacer_init(framePacer_t *pacer, int fps)
+{
+	pacer->periodNs = (fps > 0) ? 1000000000ULL / fps : 0;
+	pacer->nextNs = 0;
+	pacer->late = 0;
+}
+
+
+
+/*
+** framePacer_wait
+**
+** Description
+**  Sleeps until the start of the next frame period. A frame that
+**  overran its period does not make the following ones early: the
+**  periods it overran are skipped, not caught up.
+**
+** Input Arguments:
+**  pacer		pointer to framePacer_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Number of periods skipped
+**
+** Special Considerations:
+**  Returns at once without pacing. The sleep ends early on a signal.
+**
+**/
+unsigned long framePacer_wait(framePacer_t *pacer)
+{
+	if (pacer->periodNs == 0)
+	{
+		return 0;
+	}
+
+	uint64_t now = pipelineStats_now();
+	unsigned long skipped = 0;
+
+	if (pacer->nextNs == 0)
+	{
+		pacer->nextNs = now;
+	}
+	else if (now > pacer->nextNs + pacer->periodNs)
+	{
+		// overran: keep the phase, drop the periods already gone
+		skipped = (now - pacer->nextNs) / pacer->periodNs;
+		pacer->nextNs += skipped * pacer->periodNs;
+		pacer->late += skipped;
+	}
+
+	struct timespec ts;
+	ts.tv_sec = pacer->nextNs / 1000000000ULL;
+	ts.tv_nsec = pacer->nextNs % 1000000000ULL;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+	pacer->nextNs += pacer->periodNs;
+	return skipped;
+}
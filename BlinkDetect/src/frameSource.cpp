@@ -0,0 +1,482 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Frame source layer for the blink detector. Abstracts where
+				the grayscale frames come from so the vision pipeline can
+				run from the Pi camera, a V4L2 device, a recorded video
+				file or a directory of still frames.
+ ============================================================================
+ */
+
+
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/videoio.hpp"
+#ifdef HAVE_RASPICAM
+#include <raspicam/raspicamtypes.h>
+#include <raspicam/raspicam_cv.h>
+#endif
+
+#include "../include/frameSource.h"
+#include "../include/frameCapture.h"
+
+
+/************************ Macros **************************************/
+
+// driver buffers: more than the frame ring can hold plus the one
+// being filled, so the driver never runs dry while the ring is full
+#define V4L2_MMAP_BUFFERS		8
+
+// every ring slot keeps its frame in a driver buffer until the slot is
+// reused, the capture thread latches one more and the driver needs one
+// to fill, with fewer DQBUF blocks for good
+#define V4L2_MIN_BUFFERS		(FRAME_RING_SLOTS + 2)
+
+
+/************************** Namespaces ********************************/
+
+using namespace std;
+
+
+/**************************** Data Types ******************************/
+
+
+#ifdef HAVE_RASPICAM
+/*
+** RaspiCamSource
+**
+** Description
+**  Raspberry Pi camera through raspicam. Frames are delivered as
+**  CV_8UC1 at the detector resolution directly by the library.
+**
+**/
+class RaspiCamSource : public FrameSource
+{
+public:
+	bool open()
+	{
+		// the ISP scales to the detector resolution, so the frames
+		// need no resize and the library copies a small image
+		Camera.set(CV_CAP_PROP_FORMAT, CV_8UC1);
+		Camera.set(CV_CAP_PROP_FRAME_WIDTH, DETECT_FRAME_WIDTH);
+		Camera.set(CV_CAP_PROP_FRAME_HEIGHT, DETECT_FRAME_HEIGHT);
+		return Camera.open();
+	}
+	bool grab()							{ return Camera.grab(); }
+	bool retrieve(cv::Mat& frame)		{ Camera.retrieve(frame); return !frame.empty(); }
+	void close()						{ Camera.release(); }
+	bool isLive() const					{ return true; }
+	const char *name() const			{ return "raspicam"; }
+
+private:
+	raspicam::RaspiCam_Cv Camera;
+};
+#endif
+
+
+
+/*
+** VideoCaptureSource
+**
+** Description
+**  V4L2 device or recorded video file through cv::VideoCapture. Color
+**  frames are converted to grayscale on retrieve.
+**
+**/
+class VideoCaptureSource : public FrameSource
+{
+public:
+	VideoCaptureSource(int index) : device(index), path() {}
+	VideoCaptureSource(const string& file) : device(-1), path(file) {}
+
+	bool open()
+	{
+		if (device >= 0)
+		{
+			return cap.open(device + cv::CAP_V4L2);
+		}
+		return cap.open(path);
+	}
+
+	bool grab()							{ return cap.grab(); }
+
+	bool retrieve(cv::Mat& frame)
+	{
+		if (!cap.retrieve(raw) || raw.empty())
+		{
+			return false;
+		}
+		if (raw.channels() == 1)
+		{
+			raw.copyTo(frame);
+		}
+		else
+		{
+			cv::cvtColor(raw, frame, CV_BGR2GRAY);
+		}
+		return true;
+	}
+
+	void close()						{ cap.release(); }
+	bool isLive() const					{ return device >= 0; }
+	const char *name() const			{ return (device >= 0) ? "v4l2" : "video"; }
+
+private:
+	int device;
+	string path;
+	cv::VideoCapture cap;
+	cv::Mat raw;
+};
+
+
+
+/*
+** V4L2MmapSource
+**
+** Description
+**  V4L2 capture device streaming into memory mapped driver buffers.
+**  The device is asked for planar YUV 4:2:0 (or plain grey) at the
+**  detector resolution, so the Y plane at the start of each buffer is
+**  the grayscale frame. retrieve() wraps it in a cv::Mat header, no
+**  pixel is copied. The buffer is queued back to the driver by
+**  release(), or by the next grab() if it was never retrieved.
+**
+**  On the Pi this is the camera through the bcm2835-v4l2 driver,
+**  which has the ISP scale and convert the sensor image.
+**
+**/
+class V4L2MmapSource : public FrameSource
+{
+public:
+	V4L2MmapSource(int index) : device(index), fd(-1), buffers(0), latched(-1), retrieved(false) {}
+	~V4L2MmapSource()					{ close(); }
+
+	bool open()
+	{
+		char path[32];
+		snprintf(path, sizeof(path), "/dev/video%d", device);
+		fd = ::open(path, O_RDWR);
+		if (fd < 0)
+		{
+			cerr << "frameSource: cannot open " << path << ": " << strerror(errno) << endl;
+			return false;
+		}
+		
+		// detector resolution, Y plane first
+		struct v4l2_format fmt;
+		memset(&fmt, 0, sizeof(fmt));
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		fmt.fmt.pix.width = DETECT_FRAME_WIDTH;
+		fmt.fmt.pix.height = DETECT_FRAME_HEIGHT;
+		fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+		fmt.fmt.pix.field = V4L2_FIELD_NONE;
+		if (xioctl(VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUV420)
+		{
+			fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+			if (xioctl(VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_GREY)
+			{
+				cerr << "frameSource: " << path << " delivers neither YUV420 nor GREY" << endl;
+				close();
+				return false;
+			}
+		}
+		// the driver may have picked the nearest size it supports
+		width = fmt.fmt.pix.width;
+		height = fmt.fmt.pix.height;
+		stride = fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : width;
+		
+		struct v4l2_requestbuffers req;
+		memset(&req, 0, sizeof(req));
+		req.count = V4L2_MMAP_BUFFERS;
+		req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		req.memory = V4L2_MEMORY_MMAP;
+		if (xioctl(VIDIOC_REQBUFS, &req) < 0)
+		{
+			cerr << "frameSource: " << path << " has no streaming buffers" << endl;
+			close();
+			return false;
+		}
+		if (req.count < V4L2_MIN_BUFFERS)
+		{
+			cerr << "frameSource: " << path << " has " << req.count << " streaming buffers, "
+				 << V4L2_MIN_BUFFERS << " needed" << endl;
+			close();
+			return false;
+		}
+		
+		for (buffers = 0; buffers < (int)req.count && buffers < V4L2_MMAP_BUFFERS; buffers++)
+		{
+			struct v4l2_buffer buf;
+			memset(&buf, 0, sizeof(buf));
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = V4L2_MEMORY_MMAP;
+			buf.index = buffers;
+			if (xioctl(VIDIOC_QUERYBUF, &buf) < 0)
+			{
+				close();
+				return false;
+			}
+			length[buffers] = buf.length;
+			start[buffers] = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+			if (start[buffers] == MAP_FAILED || xioctl(VIDIOC_QBUF, &buf) < 0)
+			{
+				if (start[buffers] != MAP_FAILED)
+				{
+					buffers++;
+				}
+				close();
+				return false;
+			}
+		}
+		
+		int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (xioctl(VIDIOC_STREAMON, &type) < 0)
+		{
+			cerr << "frameSource: cannot start streaming on " << path << endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool grab()
+	{
+		// a frame grabbed but never retrieved goes straight back
+		if (latched >= 0 && !retrieved)
+		{
+			queue(latched);
+		}
+		latched = -1;
+		
+		struct v4l2_buffer buf;
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		if (xioctl(VIDIOC_DQBUF, &buf) < 0)
+		{
+			return false;
+		}
+		latched = buf.index;
+		retrieved = false;
+		return true;
+	}
+
+	bool retrieve(cv::Mat& frame)
+	{
+		if (latched < 0)
+		{
+			return false;
+		}
+		frame = cv::Mat(height, width, CV_8UC1, start[latched], stride);
+		retrieved = true;
+		return true;
+	}
+
+	void release(const cv::Mat& frame)
+	{
+		for (int i = 0; i < buffers; i++)
+		{
+			if (frame.data == start[i])
+			{
+				queue(i);
+				return;
+			}
+		}
+	}
+
+	void close()
+	{
+		if (fd < 0)
+		{
+			return;
+		}
+		int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		xioctl(VIDIOC_STREAMOFF, &type);
+		for (int i = 0; i < buffers; i++)
+		{
+			if (start[i] != MAP_FAILED)
+			{
+				munmap(start[i], length[i]);
+			}
+		}
+		buffers = 0;
+		latched = -1;
+		::close(fd);
+		fd = -1;
+	}
+
+	bool isZeroCopy() const				{ return true; }
+	bool isLive() const					{ return true; }
+	const char *name() const			{ return "v4l2mmap"; }
+
+private:
+	int xioctl(unsigned long request, void *arg)
+	{
+		int ret;
+		while ((ret = ioctl(fd, request, arg)) < 0 && errno == EINTR);
+		return ret;
+	}
+
+	void queue(int index)
+	{
+		struct v4l2_buffer buf;
+		memset(&buf, 0, sizeof(buf));
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = index;
+		xioctl(VIDIOC_QBUF, &buf);
+	}
+
+	int device;
+	int fd;
+	int width, height, stride;
+	void *start[V4L2_MMAP_BUFFERS];
+	size_t length[V4L2_MMAP_BUFFERS];
+	int buffers;						// mapped buffers
+	int latched;						// buffer of the grabbed frame, -1 if none
+	bool retrieved;						// latched buffer handed out by retrieve()
+};
+
+
+
+/*
+** ImageDirSource
+**
+** Description
+**  Directory of still frames (.pgm or .png), played back in file name
+**  order. Each frame is decoded as grayscale.
+**
+**/
+class ImageDirSource : public FrameSource
+{
+public:
+	ImageDirSource(const string& dir) : directory(dir), next(0) {}
+
+	bool open()
+	{
+		vector<cv::String> all;
+		cv::glob(directory, all, false);
+
+		files.clear();
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			string file = all[i];
+			string ext = file.substr(file.find_last_of('.') + 1);
+			transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+			if (ext == "pgm" || ext == "png")
+			{
+				files.push_back(file);
+			}
+		}
+		sort(files.begin(), files.end());
+		next = 0;
+
+		return !files.empty();
+	}
+
+	bool grab()
+	{
+		if (next >= files.size())
+		{
+			return false;
+		}
+		current = files[next++];
+		return true;
+	}
+
+	bool retrieve(cv::Mat& frame)
+	{
+		frame = cv::imread(current, cv::IMREAD_GRAYSCALE);
+		return !frame.empty();
+	}
+
+	void close()						{ files.clear(); }
+	bool isLive() const					{ return false; }
+	const char *name() const			{ return "images"; }
+
+private:
+	string directory;
+	vector<string> files;
+	size_t next;
+	string current;
+};
+
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** frameSource_create
+**
+** Description
+**  Creates a frame source from a textual specification:
+**    "raspicam"          Raspberry Pi camera (default)
+**    "v4l2[:<index>]"    V4L2 capture device, /dev/video<index>
+**    "v4l2mmap[:<index>]" V4L2 device, Y plane at the detector resolution,
+**                        zero-copy from the driver buffers
+**    "video:<path>"      recorded video file
+**    "images:<dir>"      directory of .pgm/.png frames, in name order
+**
+** Input Arguments:
+**  spec    source specification
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  A new (not yet opened) frame source, or NULL if the specification
+**  is invalid or the backend was not compiled in. Release with delete.
+**
+** Special Considerations:
+**  None
+**
+**/
+FrameSource *frameSource_create(const string& spec)
+{
+	string kind = spec.substr(0, spec.find(':'));
+	string arg = (spec.find(':') != string::npos) ? spec.substr(spec.find(':') + 1) : "";
+
+	if (kind == "raspicam")
+	{
+#ifdef HAVE_RASPICAM
+		return new RaspiCamSource();
+#else
+		cerr << "frameSource: raspicam support not compiled in" << endl;
+		return NULL;
+#endif
+	}
+	else if (kind == "v4l2")
+	{
+		return new VideoCaptureSource(arg.empty() ? 0 : atoi(arg.c_str()));
+	}
+	else if (kind == "v4l2mmap")
+	{
+		return new V4L2MmapSource(arg.empty() ? 0 : atoi(arg.c_str()));
+	}
+	else if (kind == "video" && !arg.empty())
+	{
+		return new VideoCaptureSource(arg);
+	}
+	else if (kind == "images" && !arg.empty())
+	{
+		return new ImageDirSource(arg);
+	}
+
+	cerr << "frameSource: unknown frame source '" << spec << "'" << endl;
+	return NULL;
+}
@@ -0,0 +1,431 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Debug frame tap of the blink detector. The detector copies
+				the frame it just processed, with the face and eye
+				rectangles and its decisions, into a single shared memory
+				slot that a separate viewer process renders. Publishing
+				never waits: while the viewer holds the slot the frame is
+				dropped, and nothing is copied when no viewer is attached.
+ ============================================================================
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../include/frameTap.h"
+#include "../include/pipelineStats.h"
+
+
+/************************ Macros **************************************/
+
+#define FRAME_TAP_MAGIC			0x54415042		// "BPAT"
+#define FRAME_TAP_VERSION		1
+
+
+/**************************** Data Types ******************************/
+
+
+// owner of the slot
+typedef enum {
+	TAP_EMPTY,				// free, nothing new in it
+	TAP_WRITING,			// the detector fills it
+	TAP_READY,				// holds a frame the viewer has not read
+	TAP_READING				// the viewer copies it out
+} tapStateType;
+
+
+struct frameTapShm {
+
+	uint32_t magic;
+	uint32_t version;
+	uint32_t state;					// tapStateType
+	uint32_t published;				// frames published so far, futex word
+	uint32_t waiters;				// viewers sleeping on published
+	uint32_t reserved;
+	uint64_t viewerNs;				// last time the viewer read the slot
+
+	frameTapOverlayType overlay;
+	int32_t width, height;
+	uint8_t pixels[FRAME_TAP_MAX_PIXELS];
+
+};
+
+
+/********************* LOCAL Function Prototypes **********************/
+
+static long futex(uint32_t *word, int op, uint32_t val, const struct timespec *timeout);
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** frameTap_open
+**
+** Description
+**  Maps the shared memory slot, creating it if it does not exist yet.
+**  The detector and the viewer may open in any order.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  None
+**
+**/
+int frameTap_open(frameTap_t *tap)
+{
+	struct stat st;
+
+	tap->shm = NULL;
+	tap->published = 0;
+	tap->dropped = 0;
+	tap->readSeq = 0;
+	tap->writingNs = 0;
+
+	int fd = shm_open(FRAME_TAP_NAME, O_RDWR | O_CREAT, 0666);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	// a freshly created (zero filled) object is an empty slot
+	if (fstat(fd, &st) < 0 ||
+		(st.st_size < (off_t)sizeof(frameTapShmType) && ftruncate(fd, sizeof(frameTapShmType)) < 0))
+	{
+		close(fd);
+		return 0;
+	}
+
+	void *mem = mmap(NULL, sizeof(frameTapShmType), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		return 0;
+	}
+	tap->shm = (frameTapShmType *)mem;
+
+	// stamp the layout, or check the one stamped by the other side
+	uint32_t magic = 0;
+	if (!__atomic_compare_exchange_n(&tap->shm->magic, &magic, FRAME_TAP_MAGIC, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+	{
+		if (magic != FRAME_TAP_MAGIC)
+		{
+			fprintf(stderr, "frameTap: bad magic 0x%X\n", magic);
+			frameTap_close(tap);
+			return 0;
+		}
+	}
+	else
+	{
+		tap->shm->version = FRAME_TAP_VERSION;
+	}
+
+	// left behind by a build with another slot layout (0 is the other
+	// side still stamping it)
+	uint32_t version = __atomic_load_n(&tap->shm->version, __ATOMIC_ACQUIRE);
+	if (version != 0 && version != FRAME_TAP_VERSION)
+	{
+		fprintf(stderr, "frameTap: version %u, expected %u, remove /dev/shm%s\n",
+				version, FRAME_TAP_VERSION, FRAME_TAP_NAME);
+		frameTap_close(tap);
+		return 0;
+	}
+
+	// a viewer left holding the slot by a crash must not block the tap
+	uint32_t reading = TAP_READING;
+	__atomic_compare_exchange_n(&tap->shm->state, &reading, TAP_EMPTY, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	tap->readSeq = __atomic_load_n(&tap->shm->published, __ATOMIC_ACQUIRE);
+
+	return 1;
+}
+
+
+
+/*
+** frameTap_wanted
+**
+** Description
+**  Tells the detector whether a viewer is attached, so it can skip
+**  building the overlay when nobody looks.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**  nowNs		CLOCK_MONOTONIC time
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if a viewer read the slot in the last FRAME_TAP_VIEWER_TIMEOUT_MS
+**
+** Special Considerations:
+**  One shared memory load.
+**
+**/
+int frameTap_wanted(frameTap_t *tap, uint64_t nowNs)
+{
+	if (tap->shm == NULL)
+	{
+		return 0;
+	}
+
+	uint64_t viewer = __atomic_load_n(&tap->shm->viewerNs, __ATOMIC_RELAXED);
+
+	return (viewer != 0 && nowNs < viewer + FRAME_TAP_VIEWER_TIMEOUT_MS * 1000000ULL);
+}
+
+
+
+/*
+** frameTap_publish
+**
+** Description
+**  Copies a frame and its overlay into the slot and wakes the viewer.
+**  An unread older frame is replaced; a frame arriving while the
+**  viewer copies the slot out is dropped.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**  frame		CV_8UC1 frame, at most FRAME_TAP_MAX_PIXELS
+**  overlay		what the detector saw, the seq field is filled in
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the frame was published, 0 if it was dropped.
+**
+** Special Considerations:
+**  Single producer. Never blocks.
+**
+**/
+int frameTap_publish(frameTap_t *tap, const cv::Mat& frame, frameTapOverlayType *overlay)
+{
+	if (tap->shm == NULL || frame.type() != CV_8UC1 || frame.total() > FRAME_TAP_MAX_PIXELS)
+	{
+		return 0;
+	}
+
+	frameTapShmType *shm = tap->shm;
+
+	// take the slot unless the viewer holds it
+	uint32_t state = __atomic_load_n(&shm->state, __ATOMIC_RELAXED);
+	if (state == TAP_READING ||
+		!__atomic_compare_exchange_n(&shm->state, &state, TAP_WRITING, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+		tap->dropped++;
+		return 0;
+	}
+
+	uint32_t n = __atomic_load_n(&shm->published, __ATOMIC_RELAXED);
+	overlay->seq = n;
+	shm->overlay = *overlay;
+	shm->width = frame.cols;
+	shm->height = frame.rows;
+	for (int row = 0; row < frame.rows; row++)
+	{
+		memcpy(&shm->pixels[row * frame.cols], frame.ptr(row), frame.cols);
+	}
+
+	__atomic_store_n(&shm->state, TAP_READY, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->published, n + 1, __ATOMIC_SEQ_CST);
+	tap->published++;
+
+	if (__atomic_load_n(&shm->waiters, __ATOMIC_SEQ_CST) != 0)
+	{
+		futex(&shm->published, FUTEX_WAKE, INT_MAX, NULL);
+	}
+
+	return 1;
+}
+
+
+
+/*
+** frameTap_read
+**
+** Description
+**  Waits for a frame newer than the last one read and copies it out
+**  of the slot. Also tells the detector a viewer is attached.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**  timeoutMs	maximum time to wait
+**
+** Output Arguments:
+**  frame		copy of the frame
+**  overlay		what the detector saw
+**
+** Function Return:
+**  1 if a frame was read, 0 on timeout.
+**
+** Special Considerations:
+**  Single viewer. A slot left half written for longer than
+**  FRAME_TAP_VIEWER_TIMEOUT_MS by a detector that died is emptied.
+**
+**/
+int frameTap_read(frameTap_t *tap, cv::Mat& frame, frameTapOverlayType *overlay, int timeoutMs)
+{
+	if (tap->shm == NULL)
+	{
+		return 0;
+	}
+
+	frameTapShmType *shm = tap->shm;
+	uint64_t deadline = pipelineStats_now() + timeoutMs * 1000000ULL;
+
+	while (1)
+	{
+		uint64_t now = pipelineStats_now();
+		__atomic_store_n(&shm->viewerNs, now, __ATOMIC_RELAXED);
+
+		uint32_t published = __atomic_load_n(&shm->published, __ATOMIC_SEQ_CST);
+		if (published != tap->readSeq)
+		{
+			uint32_t ready = TAP_READY;
+			if (__atomic_compare_exchange_n(&shm->state, &ready, TAP_READING, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			{
+				tap->writingNs = 0;
+				frame.create(shm->height, shm->width, CV_8UC1);
+				memcpy(frame.ptr(0), shm->pixels, (size_t)shm->width * shm->height);
+				*overlay = shm->overlay;
+				__atomic_store_n(&shm->state, TAP_EMPTY, __ATOMIC_RELEASE);
+
+				tap->readSeq = overlay->seq + 1;
+				return 1;
+			}
+			if (ready == TAP_WRITING)
+			{
+				// the detector is a memcpy away from publishing, unless it
+				// died half way through
+				if (tap->writingNs == 0)
+				{
+					tap->writingNs = now;
+				}
+				if (now - tap->writingNs < FRAME_TAP_VIEWER_TIMEOUT_MS * 1000000ULL)
+				{
+					if (now >= deadline)
+					{
+						return 0;
+					}
+					sched_yield();
+					continue;
+				}
+
+				uint32_t writing = TAP_WRITING;
+				__atomic_compare_exchange_n(&shm->state, &writing, TAP_EMPTY, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			}
+			tap->writingNs = 0;
+
+			// nothing unread left in the slot
+			tap->readSeq = published;
+		}
+
+		if (now >= deadline)
+		{
+			return 0;
+		}
+
+		// sleep until the next frame, waking up now and then to keep
+		// the detector aware of the viewer
+		uint64_t wait = deadline - now;
+		if (wait > FRAME_TAP_VIEWER_TIMEOUT_MS * 1000000ULL / 2)
+		{
+			wait = FRAME_TAP_VIEWER_TIMEOUT_MS * 1000000ULL / 2;
+		}
+		struct timespec ts;
+		ts.tv_sec = wait / 1000000000ULL;
+		ts.tv_nsec = wait % 1000000000ULL;
+
+		__atomic_add_fetch(&shm->waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&shm->published, __ATOMIC_SEQ_CST) == tap->readSeq)
+		{
+			futex(&shm->published, FUTEX_WAIT, tap->readSeq, &ts);
+		}
+		__atomic_sub_fetch(&shm->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+
+
+/*
+** frameTap_close
+**
+** Description
+**  Unmaps the slot. The shared memory object is left in place for the
+**  other side.
+**
+** Input Arguments:
+**  tap			pointer to frameTap_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void frameTap_close(frameTap_t *tap)
+{
+	if (tap->shm != NULL)
+	{
+		munmap(tap->shm, sizeof(frameTapShmType));
+		tap->shm = NULL;
+	}
+}
+
+
+
+/*
+** futex
+**
+** Description
+**  Thin wrapper around the futex system call. The slot lives in
+**  memory shared between processes so the non-private operations are
+**  used.
+**
+** Input Arguments:
+**  word		futex word
+**  op			FUTEX_WAIT or FUTEX_WAKE
+**  val			expected value (wait) or number of waiters to wake (wake)
+**  timeout		relative timeout for FUTEX_WAIT, NULL for none
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  System call return value
+**
+** Special Considerations:
+**  None
+**
+**/
+static long futex(uint32_t *word, int op, uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
@@ -0,0 +1,296 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : GPIO output line for the blink detector. The line is opened
+				once and then driven with a single write per change, so
+				the per-frame path never forks a shell.
+ ============================================================================
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "../include/gpioOut.h"
+
+
+/************************ Macros **************************************/
+
+#define GPIO_SYSFS_DIR		"/sys/class/gpio"
+#define GPIO_CHARDEV		"/dev/gpiochip0"
+
+
+/********************* LOCAL Function Prototypes **********************/
+
+static int writeFile(const char *path, const char *value);
+static void gpioOut_write(gpioOut_t *line, int level);
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** gpioOut_open
+**
+** Description
+**  Configures the pin as an output and keeps its handle open for
+**  the following set/clear calls.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**  pin			BCM GPIO number
+**  backend		how to drive the pin
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioOut_open(gpioOut_t *line, int pin, gpioOutBackendType backend)
+{
+	char path[64];
+
+	line->backend = backend;
+	line->pin = pin;
+	line->fd = -1;
+	line->state = -1;
+	line->writes = 0;
+
+	switch (backend)
+	{
+		case GPIO_OUT_SYSFS:
+
+			// export the pin (EBUSY means it is already exported)
+			snprintf(path, sizeof(path), "%d", pin);
+			if (!writeFile(GPIO_SYSFS_DIR "/export", path) && errno != EBUSY)
+			{
+				return 0;
+			}
+
+			snprintf(path, sizeof(path), GPIO_SYSFS_DIR "/gpio%d/direction", pin);
+			if (!writeFile(path, "out"))
+			{
+				return 0;
+			}
+
+			snprintf(path, sizeof(path), GPIO_SYSFS_DIR "/gpio%d/value", pin);
+			line->fd = open(path, O_WRONLY);
+			break;
+
+		case GPIO_OUT_CHARDEV:
+		{
+			int chip = open(GPIO_CHARDEV, O_RDONLY);
+			if (chip < 0)
+			{
+				return 0;
+			}
+
+			struct gpiohandle_request req;
+			memset(&req, 0, sizeof(req));
+			req.lineoffsets[0] = pin;
+			req.lines = 1;
+			req.flags = GPIOHANDLE_REQUEST_OUTPUT;
+			strncpy(req.consumer_label, "blinkDetect", sizeof(req.consumer_label) - 1);
+
+			if (ioctl(chip, GPIO_GET_LINEHANDLE_IOCTL, &req) == 0)
+			{
+				line->fd = req.fd;
+			}
+			close(chip);
+			break;
+		}
+
+		case GPIO_OUT_MOCK:
+			return 1;
+
+		default:
+			return 0;
+	}
+
+	return (line->fd >= 0);
+}
+
+
+
+/*
+** gpioOut_set
+**
+** Description
+**  Drives the line high.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioOut_set(gpioOut_t *line)
+{
+	gpioOut_write(line, 1);
+}
+
+
+
+/*
+** gpioOut_clear
+**
+** Description
+**  Drives the line low.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioOut_clear(gpioOut_t *line)
+{
+	gpioOut_write(line, 0);
+}
+
+
+
+/*
+** gpioOut_close
+**
+** Description
+**  Releases the line handle.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioOut_close(gpioOut_t *line)
+{
+	if (line->fd != -1)
+	{
+		close(line->fd);
+		line->fd = -1;
+	}
+}
+
+
+
+/*
+** gpioOut_write
+**
+** Description
+**  Drives the line to the given level with a single system call,
+**  skipping the call if the line is already there.
+**
+** Input Arguments:
+**  line		pointer to gpioOut_t object
+**  level		0 or 1
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  The state only changes when the write succeeds, a failed write is
+**  tried again on the next call.
+**
+**/
+static void gpioOut_write(gpioOut_t *line, int level)
+{
+	if (line->state == level)
+	{
+		return;
+	}
+
+	int ok = 1;
+	if (line->backend == GPIO_OUT_SYSFS)
+	{
+		// pwrite so the file offset never needs rewinding
+		ok = (pwrite(line->fd, level ? "1" : "0", 1, 0) == 1);
+	}
+	else if (line->backend == GPIO_OUT_CHARDEV)
+	{
+		struct gpiohandle_data data;
+		memset(&data, 0, sizeof(data));
+		data.values[0] = level;
+		ok = (ioctl(line->fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) >= 0);
+	}
+
+	if (ok)
+	{
+		line->state = level;
+		line->writes++;
+	}
+}
+
+
+
+/*
+** writeFile
+**
+** Description
+**  Writes a string into a sysfs attribute.
+**
+** Input Arguments:
+**  path		attribute file
+**  value		string to write
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed (errno is set).
+**
+** Special Considerations:
+**  None
+**
+**/
+static int writeFile(const char *path, const char *value)
+{
+	int fd = open(path, O_WRONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	ssize_t len = write(fd, value, strlen(value));
+	int err = errno;
+	close(fd);
+	errno = err;
+
+	return (len == (ssize_t)strlen(value));
+}
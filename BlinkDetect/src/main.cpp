@@ -14,7 +14,12 @@
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
 #include "../include/blinkDetectModule.h"
+#include "../include/faceLocator.h"
+#include "../include/framePacer.h"
 
 
 /************************ Macros **************************************/
@@ -23,7 +28,8 @@
 
 /********************* LOCAL Function Prototypes **********************/
 
-void exitingFunction(int signo);
+static void exitingFunction(int signo);
+static void usage(const char *prog);
 
 /*************************** Globals **********************************/
 
@@ -40,16 +46,79 @@ using namespace std;
 
 
 
+#ifdef INTEGRATED
+// Entry point of the detector in the integrated build, called by
+// main_integrated.cpp on the main thread.
+int blinkDetect_main( int argc, char** argv )
+#else
 // Main function, defines the entry point for the program.
 int main( int argc, char** argv )
+#endif
 {
+	blinkDetectOptionsType options;
+	options.source = "raspicam";
+	options.replay = false;
+	options.gpio = GPIO_OUT_SYSFS;
+	options.trackFace = true;
+	options.trackEyes = true;
+	options.parallelEyes = true;
+	options.faceRateHz = FACE_LOCATOR_DEFAULT_HZ;
+	options.fps = FRAME_PACER_DEFAULT_FPS;
+	options.frameTap = false;
 	
+	int opt;
+	while ((opt = getopt(argc, argv, "s:rg:FESf:p:Th")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				options.source = optarg;
+				break;
+			case 'r':
+				options.replay = true;
+				break;
+			case 'g':
+				if (strcmp(optarg, "sysfs") == 0)			options.gpio = GPIO_OUT_SYSFS;
+				else if (strcmp(optarg, "chardev") == 0)	options.gpio = GPIO_OUT_CHARDEV;
+				else if (strcmp(optarg, "none") == 0)		options.gpio = GPIO_OUT_MOCK;
+				else { usage(argv[0]); return 1; }
+				break;
+			case 'F':
+				options.trackFace = false;
+				break;
+			case 'E':
+				options.trackEyes = false;
+				break;
+			case 'S':
+				options.parallelEyes = false;
+				break;
+			case 'f':
+				options.faceRateHz = atoi(optarg);
+				break;
+			case 'p':
+				options.fps = atoi(optarg);
+				break;
+			case 'T':
+				options.frameTap = true;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
 	
 	// Register a function to be called when SIGINT occurs
 	//
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = exitingFunction;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
 	
+	blinkDetect_task(&options);
 	
-	blinkDetect_task();
+	cout<< "Good bye!" << endl;
 	
 	
 	
@@ -66,7 +135,8 @@ int main( int argc, char** argv )
 **
 ** Description
 **  Function that gets called when interrupting or killing 
-**  the application. Used for cleaning up.
+**  the application. Stops the detector, which cleans up and
+**  prints its statistics before main returns.
 **
 ** Input Arguments:
 **  signo		signal sent by the user
@@ -81,14 +151,45 @@ int main( int argc, char** argv )
 **  None
 **
 **/
-void exitingFunction(int signo)
+static void exitingFunction(int signo)
 {
-	cout<< "Exiting..." << endl;
-	
-	cout<< "Good bye!" << endl;
-	exit(1);
-	
+	blinkDetect_stop();
 }
 
 
 
+
+/*
+** usage
+**
+** Description
+**  Prints the command line options.
+**
+** Input Arguments:
+**  prog		name of the executable
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void usage(const char *prog)
+{
+	cerr << "usage: " << prog << " [-s source] [-r] [-g gpio] [-F] [-E] [-S] [-f hz] [-p fps] [-T]" << endl;
+	cerr << "  -s source   raspicam (default), v4l2[:index], v4l2mmap[:index], video:<file>, images:<dir>" << endl;
+	cerr << "  -r          replay: process frames as fast as possible and report frames/sec" << endl;
+	cerr << "  -g gpio     blink indicator backend: sysfs (default), chardev, none" << endl;
+	cerr << "  -F          disable face tracking, scan the whole frame for the face every frame" << endl;
+	cerr << "  -E          disable eye tracking, search the whole face for the eye every frame" << endl;
+	cerr << "  -S          run the two eye detectors one after the other instead of side by side" << endl;
+	cerr << "  -f hz       face localisation rate on its own thread (default " << FACE_LOCATOR_DEFAULT_HZ
+		 << "), 0 locates the face on every frame" << endl;
+	cerr << "  -p fps      detector frame rate on a live source (default " << FRAME_PACER_DEFAULT_FPS
+		 << "), 0 follows the source" << endl;
+	cerr << "  -T          publish the processed frames for blinkViewer" << endl;
+}
@@ -0,0 +1,131 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Main for the integrated drowsyDetect application. Hosts the
+				blink detector and the sensor fusion in one process: the
+				detector runs on the main thread, the sensor fusion on
+				its own thread, and the blink events go through a
+				process-local blink channel that wakes up the fusion
+				directly.
+ ============================================================================
+ */
+
+
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../../DrowsyDetect/include/common.h"
+#include "../../DrowsyDetect/include/blinkChannel.h"
+#include "../../DrowsyDetect/include/sensorEvents.h"
+#include "../../DrowsyDetect/include/flightRecorder.h"
+#include "../../DrowsyDetect/include/alertScheduler.h"
+#include "../../DrowsyDetect/include/drowsyDetect.h"
+
+
+/************************ Macros **************************************/
+
+
+
+/********************* LOCAL Function Prototypes **********************/
+
+static void blinkPublished(void);
+
+// main of the blink detector, src/main.cpp built with INTEGRATED
+int blinkDetect_main(int argc, char** argv);
+
+/*************************** Globals **********************************/
+
+
+
+/************************** Namespaces ********************************/
+
+using namespace std;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+
+
+// Main function, defines the entry point for the program.
+//
+// usage: drowsyDetectIntegrated [blinkDetect options] -- [drowsyDetect options]
+int main( int argc, char** argv )
+{
+	// split the command line at "--", both halves keep the program name
+	vector<char *> blinkArgs;
+	vector<char *> drowsyArgs;
+	vector<char *> *args = &blinkArgs;
+
+	blinkArgs.push_back(argv[0]);
+	drowsyArgs.push_back(argv[0]);
+	for (int i = 1; i < argc; i++)
+	{
+		if (args == &blinkArgs && strcmp(argv[i], "--") == 0)
+		{
+			args = &drowsyArgs;
+			continue;
+		}
+		args->push_back(argv[i]);
+	}
+	blinkArgs.push_back(NULL);
+	drowsyArgs.push_back(NULL);
+
+	// blink events stay in the process, no bridge thread and no shared
+	// memory object; must be set before either side opens the channel
+	blinkChannel_setLocal(blinkPublished);
+
+	if (!drowsyDetect_start(drowsyArgs.size() - 1, &drowsyArgs[0]))
+	{
+		return 1;
+	}
+
+	thread fusion(sensorFusionAlgorithm);
+	// the fusion loop does not return, it ends with the process
+	fusion.detach();
+
+	// the detector registers its SIGINT/SIGTERM handler after pigpio's,
+	// so an interrupt stops the detector and we clean up below
+	optind = 1;
+	int ret = blinkDetect_main(blinkArgs.size() - 1, &blinkArgs[0]);
+
+	alertScheduler_report();
+	gpioTerminate();
+	flightRecorder_close();
+
+	return ret;
+}
+
+
+
+
+/*
+** blinkPublished
+**
+** Description
+**  Notify function of the local blink channel. Wakes up the sensor
+**  fusion, which reads the event from its own channel handle.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Runs on the detector thread, after every publish.
+**
+**/
+static void blinkPublished(void)
+{
+	sensorEvents_notify(SENSOR_EVENT_BLINK);
+}
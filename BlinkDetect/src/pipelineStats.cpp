@@ -0,0 +1,414 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Per-stage latency instrumentation for the vision pipeline.
+				Stage timings go into lock-free fixed-bucket histograms
+				that are dumped periodically as p50/p95/p99 together
+				with the achieved frame rate.
+ ============================================================================
+ */
+
+
+
+#include <atomic>
+#include <stdio.h>
+#include <time.h>
+
+#include "../include/pipelineStats.h"
+
+
+/************************ Macros **************************************/
+
+// log-linear buckets in microseconds: 4 buckets per power of two
+#define HIST_SUB_BUCKETS		4
+#define HIST_MAX_POWER			24		// ~16 s
+#define HIST_NUM_BUCKETS		(HIST_SUB_BUCKETS * HIST_MAX_POWER)
+
+#define CPU_FREQ_FILE	"/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct
+{
+	std::atomic<unsigned long> bucket[HIST_NUM_BUCKETS];
+	std::atomic<uint64_t> maxUs;
+	std::atomic<unsigned long> misses;		// frames over deadline charged to this stage
+} latencyHistogramType;
+
+
+/*************************** Globals **********************************/
+
+static latencyHistogramType histogram[NUM_PIPELINE_STAGES];
+
+static const char *stageName[NUM_PIPELINE_STAGES] = {
+	"grab", "retrieve", "resize", "equalizeHist", "face detect",
+	"eye track", "eyes classifier", "eyes hybrid", "eyes join", "frame", "capture-to-decision"
+};
+
+// detector thread only
+static uint64_t periodStart = 0;
+static unsigned long periodFrames = 0;
+static unsigned long periodDeadlineMisses = 0;
+
+
+/********************* LOCAL Function Prototypes **********************/
+
+static int bucketIndex(uint64_t us);
+static uint64_t bucketUpperUs(int index);
+static uint64_t percentile(const unsigned long *counts, unsigned long total, double p);
+static long cpuFrequencyMHz(void);
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** pipelineStats_now
+**
+** Description
+**  Reads the monotonic clock.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+uint64_t pipelineStats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+
+/*
+** pipelineStats_record
+**
+** Description
+**  Records the time elapsed since start for the given stage. The
+**  return value can be passed as the start of the next stage.
+**
+** Input Arguments:
+**  stage		pipeline stage
+**  start		stage start time, from pipelineStats_now()
+**  frame		stage times of the frame to add it to, NULL for none
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Current time in nanoseconds
+**
+** Special Considerations:
+**  Wait-free, may be called from any thread. frame belongs to the
+**  caller.
+**
+**/
+uint64_t pipelineStats_record(pipelineStageType stage, uint64_t start, pipelineFrameType *frame)
+{
+	uint64_t now = pipelineStats_now();
+	uint64_t us = (now - start) / 1000;
+	latencyHistogramType *h = &histogram[stage];
+
+	h->bucket[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t max = h->maxUs.load(std::memory_order_relaxed);
+	while (us > max && !h->maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed));
+
+	if (frame != NULL)
+	{
+		frame->stageNs[stage] += now - start;
+	}
+
+	return now;
+}
+
+
+
+/*
+** pipelineStats_frameDone
+**
+** Description
+**  Closes a frame. The frame time is recorded and, if it is over the
+**  deadline, the miss is charged to the slowest stage of that frame,
+**  on whichever thread it ran. The statistics are dumped when the
+**  reporting period has elapsed.
+**
+** Input Arguments:
+**  frame			stage times of the frame
+**  frameStart		time the frame processing started
+**  captureStart	time the frame was grabbed
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Call from the detector thread only.
+**
+**/
+void pipelineStats_frameDone(const pipelineFrameType *frame, uint64_t frameStart, uint64_t captureStart)
+{
+	uint64_t now = pipelineStats_record(STAGE_FRAME, frameStart);
+	pipelineStats_record(STAGE_CAPTURE_TO_DECISION, captureStart);
+
+	if (now - frameStart > (uint64_t)PIPELINE_FRAME_DEADLINE_MS * 1000000ULL)
+	{
+		// blame the slowest stage of this frame inside the deadline
+		// window, grab and retrieve happen before frameStart
+		int worst = STAGE_RESIZE;
+		for (int i = STAGE_RESIZE; i < STAGE_FRAME; i++)
+		{
+			if (frame->stageNs[i] > frame->stageNs[worst])
+			{
+				worst = i;
+			}
+		}
+		histogram[worst].misses.fetch_add(1, std::memory_order_relaxed);
+		periodDeadlineMisses++;
+	}
+
+	periodFrames++;
+	if (periodStart == 0)
+	{
+		periodStart = frameStart;
+	}
+	if (now - periodStart >= (uint64_t)PIPELINE_STATS_PERIOD_SEC * 1000000000ULL)
+	{
+		pipelineStats_dump();
+	}
+}
+
+
+
+/*
+** pipelineStats_dump
+**
+** Description
+**  Prints the statistics gathered since the last dump and starts a
+**  new reporting period.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void pipelineStats_dump(void)
+{
+	uint64_t now = pipelineStats_now();
+	double seconds = (periodStart != 0) ? (now - periodStart) / 1e9 : 0;
+
+	fprintf(stderr, "blinkdetect: stats %.1f s, %lu frames, %.1f fps, cpu %ld MHz, %lu over %d ms deadline\n",
+			seconds, periodFrames, (seconds > 0) ? periodFrames / seconds : 0.0,
+			cpuFrequencyMHz(), periodDeadlineMisses, PIPELINE_FRAME_DEADLINE_MS);
+	fprintf(stderr, "  %-20s %8s %9s %9s %9s %9s %7s\n",
+			"stage", "count", "p50(us)", "p95(us)", "p99(us)", "max(us)", "misses");
+
+	for (int i = 0; i < NUM_PIPELINE_STAGES; i++)
+	{
+		latencyHistogramType *h = &histogram[i];
+		unsigned long counts[HIST_NUM_BUCKETS];
+		unsigned long total = 0;
+
+		// take the interval's counts and start the next one
+		for (int b = 0; b < HIST_NUM_BUCKETS; b++)
+		{
+			counts[b] = h->bucket[b].exchange(0, std::memory_order_relaxed);
+			total += counts[b];
+		}
+		uint64_t max = h->maxUs.exchange(0, std::memory_order_relaxed);
+		unsigned long misses = h->misses.exchange(0, std::memory_order_relaxed);
+
+		if (total == 0)
+		{
+			continue;
+		}
+
+		fprintf(stderr, "  %-20s %8lu %9llu %9llu %9llu %9llu %7lu\n",
+				stageName[i], total,
+				(unsigned long long)percentile(counts, total, 0.50),
+				(unsigned long long)percentile(counts, total, 0.95),
+				(unsigned long long)percentile(counts, total, 0.99),
+				(unsigned long long)max, misses);
+	}
+
+	periodStart = now;
+	periodFrames = 0;
+	periodDeadlineMisses = 0;
+}
+
+
+
+/*
+** bucketIndex
+**
+** Description
+**  Maps a latency to its histogram bucket. Values below 4 us get a
+**  bucket each, above that every power of two is split in 4.
+**
+** Input Arguments:
+**  us		latency in microseconds
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Bucket index
+**
+** Special Considerations:
+**  None
+**
+**/
+static int bucketIndex(uint64_t us)
+{
+	if (us < HIST_SUB_BUCKETS)
+	{
+		return (int)us;
+	}
+
+	int msb = 63 - __builtin_clzll(us);
+	int sub = (int)(us >> (msb - 2)) & (HIST_SUB_BUCKETS - 1);
+	int index = HIST_SUB_BUCKETS * (msb - 1) + sub;
+
+	return (index < HIST_NUM_BUCKETS) ? index : HIST_NUM_BUCKETS - 1;
+}
+
+
+
+/*
+** bucketUpperUs
+**
+** Description
+**  Upper bound of a histogram bucket.
+**
+** Input Arguments:
+**  index	bucket index
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Bucket upper bound in microseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t bucketUpperUs(int index)
+{
+	if (index < HIST_SUB_BUCKETS)
+	{
+		return index + 1;
+	}
+
+	int msb = index / HIST_SUB_BUCKETS + 1;
+	int sub = index % HIST_SUB_BUCKETS;
+
+	return (uint64_t)(HIST_SUB_BUCKETS + sub + 1) << (msb - 2);
+}
+
+
+
+/*
+** percentile
+**
+** Description
+**  Finds the bucket holding the requested percentile.
+**
+** Input Arguments:
+**  counts		bucket counts
+**  total		sum of the counts
+**  p			percentile, 0 to 1
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Upper bound of the bucket in microseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t percentile(const unsigned long *counts, unsigned long total, double p)
+{
+	unsigned long rank = (unsigned long)(p * total + 0.5);
+	unsigned long seen = 0;
+
+	if (rank == 0)
+	{
+		rank = 1;
+	}
+
+	for (int b = 0; b < HIST_NUM_BUCKETS; b++)
+	{
+		seen += counts[b];
+		if (seen >= rank)
+		{
+			return bucketUpperUs(b);
+		}
+	}
+	return bucketUpperUs(HIST_NUM_BUCKETS - 1);
+}
+
+
+
+/*
+** cpuFrequencyMHz
+**
+** Description
+**  Current frequency of cpu0, to spot thermal or undervoltage
+**  throttling next to the latency figures.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Frequency in MHz, or -1 if unknown
+**
+** Special Considerations:
+**  None
+**
+**/
+static long cpuFrequencyMHz(void)
+{
+	long khz = -1;
+	FILE *f = fopen(CPU_FREQ_FILE, "r");
+
+	if (f != NULL)
+	{
+		if (fscanf(f, "%ld", &khz) != 1)
+		{
+			khz = -1;
+		}
+		fclose(f);
+	}
+
+	return (khz > 0) ? khz / 1000 : -1;
+}
@@ -0,0 +1,203 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Small persistent worker pool for the vision pipeline. The
+				threads are started once and run short per-frame jobs, so
+				no thread is created on the frame path.
+ ============================================================================
+ */
+
+
+
+#include <chrono>
+
+#include "../include/workerPool.h"
+
+
+/************************** Namespaces ********************************/
+
+using namespace std;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+WorkerPool::WorkerPool(int threads)
+	: idle(0), running(true), refusedCount(0)
+{
+	for (int i = 0; i < threads; i++)
+	{
+		worker.push_back(std::thread(&WorkerPool::run, this));
+	}
+}
+
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < worker.size(); i++)
+	{
+		worker[i].join();
+	}
+}
+
+
+
+/*
+** WorkerPool::post
+**
+** Description
+**  Hands a job to an idle worker.
+**
+** Input Arguments:
+**  job			function to run on the worker
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  true if the job was taken, false if every worker is busy
+**
+** Special Considerations:
+**  Never blocks on a running job.
+**
+**/
+bool WorkerPool::post(const std::function<void()>& job)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (idle <= (int)jobs.size())
+		{
+			refusedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		jobs.push_back(job);
+	}
+	wake.notify_one();
+	return true;
+}
+
+
+
+/*
+** WorkerPool::run
+**
+** Description
+**  Worker loop. Waits for a job and runs it.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Runs on every worker thread. Jobs left when the pool is destroyed
+**  are not run.
+**
+**/
+void WorkerPool::run()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true)
+	{
+		idle++;
+		while (running && jobs.empty())
+		{
+			wake.wait(guard);
+		}
+		idle--;
+		if (!running)
+		{
+			break;
+		}
+
+		std::function<void()> job = jobs.back();
+		jobs.pop_back();
+
+		guard.unlock();
+		job();
+		guard.lock();
+	}
+}
+
+
+
+
+
+
+JobLatch::JobLatch(int jobs)
+	: pending(jobs)
+{
+}
+
+
+
+/*
+** JobLatch::done
+**
+** Description
+**  Marks one job of the frame as finished.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Called by the job, on the worker thread.
+**
+**/
+void JobLatch::done()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending--;
+	}
+	finished.notify_all();
+}
+
+
+
+/*
+** JobLatch::waitUntil
+**
+** Description
+**  Waits for the jobs of the frame to finish.
+**
+** Input Arguments:
+**  deadlineNs	CLOCK_MONOTONIC time to give up at
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  true if every job finished, false if the deadline passed first
+**
+** Special Considerations:
+**  None
+**
+**/
+bool JobLatch::waitUntil(uint64_t deadlineNs)
+{
+	// steady_clock counts CLOCK_MONOTONIC
+	std::chrono::nanoseconds sinceBoot(deadlineNs);
+	std::chrono::steady_clock::time_point deadline(sinceBoot);
+	std::unique_lock<std::mutex> guard(lock);
+
+	return finished.wait_until(guard, deadline, [this] { return pending <= 0; });
+}
@@ -0,0 +1,82 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Register access backends for the ADS1015 driver. The real
+				chips are reached over /dev/i2c-1, the simulator emulates
+				their registers and conversion timing and plays synthetic
+				or recorded sensor waveforms, so the sensor stack can run
+				without the hardware.
+ ============================================================================
+ */
+
+
+
+#ifndef _ADCBACKEND_H_
+#define _ADCBACKEND_H_
+
+
+#include <stdint.h>
+#include "../include/ads1015.h"
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct {
+
+	const char *name;
+
+	// Opens the chip at the given I2C address. 1 on success, 0 on failure.
+	int (*open)(ads1015_t *chip, int address);
+
+	// SMBus word transfers, the data bytes are in bus order (LSB first).
+	// Negative on error.
+	int (*readWord)(ads1015_t *chip, uint8_t reg);
+	int (*writeWord)(ads1015_t *chip, uint8_t reg, uint16_t value);
+
+	void (*close)(ads1015_t *chip);
+
+} adcBackendOps;
+
+
+/*************************** Globals **********************************/
+
+extern const adcBackendOps adcBackend_i2c;
+extern const adcBackendOps adcBackend_sim;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** adcSim_loadWaveform
+**
+** Description
+**  Replaces the synthetic waveform of a simulated sensor with a
+**  recording. The file holds one sample per line; the last column is
+**  the reading in mV as the driver reports it, so the output of the
+**  pulse sensor saveToFile() plays back as is. The recording loops.
+**
+** Input Arguments:
+**  spec		<sensor>:<file>[@<rate>] with sensor pulse, proximity or
+**				pressure and rate the recording sample rate in Hz
+**				(default 500)
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Call before the ADCs are opened.
+**
+**/
+int adcSim_loadWaveform(const char *spec);
+
+
+
+
+#endif /* #ifndef _ADCBACKEND_H_*/
@@ -0,0 +1,135 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : ADC bus scheduler. A single task owns the I2C bus and both
+				ADS1015 chips, samples every sensor channel on a fixed
+				plan and hands the samples to the sensor tasks through
+				lock-free single-producer/single-consumer queues.
+				When the pulse ADC ALERT/RDY pin is wired, the pulse chip
+				converts continuously and its conversion ready edges
+				pace the scheduler.
+ ============================================================================
+ */
+
+ 
+
+#ifndef _ADCSCHEDULER_H_
+#define _ADCSCHEDULER_H_
+
+
+#include <stdint.h>
+
+
+/************************ Macros **************************************/
+
+#define ADC_SLOT_US					2000	// scheduler period, one pulse sample
+#define ADC_SLOW_PERIOD_SLOTS		50		// proximity/pressure every 100 ms
+#define ADC_QUEUE_SLOTS				64		// per channel, must be a power of two
+#define ADC_REPORT_PERIOD_SEC		10		// rate/jitter report interval
+#define ADC_READY_PERIOD_NS			(1000000000ULL / 490)	// pulse conversion time in continuous mode
+#define ADC_READY_TIMEOUT_MS		20		// no ready edge for this long is a missed edge
+#define ADC_READY_MAX_MISSES		5		// consecutive missed edges: fall back to polling
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	ADC_CH_PULSE,
+	ADC_CH_PROXIMITY,
+	ADC_CH_PRESSURE,
+	NUM_ADC_CHANNELS
+} adcChannelType;
+
+
+typedef struct {
+
+	float voltage;				// converted value in Volts, negative on error
+	uint32_t seq;				// sample number on this channel
+	uint64_t stampNs;			// CLOCK_MONOTONIC time of the conversion start (ready edge in continuous mode)
+
+} adcSampleType;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** adcScheduler_init
+**
+** Description
+**  Opens both ADC chips and sets up the sample queues. The pulse chip
+**  is switched to continuous conversion with a conversion ready alert
+**  on PULSE_ADC_READY_GPIO_PIN; if that fails it is polled instead.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Must be called after gpioInitialise() and before any sensor task
+**  is started.
+**
+**/
+int adcScheduler_init(void);
+
+
+
+/*
+** adcScheduler_task
+**
+** Description
+**  Task that owns the I2C bus. Every slot it reads the conversions
+**  that are due and starts the next ones, so a conversion never holds
+**  the bus while it runs. A slot starts on the pulse conversion ready
+**  edge, or every ADC_SLOT_US when the pulse chip is polled.
+**
+** Input Arguments:
+**  arg		string to be printed at task startup
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void *adcScheduler_task(void *arg);
+
+
+
+/*
+** adcScheduler_read
+**
+** Description
+**  Waits for the next sample of a channel.
+**
+** Input Arguments:
+**  channel		channel to read
+**
+** Output Arguments:
+**  sample		the sample read
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Each channel has a single consumer.
+**
+**/
+void adcScheduler_read(adcChannelType channel, adcSampleType *sample);
+
+
+
+
+#endif
@@ -44,6 +44,30 @@ typedef enum {
 
 
 
+/*
+** ads1015_setBackend
+**
+** Description
+**  Selects how the chips are reached: "i2c" for the real chips on
+**  /dev/i2c-1, "sim" for the simulated ones.
+**
+** Input Arguments:
+**  name		backend name
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if there is no such backend.
+**
+** Special Considerations:
+**  Must be called before ads1015_init.
+**
+**/
+int ads1015_setBackend(const char *name);
+
+
+
 /*
 ** ads1015_init
 ** 
@@ -95,6 +119,60 @@ int ads1015_changeActiveChannel(ads1015_t *chip, int channel);
 
 
 
+/*
+** ads1015_startConversion
+**
+** Description
+**  Selects the channel and starts a single-shot conversion on it. The
+**  result can be read with ads1015_getDataFromActiveChannel once the
+**  conversion time has elapsed.
+**
+** Input Arguments:
+**   A pointer to ads1015_t object
+**   Channel to convert
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The active channel, negative on error
+**
+** Special Considerations:
+**  None
+**
+**/
+int ads1015_startConversion(ads1015_t *chip, int channel);
+
+
+
+/*
+** ads1015_startContinuous
+**
+** Description
+**  Puts the chip in continuous conversion mode on one channel at
+**  490 samples/sec, with the comparator set up as a conversion ready
+**  signal: the ALERT/RDY pin pulses low at the end of every
+**  conversion.
+**
+** Input Arguments:
+**   A pointer to ads1015_t object
+**   Channel to convert
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The active channel, negative on error
+**
+** Special Considerations:
+**  The ALERT/RDY pin is open drain and needs a pull-up. The results
+**  are read with ads1015_getDataFromActiveChannel.
+**
+**/
+int ads1015_startContinuous(ads1015_t *chip, int channel);
+
+
+
 /*
 ** ads1015_getDataFromChannel
 **
@@ -0,0 +1,147 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Alert scheduler. A single task owns the buzzer and plays
+				one alert pattern at a time. Requests of the level that
+				is already sounding or pending are merged into it, a
+				higher level cuts a lower one short, and the pattern
+				edges are timed by a timerfd instead of sleeping.
+ ============================================================================
+ */
+
+
+
+#ifndef _ALERTSCHEDULER_H_
+#define _ALERTSCHEDULER_H_
+
+
+#include <stdint.h>
+
+
+/************************ Macros **************************************/
+
+#define ALERT_PATTERN_MAX_STEPS		8		// on/off steps of a pattern
+#define ALERT_LATENCY_WINDOW		64		// alerts in the recent latency statistics
+#define ALERT_REPORT_PERIOD_SEC		60		// statistics report interval
+
+
+/**************************** Data Types ******************************/
+
+
+// lowest to highest priority
+typedef enum {
+	ALERT_LEVEL_NONE,
+	ALERT_LEVEL_ADVISORY,			// one short beep
+	ALERT_LEVEL_WARNING,			// three beeps
+	ALERT_LEVEL_CRITICAL,			// long tone
+	NUM_ALERT_LEVELS
+} alertLevelType;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** alertScheduler_init
+**
+** Description
+**  Creates the request eventfd and the pattern timer, and switches
+**  the buzzer off.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Must be called after gpioInitialise() and before the task is
+**  started.
+**
+**/
+int alertScheduler_init(void);
+
+
+
+/*
+** alertScheduler_task
+**
+** Description
+**  Task that owns the buzzer. Sleeps until a request arrives or the
+**  current pattern step ends.
+**
+** Input Arguments:
+**  arg		string to be printed at task startup
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void *alertScheduler_task(void *arg);
+
+
+
+/*
+** alertScheduler_request
+**
+** Description
+**  Asks for an alert. Never blocks. A request of a level that is
+**  already pending or sounding, or lower than the one sounding, is
+**  merged into it; a higher level preempts the one sounding.
+**
+** Input Arguments:
+**  level		priority of the alert, selects the buzzer pattern
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+void alertScheduler_request(alertLevelType level);
+
+
+
+/*
+** alertScheduler_report
+**
+** Description
+**  Prints the request counters and the request to buzzer on latency.
+**  The task prints it every ALERT_REPORT_PERIOD_SEC that had
+**  requests, call it at exit for the last period.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+void alertScheduler_report(void);
+
+
+
+
+
+#endif /* #ifndef _ALERTSCHEDULER_H_*/
@@ -0,0 +1,248 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Blink event channel between the blink detector and the
+				sensor fusion. A single-producer/single-consumer ring of
+				timestamped event records in shared memory, with a futex
+				to wake up the consumer.
+ ============================================================================
+ */
+
+
+
+#ifndef _BLINKCHANNEL_H_
+#define _BLINKCHANNEL_H_
+
+
+#include <stdint.h>
+
+
+/************************ Macros **************************************/
+
+#define BLINK_CHANNEL_NAME			"/blinkDchannel"
+#define BLINK_CHANNEL_SLOTS			64			// must be a power of two
+#define BLINK_EYE_BATCH				8			// eye samples per BLINK_EVENT_EYE_SAMPLES
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	BLINK_EVENT_BLINK = 1,
+	BLINK_EVENT_EYE_SAMPLES			// eye-openness of consecutive frames
+} blinkEventKindType;
+
+
+// Eye-openness of one frame
+typedef struct {
+
+	uint32_t offsetUs;			// capture time after the captureNs of the event
+	float eyeOpen;				// 0 (closed) to 1 (open), negative if the eye was not seen
+
+} blinkEyeSampleType;
+
+
+typedef struct {
+
+	uint32_t seq;				// sequence number, assigned by the channel
+	uint32_t kind;				// blinkEventKindType
+	uint64_t captureNs;			// CLOCK_MONOTONIC time the (first) frame was grabbed
+	uint32_t blinkCount;		// blinks since the detector started
+	float eyeOpenClassifier;	// eye-open score of the eye classifier, 0 to 1
+	float eyeOpenHybrid;		// eye-open score of the hybrid detector, 0 to 1
+	uint32_t samples;			// BLINK_EVENT_EYE_SAMPLES: entries of sample used
+	blinkEyeSampleType sample[BLINK_EYE_BATCH];
+
+} blinkEventType;
+
+
+typedef struct blinkChannelShm blinkChannelShmType;
+
+typedef void (*blinkChannelNotifyFunc)(void);
+
+typedef struct {
+
+	blinkChannelShmType *shm;
+	uint32_t readSeq;			// next event to read (consumer only)
+	unsigned long lost;			// events overwritten before they were read
+
+} blinkChannel_t;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** blinkChannel_setLocal
+**
+** Description
+**  Makes the channel process-local, for builds that host the blink
+**  detector and the sensor fusion in one process. The channels
+**  opened afterwards share a ring in ordinary memory instead of the
+**  shared memory object, and every publish calls notify directly.
+**
+** Input Arguments:
+**  notify		called after every publish, on the publishing thread
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Call before any channel is opened. notify must not block.
+**
+**/
+void blinkChannel_setLocal(blinkChannelNotifyFunc notify);
+
+
+
+/*
+** blinkChannel_isLocal
+**
+** Description
+**  Tells whether blinkChannel_setLocal was called.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the channel is process-local, 0 if it is shared memory.
+**
+** Special Considerations:
+**  None
+**
+**/
+int blinkChannel_isLocal(void);
+
+
+
+/*
+** blinkChannel_open
+**
+** Description
+**  Maps the shared memory channel, creating it if it does not exist
+**  yet. Either side may open first, there is no rendezvous.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  A consumer only sees the events published after it opened.
+**
+**/
+int blinkChannel_open(blinkChannel_t *ch);
+
+
+
+/*
+** blinkChannel_publish
+**
+** Description
+**  Appends an event to the channel and wakes up a waiting consumer.
+**  Never blocks: if the consumer is a full ring behind, its oldest
+**  unread event is overwritten.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**  event		event to publish, the seq field is filled in
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Single producer.
+**
+**/
+void blinkChannel_publish(blinkChannel_t *ch, blinkEventType *event);
+
+
+
+/*
+** blinkChannel_poll
+**
+** Description
+**  Reads the next unread event, if any.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**
+** Output Arguments:
+**  event		the event read
+**
+** Function Return:
+**  1 if an event was read, 0 if the channel is empty.
+**
+** Special Considerations:
+**  Single consumer.
+**
+**/
+int blinkChannel_poll(blinkChannel_t *ch, blinkEventType *event);
+
+
+
+/*
+** blinkChannel_wait
+**
+** Description
+**  Sleeps until an unread event is available or the timeout expires.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**  timeoutMs	maximum time to wait, -1 to wait forever
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if an unread event is available, 0 on timeout.
+**
+** Special Considerations:
+**  Single consumer.
+**
+**/
+int blinkChannel_wait(blinkChannel_t *ch, int timeoutMs);
+
+
+
+/*
+** blinkChannel_close
+**
+** Description
+**  Unmaps the channel. The shared memory object is left in place for
+**  the other side.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void blinkChannel_close(blinkChannel_t *ch);
+
+
+
+
+#endif /* #ifndef _BLINKCHANNEL_H_*/
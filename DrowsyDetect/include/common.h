@@ -20,7 +20,11 @@
 #include <pthread.h>    
 #include <semaphore.h>  
 
+#ifdef SIMULATOR
+#include "../include/pigpioSim.h"
+#else
 #include <pigpio.h>
+#endif
 #include "../include/ads1015.h"
 
 /************************ Macros **************************************/
@@ -29,11 +33,14 @@
 #define PULSE_SENSOR_GPIO_PIN			21
 #define PROXIMITY_SENSOR_GPIO_PIN		16
 #define PRESSURE_SENSOR_GPIO_PIN		12
+#define PULSE_ADC_READY_GPIO_PIN		20		// ALERT/RDY of the pulse ADC (input)
 
 #define PULSE_SENSOR_ADC_CHANNEL		0
 #define PROXIMITY_SENSOR_ADC_CHANNEL	1
 #define PRESSURE_SENSOR_ADC_CHANNEL		2
 
+#define SENSOR_AVG_WINDOW_SIZE			5		// proximity and pressure delta: samples averaged
+
 
 
 #endif
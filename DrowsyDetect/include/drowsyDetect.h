@@ -0,0 +1,72 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Entry points of drowsyDetect, for the builds that host it
+				inside another process (the integrated blinkDetect and
+				drowsyDetect executable) instead of running its own main.
+ ============================================================================
+ */
+
+ 
+
+#ifndef _DROWSYDETECT_H_
+#define _DROWSYDETECT_H_
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** drowsyDetect_start
+**
+** Description
+**  Parses the command line, initialises the hardware, the flight
+**  recorder and the sensor events, and starts the sensor, ADC and
+**  buzzer tasks.
+**
+** Input Arguments:
+**  argc		number of arguments
+**  argv		command line
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Uses getopt, reset optind before parsing another command line.
+**
+**/
+int drowsyDetect_start(int argc, char** argv);
+
+
+
+/*
+** sensorFusionAlgorithm
+**
+** Description
+**  Runs the sensor fusion loop.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None, the loop does not return.
+**
+** Special Considerations:
+**  Call after drowsyDetect_start, on the thread that is to run the
+**  fusion.
+**
+**/
+void sensorFusionAlgorithm(void);
+
+
+
+
+#endif /* #ifndef _DROWSYDETECT_H_*/
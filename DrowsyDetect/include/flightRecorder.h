@@ -0,0 +1,264 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Always-on flight recorder. The sensor, blink, fusion and
+				buzzer tasks append compact binary records to a lock-free
+				ring; a background thread drains the ring to a rotating
+				log of length-prefixed, CRC protected records. Recording
+				never blocks the caller: if the ring is full the record is
+				dropped and counted.
+ ============================================================================
+ */
+
+
+
+#ifndef _FLIGHTRECORDER_H_
+#define _FLIGHTRECORDER_H_
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../include/sensorFusion.h"
+
+
+/************************ Macros **************************************/
+
+#define FLIGHT_RECORDER_DEFAULT_PATH	"flight.rec"
+#define FLIGHT_RECORDER_SLOTS			4096				// must be a power of two
+#define FLIGHT_RECORDER_FILE_BYTES		(16 * 1024 * 1024)	// rotate after this size
+#define FLIGHT_RECORDER_FILES			4					// current log plus rotated ones
+#define FLIGHT_RECORDER_FLUSH_MS		100					// writer wake-up period
+
+#define FLIGHT_RECORDER_MAGIC			0x52464444			// "DDFR"
+#define FLIGHT_RECORDER_VERSION			1
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	REC_ADC_SAMPLE = 1,			// source: adcChannelType
+	REC_SENSOR,					// value published to the fusion, source: sensorEventSourceType
+	REC_BLINK,					// blink event, stamped with the frame capture time
+	REC_FUSION,					// alert raised by the fusion, source: fusionDecisionType
+	REC_BUZZER,					// alert pattern started or ended, source: 1 on, 0 off
+	REC_DROPPED,				// records lost because the ring was full
+	REC_EYE						// eye openness of one frame, stamped with its capture time
+} recordKindType;
+
+
+// One record, 32 bytes. In the log every record is preceded by its
+// length and followed by the CRC-32 of the record bytes, so readers
+// can skip kinds they do not know and stop at a torn tail.
+typedef struct {
+
+	uint16_t kind;				// recordKindType
+	uint16_t source;			// meaning depends on kind
+	uint32_t reserved;
+	uint64_t stampNs;			// CLOCK_MONOTONIC
+
+	union {
+		struct { uint32_t seq; float voltage; } adc;
+		struct { int32_t value; int32_t delta; } sensor;
+		struct { uint32_t blinkCount; float eyeOpenClassifier; float eyeOpenHybrid; } blink;
+		struct { int32_t blinkDelta; int32_t proximity; int32_t pressure; int32_t pulseIBI; } fusion;
+		struct { uint32_t level; uint32_t latencyUs; } buzzer;	// alertLevelType, request to buzzer on
+		struct { uint32_t count; } dropped;
+		struct { float eyeOpen; } eye;
+		uint32_t word[4];
+	};
+
+} flightRecordType;
+
+
+// Log file header, followed by the records
+typedef struct {
+
+	uint32_t magic;
+	uint32_t version;
+	uint64_t monotonicNs;		// CLOCK_MONOTONIC when the file was opened
+	uint64_t realtimeNs;		// CLOCK_REALTIME at the same moment
+
+} flightLogHeaderType;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** flightRecorder_init
+**
+** Description
+**  Rotates the logs of the previous run, opens a new log and starts
+**  the writer thread.
+**
+** Input Arguments:
+**  path		log file, the rotated logs are path.1, path.2, ...
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Until this succeeds the record functions do nothing.
+**
+**/
+int flightRecorder_init(const char *path);
+
+
+
+/*
+** flightRecorder_record
+**
+** Description
+**  Appends a record to the ring. Wait-free for a single caller,
+**  lock-free with many: never sleeps and never touches the disk.
+**
+** Input Arguments:
+**  rec			record to append
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the record was queued, 0 if it was dropped.
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+int flightRecorder_record(const flightRecordType *rec);
+
+
+
+/*
+** flightRecorder_adcSample / flightRecorder_sensor / flightRecorder_blink /
+** flightRecorder_eye / flightRecorder_fusion / flightRecorder_buzzer
+**
+** Description
+**  Build and append one record of each kind.
+**
+** Input Arguments:
+**  See the fields of flightRecordType. stampNs is CLOCK_MONOTONIC, 0
+**  stamps the record with the current time.
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+void flightRecorder_adcSample(int channel, uint32_t seq, float voltage, uint64_t stampNs);
+void flightRecorder_sensor(int source, int value, int delta);
+void flightRecorder_blink(uint32_t blinkCount, float eyeOpenClassifier, float eyeOpenHybrid, uint64_t captureNs);
+void flightRecorder_eye(float eyeOpen, uint64_t captureNs);
+void flightRecorder_fusion(fusionDecisionType decision, int blinkDelta, int proximity, int pressure, int pulseIBI);
+void flightRecorder_buzzer(int on, int level, uint32_t latencyUs);
+
+
+
+/*
+** flightRecorder_close
+**
+** Description
+**  Stops the writer thread after it drained the ring, and closes the
+**  log.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Records appended after this are dropped.
+**
+**/
+void flightRecorder_close(void);
+
+
+
+/*
+** flightRecorder_openLog
+**
+** Description
+**  Opens a log for reading and checks its header.
+**
+** Input Arguments:
+**  path		log file
+**
+** Output Arguments:
+**  header		header of the log
+**
+** Function Return:
+**  The open log, NULL if it cannot be opened or is not a log.
+**
+** Special Considerations:
+**  Close with fclose.
+**
+**/
+FILE *flightRecorder_openLog(const char *path, flightLogHeaderType *header);
+
+
+
+/*
+** flightRecorder_readLog
+**
+** Description
+**  Reads the next record of a log.
+**
+** Input Arguments:
+**  f			log opened with flightRecorder_openLog
+**
+** Output Arguments:
+**  rec			the record read
+**
+** Function Return:
+**  1 if a record was read, 0 at the end of the log, -1 if the record
+**  failed its CRC check (rec is not valid, reading can go on).
+**
+** Special Considerations:
+**  A torn record at the end of the log counts as the end.
+**
+**/
+int flightRecorder_readLog(FILE *f, flightRecordType *rec);
+
+
+
+/*
+** flightRecorder_crc32
+**
+** Description
+**  CRC-32 (IEEE 802.3) of a buffer, as stored after every record.
+**
+** Input Arguments:
+**  data		buffer
+**  length		buffer length in bytes
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The CRC
+**
+** Special Considerations:
+**  None
+**
+**/
+uint32_t flightRecorder_crc32(const void *data, uint32_t length);
+
+
+
+
+#endif /* #ifndef _FLIGHTRECORDER_H_*/
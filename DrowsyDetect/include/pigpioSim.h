@@ -0,0 +1,125 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Stand-in for the subset of the pigpio library used by the
+				application, for simulator builds on machines without
+				the GPIO hardware. Threads and timing behave like pigpio,
+				outputs are only remembered and inputs change only when
+				a simulated device drives them.
+ ============================================================================
+ */
+
+
+
+#ifndef _PIGPIOSIM_H_
+#define _PIGPIOSIM_H_
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+
+/************************ Macros **************************************/
+
+#define PI_INPUT				0
+#define PI_OUTPUT				1
+
+#define PI_PUD_OFF				0
+#define PI_PUD_DOWN				1
+#define PI_PUD_UP				2
+
+#define PI_TIME_RELATIVE		0
+#define PI_TIME_ABSOLUTE		1
+
+#define RISING_EDGE				0
+#define FALLING_EDGE			1
+#define EITHER_EDGE				2
+
+#define PI_BAD_GPIO				-3
+
+
+/**************************** Data Types ******************************/
+
+
+typedef void *(gpioThreadFunc_t)(void *);
+typedef void (*gpioAlertFuncEx_t)(int gpio, int level, uint32_t tick, void *userdata);
+typedef void (*gpioSignalFunc_t)(int signum);
+
+
+/************************ Function Prototypes *************************/
+
+
+int gpioInitialise(void);
+void gpioTerminate(void);
+
+int gpioSetMode(unsigned gpio, unsigned mode);
+int gpioSetPullUpDown(unsigned gpio, unsigned pud);
+int gpioRead(unsigned gpio);
+int gpioWrite(unsigned gpio, unsigned level);
+int gpioPWM(unsigned gpio, unsigned dutycycle);
+
+pthread_t *gpioStartThread(gpioThreadFunc_t f, void *userdata);
+void gpioStopThread(pthread_t *pth);
+
+uint32_t gpioTick(void);
+int gpioSleep(unsigned timetype, int seconds, int micros);
+
+
+
+/*
+** gpioSetAlertFuncEx
+**
+** Description
+**  Registers the function called on every level change of a GPIO.
+**
+** Input Arguments:
+**  gpio		GPIO to watch
+**  f			callback, NULL to cancel
+**  userdata	passed to the callback
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0, or PI_BAD_GPIO
+**
+** Special Considerations:
+**  Only the simulated devices change inputs, through
+**  pigpioSim_driveInput().
+**
+**/
+int gpioSetAlertFuncEx(unsigned gpio, gpioAlertFuncEx_t f, void *userdata);
+
+int gpioSetSignalFunc(unsigned signum, gpioSignalFunc_t f);
+
+
+
+/*
+** pigpioSim_driveInput
+**
+** Description
+**  Drives an input from a simulated device and calls its alert
+**  function if the level changed.
+**
+** Input Arguments:
+**  gpio		GPIO driven
+**  level		0 or 1
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0, or PI_BAD_GPIO
+**
+** Special Considerations:
+**  The alert function runs on the calling thread, which stands in for
+**  the pigpio alert thread.
+**
+**/
+int pigpioSim_driveInput(unsigned gpio, unsigned level);
+
+
+
+
+#endif /* #ifndef _PIGPIOSIM_H_*/
@@ -0,0 +1,186 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : New sensor data notifications for the sensor fusion. Every
+				producer signals its own eventfd, the fusion thread
+				blocks on all of them plus a timerfd for its hold-off
+				deadlines.
+ ============================================================================
+ */
+
+ 
+
+#ifndef _SENSOREVENTS_H_
+#define _SENSOREVENTS_H_
+
+
+#include <stdint.h>
+
+
+/************************ Macros **************************************/
+
+#define SENSOR_EVENT_BIT(src)		(1u << (src))
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	SENSOR_EVENT_PULSE,
+	SENSOR_EVENT_PROXIMITY,
+	SENSOR_EVENT_PRESSURE,
+	SENSOR_EVENT_BLINK,
+	SENSOR_EVENT_TIMER,			// fusion deadline expired
+	NUM_SENSOR_EVENTS
+} sensorEventSourceType;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** sensorEvents_init
+**
+** Description
+**  Creates the notification eventfds, the deadline timer and the
+**  epoll set that waits on all of them.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Must be called before any producer task is started.
+**
+**/
+int sensorEvents_init(void);
+
+
+
+/*
+** sensorEvents_notify
+**
+** Description
+**  Signals that the given producer has published new data.
+**
+** Input Arguments:
+**  src			producer that has new data
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  May be called from any thread. Notifications that arrive before
+**  the fusion thread wakes up are merged.
+**
+**/
+void sensorEvents_notify(sensorEventSourceType src);
+
+
+
+/*
+** sensorEvents_wait
+**
+** Description
+**  Blocks until at least one producer has new data or the deadline
+**  timer expires.
+**
+** Input Arguments:
+**  timeoutMs	maximum time to wait, -1 to wait forever
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Mask of SENSOR_EVENT_BIT() of the sources that fired, 0 on timeout.
+**
+** Special Considerations:
+**  Call from the fusion thread only.
+**
+**/
+unsigned int sensorEvents_wait(int timeoutMs);
+
+
+
+/*
+** sensorEvents_setDeadline
+**
+** Description
+**  Arms the deadline timer to fire SENSOR_EVENT_TIMER at the given
+**  time, replacing any previous deadline.
+**
+** Input Arguments:
+**  deadlineMs	absolute time from sensorEvents_nowMs(), 0 to disarm
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  A deadline already in the past fires immediately.
+**
+**/
+void sensorEvents_setDeadline(uint64_t deadlineMs);
+
+
+
+/*
+** sensorEvents_nowMs
+**
+** Description
+**  Reads the monotonic clock the deadlines are expressed in.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in milliseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+uint64_t sensorEvents_nowMs(void);
+
+
+
+/*
+** sensorEvents_close
+**
+** Description
+**  Releases the file descriptors.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorEvents_close(void);
+
+
+
+
+#endif
@@ -0,0 +1,451 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Sensor fusion algorithm of the drowsiness detection system.
+				The fusion runs on a clock supplied by the caller and
+				reports alerts through a callback, so the same code runs
+				live on the sensor tasks and offline on recorded drives.
+ ============================================================================
+ */
+
+
+
+#ifndef _SENSORFUSION_H_
+#define _SENSORFUSION_H_
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../include/streamStats.h"
+
+
+/************************ Macros **************************************/
+
+#define SENSOR_FUSION_BLINK_QUEUE	64			// blinks accepted between two steps
+#define PULSE_CIRCULAR_BUF_SIZE 	15
+#define BLINK_HISTORY_SIZE			5
+#define SENSOR_FUSION_EYE_WINDOW	2048		// eye samples in the PERCLOS window
+#define SENSOR_FUSION_MAX_RULES		16
+#define FUSION_RULE_MAX_CONDITIONS	4
+#define FUSION_INPUT_BIT(input)		(1u << (input))
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	FUSION_PROXIMITY = 1,
+	FUSION_PRESSURE,
+	FUSION_BLINK,
+	FUSION_BLINK_PROXIMITY,
+	FUSION_BLINK_PRESSURE,
+	FUSION_PROXIMITY_PRESSURE,
+	FUSION_BLINK_PULSE,
+	FUSION_PROXIMITY_PULSE,
+	FUSION_PRESSURE_PULSE,
+	FUSION_PERCLOS,
+	FUSION_LONG_BLINK,
+	NUM_FUSION_DECISIONS
+} fusionDecisionType;
+
+
+// Sensor values the fusion rules can test
+typedef enum {
+	FUSION_INPUT_BLINK,				// interval of a new blink in msec, an event
+	FUSION_INPUT_PROXIMITY,
+	FUSION_INPUT_PROXIMITY_DELTA,
+	FUSION_INPUT_PRESSURE,
+	FUSION_INPUT_PRESSURE_DELTA,
+	FUSION_INPUT_PULSE,				// inter-beat interval in msec
+	FUSION_INPUT_PERCLOS,
+	FUSION_INPUT_BLINK_DURATION,
+	NUM_FUSION_INPUTS
+} fusionInputType;
+
+
+// A number, or the value of a configuration parameter
+typedef struct {
+
+	int parameter;					// index of the parameter, -1 for a number
+	int value;						// the number
+
+} fusionValueType;
+
+
+// input < threshold or input > threshold
+typedef struct {
+
+	fusionInputType input;
+	char op;						// '<' or '>'
+	fusionValueType threshold;
+
+} fusionConditionType;
+
+
+// Alerts when all its conditions hold, at most once per hold-off
+typedef struct {
+
+	fusionDecisionType decision;
+	fusionValueType holdOffMs;
+	int conditions;
+	fusionConditionType condition[FUSION_RULE_MAX_CONDITIONS];
+
+} fusionRuleType;
+
+
+typedef enum {
+	PRESSURE_IDLE,
+	PRESSURE_NO_GRIP,
+	PRESSURE_ALERT,
+	PRESSURE_DISABLE_ALERT
+} pressureStatesType;
+
+
+// Thresholds and hold-off times, all times in msec
+typedef struct {
+
+	int proximityDeltaThreshold;	// approaching object: rise over the recent average
+	int proximityHoldOffMs;
+	int blinkEventThreshold;		// blinks closer than this alert on their own
+	int blinkHoldOffMs;
+	int noGripThreshold;			// pressure below this is no grip
+	int noGripTimeMs;				// for this long alerts
+	int pressureHoldOffMs;
+	int blinkThreshold;				// fused rules: blink interval below this
+	int proximityThreshold;			// fused rules: proximity above this
+	int pressureThreshold;			// fused rules: pressure below this
+	int pulseThreshold;				// fused rules: inter-beat interval above this
+	int fuseHoldOffMs;
+	int eyeClosedThreshold;			// eye openness (percent) at or below this is closed
+	int eyeOpenThreshold;			// a closed eye opens again at or above this
+	int perclosWindowMs;			// PERCLOS: share of this window the eye was closed
+	int perclosThreshold;			// PERCLOS (percent) above this alerts
+	int longBlinkMs;				// eye closed longer than this alerts
+	int eyeHoldOffMs;
+
+	// fused rules, in priority order
+	int rules;
+	fusionRuleType rule[SENSOR_FUSION_MAX_RULES];
+
+} sensorFusionConfigType;
+
+
+// Latest value of every sensor
+typedef struct {
+
+	int proximity;
+	int deltaProximity;
+	int pressure;
+	int deltaPressure;
+	int pulseIBI;
+	int blinkDelta;
+	int perclos;					// percent of the PERCLOS window the eye was closed
+	int blinkDurationMs;			// eye closure in progress, or the last one
+
+} sensorFusionInputsType;
+
+
+typedef void (*sensorFusionAlertFunc)(fusionDecisionType decision, uint64_t now, const sensorFusionInputsType *in, void *userdata);
+
+
+typedef struct {
+
+	sensorFusionConfigType cfg;
+	sensorFusionAlertFunc alert;
+	void *userdata;
+	int verbose;					// print every blink interval
+
+	// inputs since the last step
+	sensorFusionInputsType in;
+	unsigned int updated;			// SENSOR_EVENT_BIT of the sensors that published
+	uint64_t blinkCaptureNs[SENSOR_FUSION_BLINK_QUEUE];
+	int blinks;
+
+	// proximity rule
+	int proximityFlag;
+	uint64_t proximityTime;
+
+	// blink rule
+	uint64_t blinkCapturePrev;
+	RingWindow<unsigned int, BLINK_HISTORY_SIZE> blinkDeltaHistory;
+	int blinkFlag;
+	uint64_t blinkTimeoutTime;
+
+	// eye openness: PERCLOS window of closed/open frames, eye closures
+	Ring<uint64_t, SENSOR_FUSION_EYE_WINDOW> eyeSampleMs;
+	RingWindow<int, SENSOR_FUSION_EYE_WINDOW> eyeSampleClosed;	// total() is the closed samples
+	int eyeClosed;					// closure in progress
+	uint64_t eyeClosedMs;			// capture time the closure started
+	int longBlink;					// a closure passed longBlinkMs since the last step
+	int eyeFlag;
+	uint64_t eyeTime;
+
+	// pulse
+	RingWindow<int, PULSE_CIRCULAR_BUF_SIZE> pulseIBIWindow;
+
+	// pressure state machine
+	pressureStatesType pressureState;
+	uint64_t pressureTime;
+
+	// fused rules: the inputs each one reads, its resolved thresholds
+	// and when it last alerted
+	unsigned int changed;			// FUSION_INPUT_BIT of the inputs handed in since the last step
+	unsigned int ruleInputs[SENSOR_FUSION_MAX_RULES];
+	int ruleThreshold[SENSOR_FUSION_MAX_RULES][FUSION_RULE_MAX_CONDITIONS];
+	int ruleHoldOffMs[SENSOR_FUSION_MAX_RULES];
+	uint64_t ruleAlertTime[SENSOR_FUSION_MAX_RULES];
+	int ruleAlerted[SENSOR_FUSION_MAX_RULES];
+
+} sensorFusion_t;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** sensorFusion_defaultConfig
+**
+** Description
+**  Fills in the thresholds the system was tuned with, and the fused
+**  rules they go with.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  cfg			default configuration
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_defaultConfig(sensorFusionConfigType *cfg);
+
+
+
+/*
+** sensorFusion_setParameter
+**
+** Description
+**  Overrides one configuration value by name, e.g.
+**  "blinkThreshold=900".
+**
+** Input Arguments:
+**  cfg			configuration to change
+**  assignment	name=value
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if the name is not known or the
+**  value is not a number.
+**
+** Special Considerations:
+**  None
+**
+**/
+int sensorFusion_setParameter(sensorFusionConfigType *cfg, const char *assignment);
+
+
+
+/*
+** sensorFusion_printParameters
+**
+** Description
+**  Prints every configuration value as name=value.
+**
+** Input Arguments:
+**  cfg			configuration
+**  f			output stream
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_printParameters(const sensorFusionConfigType *cfg, FILE *f);
+
+
+
+/*
+** sensorFusion_loadRules
+**
+** Description
+**  Replaces the fused rules with the ones of a rules file. One rule
+**  per line, in priority order:
+**
+**    <alert> <hold-off> <input><op><threshold>...
+**
+**  e.g. "blinkProximity fuseHoldOffMs blink<blinkThreshold proximity>180".
+**  The hold-off and the thresholds are numbers or parameter names;
+**  op is < or >. A rule that tests blink only runs on a new blink.
+**  Everything after a # is a comment.
+**
+** Input Arguments:
+**  cfg			configuration to change
+**  path		rules file
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if the file could not be read or
+**  has errors; the errors are printed and cfg is left unchanged.
+**
+** Special Considerations:
+**  Parameter names are resolved by sensorFusion_init, so -t overrides
+**  apply to the rules whatever the order.
+**
+**/
+int sensorFusion_loadRules(sensorFusionConfigType *cfg, const char *path);
+
+
+
+/*
+** sensorFusion_printRules
+**
+** Description
+**  Prints the fused rules in the format of a rules file.
+**
+** Input Arguments:
+**  cfg			configuration
+**  f			output stream
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_printRules(const sensorFusionConfigType *cfg, FILE *f);
+
+
+
+/*
+** sensorFusion_init
+**
+** Description
+**  Resets the fusion state.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  cfg			thresholds, copied
+**  alert		called for every alert
+**  userdata	passed to alert
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_init(sensorFusion_t *f, const sensorFusionConfigType *cfg, sensorFusionAlertFunc alert, void *userdata);
+
+
+
+/*
+** sensorFusion_proximity / sensorFusion_pressure / sensorFusion_pulse /
+** sensorFusion_blink / sensorFusion_eyeOpen
+**
+** Description
+**  Hand a new sensor value to the fusion. It is used by the next
+**  sensorFusion_step.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  value		scaled reading, or the inter-beat interval in msec
+**  delta		change over the recent average
+**  captureNs	capture time of the frame the blink or eye was seen in
+**  eyeOpen		eye openness of the frame, 0 (closed) to 1 (open),
+**				negative if the eye was not seen
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Blinks beyond SENSOR_FUSION_BLINK_QUEUE per step are dropped.
+**  Eye samples are folded into PERCLOS and the blink duration as they
+**  arrive, in capture order.
+**
+**/
+void sensorFusion_proximity(sensorFusion_t *f, int value, int delta);
+void sensorFusion_pressure(sensorFusion_t *f, int value, int delta);
+void sensorFusion_pulse(sensorFusion_t *f, int ibi);
+void sensorFusion_blink(sensorFusion_t *f, uint64_t captureNs);
+void sensorFusion_eyeOpen(sensorFusion_t *f, uint64_t captureNs, float eyeOpen);
+
+
+
+/*
+** sensorFusion_step
+**
+** Description
+**  Runs the rules on the values handed in since the last step, plus
+**  the time driven parts (hold-offs, the pressure state machine).
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  now			current time in msec, must not go backwards
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Time the fusion must step again even if no sensor publishes, 0 if
+**  it only needs to step on new data.
+**
+** Special Considerations:
+**  None
+**
+**/
+uint64_t sensorFusion_step(sensorFusion_t *f, uint64_t now);
+
+
+
+/*
+** sensorFusion_decisionName
+**
+** Description
+**  Short name of an alert.
+**
+** Input Arguments:
+**  decision	rule that fired
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The name
+**
+** Special Considerations:
+**  None
+**
+**/
+const char *sensorFusion_decisionName(fusionDecisionType decision);
+
+
+
+
+#endif /* #ifndef _SENSORFUSION_H_*/
@@ -0,0 +1,111 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Latest reading of every sensor, published by the sensor
+				tasks and read by the sensor fusion as one consistent,
+				timestamped snapshot. Every sensor has one writer and
+				two copies of its reading: the writer fills the copy
+				readers are not directed to and then flips the index, so
+				a reader always finds a complete copy, even while the
+				writer is preempted half way through an update.
+ ============================================================================
+ */
+
+
+
+#ifndef _SENSORSNAPSHOT_H_
+#define _SENSORSNAPSHOT_H_
+
+
+#include <stdint.h>
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	SENSOR_PULSE,
+	SENSOR_PROXIMITY,
+	SENSOR_PRESSURE,
+	NUM_SENSORS
+} sensorIdType;
+
+
+typedef struct {
+
+	int value;					// scaled reading, inter-beat interval in msec for the pulse
+	int delta;					// change over the recent average, 0 for the pulse
+	uint64_t stampNs;			// CLOCK_MONOTONIC time of the sample the value came from
+	uint32_t updates;			// values published so far
+
+} sensorReadingType;
+
+
+typedef struct {
+
+	uint32_t version;			// readings published so far, all sensors
+	sensorReadingType sensor[NUM_SENSORS];
+
+} sensorDataType;
+
+
+/************************ Function Prototypes *************************/
+
+
+
+/*
+** sensorSnapshot_publish
+**
+** Description
+**  Publishes a new reading of one sensor.
+**
+** Input Arguments:
+**  sensor		sensor the reading comes from
+**  value		scaled reading, or the inter-beat interval in msec
+**  delta		change over the recent average
+**  stampNs		time of the sample the value came from
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Each sensor must be published by a single thread, its sensor
+**  task. Never waits for anything.
+**
+**/
+void sensorSnapshot_publish(sensorIdType sensor, int value, int delta, uint64_t stampNs);
+
+
+
+/*
+** sensorSnapshot_read
+**
+** Description
+**  Copies the latest complete reading of every sensor.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  snapshot	the readings
+**
+** Function Return:
+**  Number of attempts it took, 1 unless a writer published twice
+**  during the copy of its sensor.
+**
+** Special Considerations:
+**  Never blocks a writer and never waits on one. Compare the update
+**  counts with a previous snapshot to find the sensors that published
+**  since.
+**
+**/
+int sensorSnapshot_read(sensorDataType *snapshot);
+
+
+
+
+#endif /* #ifndef _SENSORSNAPSHOT_H_*/
@@ -0,0 +1,280 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Streaming statistics for the sensor windows. Fixed capacity
+				windows set at compile time, updated in constant time
+				per sample: running sum, mean and variance, exponentially
+				weighted moving average, sliding minimum and maximum.
+				Header only, nothing is allocated.
+ ============================================================================
+ */
+
+
+
+#ifndef _STREAMSTATS_H_
+#define _STREAMSTATS_H_
+
+
+#include <math.h>
+
+
+/**************************** Data Types ******************************/
+
+
+
+/*
+** Ring
+**
+** Description
+**  FIFO of the last N samples, oldest first. push() drops the oldest
+**  sample once the ring is full. Keeps no statistics, e.g. for time
+**  stamps that run alongside a RingWindow.
+**
+**/
+template <typename T, int N>
+class Ring
+{
+public:
+	Ring()									{ clear(); }
+
+	void clear()							{ head = 0; count = 0; }
+
+	void push(T v)
+	{
+		if (count == N)
+		{
+			pop();
+		}
+		int n = head + count;
+		v_[(n >= N) ? n - N : n] = v;
+		count++;
+	}
+
+	// drops and returns the oldest sample, the ring must not be empty
+	T pop()
+	{
+		T v = v_[head];
+		head = (head + 1 == N) ? 0 : head + 1;
+		count--;
+		return v;
+	}
+
+	// i-th sample, 0 is the oldest
+	T at(int i) const						{ int n = head + i; return v_[(n >= N) ? n - N : n]; }
+	T oldest() const						{ return at(0); }
+	T newest() const						{ return at(count - 1); }
+
+	int size() const						{ return count; }
+	bool empty() const						{ return count == 0; }
+	bool full() const						{ return count == N; }
+	static int capacity()					{ return N; }
+
+private:
+	T v_[N];
+	int head;
+	int count;
+};
+
+
+
+/*
+** RingWindow
+**
+** Description
+**  A Ring that also keeps the running sum and sum of squares of the
+**  samples in it, so mean() and variance() cost the same for any N.
+**
+** Special Considerations:
+**  The sums are doubles: exact for integer samples of moderate size,
+**  for float samples they drift by rounding over very long runs.
+**
+**/
+template <typename T, int N>
+class RingWindow
+{
+public:
+	RingWindow()							{ clear(); }
+
+	void clear()							{ ring.clear(); sum = 0; sumSq = 0; }
+
+	// fills the whole window with v, e.g. to seed it at start-up
+	void fill(T v)
+	{
+		clear();
+		for (int i = 0; i < N; i++)
+		{
+			push(v);
+		}
+	}
+
+	void push(T v)
+	{
+		if (ring.full())
+		{
+			pop();
+		}
+		ring.push(v);
+		sum += (double)v;
+		sumSq += (double)v * (double)v;
+	}
+
+	// drops and returns the oldest sample, the window must not be empty
+	T pop()
+	{
+		T v = ring.pop();
+		sum -= (double)v;
+		sumSq -= (double)v * (double)v;
+		return v;
+	}
+
+	T at(int i) const						{ return ring.at(i); }
+	T oldest() const						{ return ring.oldest(); }
+	T newest() const						{ return ring.newest(); }
+
+	int size() const						{ return ring.size(); }
+	bool empty() const						{ return ring.empty(); }
+	bool full() const						{ return ring.full(); }
+	static int capacity()					{ return N; }
+
+	double total() const					{ return sum; }
+	double mean() const						{ return (size() > 0) ? sum / size() : 0; }
+
+	// population variance of the window
+	double variance() const
+	{
+		if (size() == 0)
+		{
+			return 0;
+		}
+		double m = sum / size();
+		double var = sumSq / size() - m * m;
+		return (var > 0) ? var : 0;
+	}
+	double stddev() const					{ return sqrt(variance()); }
+
+private:
+	Ring<T, N> ring;
+	double sum;
+	double sumSq;
+};
+
+
+
+/*
+** Ewma
+**
+** Description
+**  Exponentially weighted moving average. Each sample moves the
+**  average alpha of the way towards it; the first sample is taken
+**  as is.
+**
+**/
+class Ewma
+{
+public:
+	Ewma(double alpha) : alpha(alpha), avg(0), primed(false) {}
+
+	void reset()							{ avg = 0; primed = false; }
+
+	double update(double v)
+	{
+		avg = primed ? avg + alpha * (v - avg) : v;
+		primed = true;
+		return avg;
+	}
+
+	double value() const					{ return avg; }
+	bool ready() const						{ return primed; }
+
+private:
+	double alpha;
+	double avg;
+	bool primed;
+};
+
+
+
+/*
+** SlidingMinMax
+**
+** Description
+**  Minimum and maximum of the last N samples. Keeps a monotonic
+**  queue of the samples that can still become the minimum (maximum),
+**  so every push costs constant amortised time and min()/max() are
+**  a lookup.
+**
+** Special Considerations:
+**  min() and max() need at least one sample.
+**
+**/
+template <typename T, int N>
+class SlidingMinMax
+{
+public:
+	SlidingMinMax()							{ clear(); }
+
+	void clear()							{ pushed = 0; lo.clear(); hi.clear(); }
+
+	void push(T v)
+	{
+		unsigned long n = pushed++;
+
+		// samples older than the window leave from the front
+		if (!lo.empty() && n - lo.oldest().n >= (unsigned long)N)
+		{
+			lo.popFront();
+		}
+		if (!hi.empty() && n - hi.oldest().n >= (unsigned long)N)
+		{
+			hi.popFront();
+		}
+
+		// samples the new one outlives and beats leave from the back
+		while (!lo.empty() && lo.newest().v >= v)
+		{
+			lo.popBack();
+		}
+		while (!hi.empty() && hi.newest().v <= v)
+		{
+			hi.popBack();
+		}
+		entry e = { v, n };
+		lo.pushBack(e);
+		hi.pushBack(e);
+	}
+
+	T min() const							{ return lo.oldest().v; }
+	T max() const							{ return hi.oldest().v; }
+	int size() const						{ return (pushed < (unsigned long)N) ? (int)pushed : N; }
+
+private:
+	struct entry { T v; unsigned long n; };
+
+	// double ended ring of at most N entries
+	struct deque
+	{
+		deque()								{ clear(); }
+
+		void clear()						{ head = 0; count = 0; }
+		bool empty() const					{ return count == 0; }
+		const entry& oldest() const			{ return e[head]; }
+		const entry& newest() const			{ int n = head + count - 1; return e[(n >= N) ? n - N : n]; }
+		void popFront()						{ head = (head + 1 == N) ? 0 : head + 1; count--; }
+		void popBack()						{ count--; }
+		void pushBack(const entry& x)		{ int n = head + count; e[(n >= N) ? n - N : n] = x; count++; }
+
+		entry e[N];
+		int head;
+		int count;
+	};
+
+	unsigned long pushed;
+	deque lo;
+	deque hi;
+};
+
+
+
+
+#endif /* #ifndef _STREAMSTATS_H_*/
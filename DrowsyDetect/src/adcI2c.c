@@ -0,0 +1,173 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : I2C register access backend for the ADS1015 driver. Talks
+				to the real chips through /dev/i2c-1.
+ ============================================================================
+ */
+
+
+#include "../include/adcBackend.h"
+#include "../include/i2c-dev.h"
+
+
+
+/***************************** Macros *********************************/
+
+#define I2C_BUS							"/dev/i2c-1"
+
+#define ENABLE_I2C_PEC					1
+#define DISABLE_I2C_PEC					0
+
+
+/******************** Local Function Prototypes *******************/
+static int i2cOpen(ads1015_t *chip, int address);
+static int i2cReadWord(ads1015_t *chip, uint8_t reg);
+static int i2cWriteWord(ads1015_t *chip, uint8_t reg, uint16_t value);
+static void i2cClose(ads1015_t *chip);
+
+
+/*************************** Globals **********************************/
+
+const adcBackendOps adcBackend_i2c = {
+	"i2c",
+	i2cOpen,
+	i2cReadWord,
+	i2cWriteWord,
+	i2cClose
+};
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** i2cOpen
+**
+** Description
+**  Opens the i2c device for read and write access and selects the
+**  slave address of the chip.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**  address		i2c slave address of the chip
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  None
+**
+**/
+static int i2cOpen(ads1015_t *chip, int address)
+{
+	chip->fd = open(I2C_BUS, O_RDWR);
+	if (chip->fd == -1)
+	{
+		return 0;
+	}
+
+	/* Let's register our i2c slave address in the system */
+	if (ioctl(chip->fd, I2C_SLAVE, address) < 0)
+	{
+		return 0;
+	}
+
+	/* Disable the error correction */
+	if (ioctl(chip->fd, I2C_PEC, DISABLE_I2C_PEC) < 0)
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+
+
+/*
+** i2cReadWord
+**
+** Description
+**  Reads a 16 bit register.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**  reg			register pointer
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Register contents in bus byte order, negative on error
+**
+** Special Considerations:
+**  None
+**
+**/
+static int i2cReadWord(ads1015_t *chip, uint8_t reg)
+{
+	return i2c_smbus_read_word_data(chip->fd, reg);
+}
+
+
+
+/*
+** i2cWriteWord
+**
+** Description
+**  Writes a 16 bit register.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**  reg			register pointer
+**  value		register contents in bus byte order
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Negative on error
+**
+** Special Considerations:
+**  None
+**
+**/
+static int i2cWriteWord(ads1015_t *chip, uint8_t reg, uint16_t value)
+{
+	return i2c_smbus_write_word_data(chip->fd, reg, value);
+}
+
+
+
+/*
+** i2cClose
+**
+** Description
+**  Closes the i2c device.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void i2cClose(ads1015_t *chip)
+{
+	if (chip->fd != -1)
+	{
+		close(chip->fd);
+		chip->fd = -1;
+	}
+}
@@ -0,0 +1,654 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : ADC bus scheduler. A single task owns the I2C bus and both
+				ADS1015 chips, samples every sensor channel on a fixed
+				plan and hands the samples to the sensor tasks through
+				lock-free single-producer/single-consumer queues.
+				When the pulse ADC ALERT/RDY pin is wired, the pulse chip
+				converts continuously and its conversion ready edges
+				pace the scheduler.
+ ============================================================================
+ */
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include "../include/common.h"
+#include "../include/adcScheduler.h"
+#include "../include/flightRecorder.h"
+
+
+/************************ Macros **************************************/
+
+#define ADC_READ_ERROR				-100.0
+
+
+/**************************** Data Types ******************************/
+
+
+// where and how often a channel is sampled
+typedef struct {
+
+	adcType chip;
+	int input;					// ADS1015 input of the sensor
+	unsigned int period;		// slots between samples
+	unsigned int phase;			// slot the conversion is started in
+	const char *name;
+
+} adcPlanEntryType;
+
+
+typedef struct {
+
+	// sample queue
+	adcSampleType sample[ADC_QUEUE_SLOTS];
+	uint32_t head;				// written by the scheduler only
+	uint32_t tail;				// written by the consumer only
+	sem_t ready;				// counts the queued samples
+
+	// scheduler state
+	int pending;				// a conversion was started last slot
+	uint64_t pendingNs;
+	uint32_t seq;
+
+	// statistics of the current report period
+	unsigned long samples;
+	unsigned long errors;
+	unsigned long overflows;
+	unsigned long missed;		// conversions never read
+	uint64_t lastNs;
+	uint64_t minIntervalNs;
+	uint64_t maxIntervalNs;
+	double sumSqDeviationUs;
+
+} adcChannelStateType;
+
+
+/*************************** Globals **********************************/
+
+// The pulse sensor has a chip of its own, proximity and pressure share
+// the other one and are sampled half a period apart.
+static const adcPlanEntryType adcPlan[NUM_ADC_CHANNELS] = {
+	{ PULSE,   PULSE_SENSOR_ADC_CHANNEL,     1,                     0,                         "pulse" },
+	{ GENERIC, PROXIMITY_SENSOR_ADC_CHANNEL, ADC_SLOW_PERIOD_SLOTS, 0,                         "proximity" },
+	{ GENERIC, PRESSURE_SENSOR_ADC_CHANNEL,  ADC_SLOW_PERIOD_SLOTS, ADC_SLOW_PERIOD_SLOTS / 2, "pressure" },
+};
+
+static ads1015_t adcChip[2];		// indexed by adcType
+static adcChannelStateType channelState[NUM_ADC_CHANNELS];
+
+// conversion ready alert of the pulse chip
+static int pulseReadyMode = 0;
+static int pulseReadyFd = -1;			// eventfd, counts the ready edges
+static uint64_t pulseReadyNs = 0;
+
+// deadline statistics of the polled slots
+static unsigned long slotsRun = 0;
+static unsigned long deadlinesMissed = 0;
+static uint64_t maxWakeLatencyNs = 0;
+static double sumSqWakeLatencyUs = 0;
+
+
+/********************* LOCAL Function Prototypes **********************/
+static void publishSample(adcChannelType channel, float voltage, uint64_t stampNs);
+static void pulseReadyAlert(int gpio, int level, uint32_t tick, void *userdata);
+static int waitPulseReady(uint64_t *stampNs);
+static uint64_t nominalPeriodNs(int channel);
+static uint64_t sleepUntilNextSlot(uint64_t deadline);
+static void reportStatistics(double seconds);
+static uint64_t nowNs(void);
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** adcScheduler_init
+**
+** Description
+**  Opens both ADC chips and sets up the sample queues. The pulse chip
+**  is switched to continuous conversion with a conversion ready alert
+**  on PULSE_ADC_READY_GPIO_PIN; if that fails it is polled instead.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Must be called after gpioInitialise() and before any sensor task
+**  is started.
+**
+**/
+int adcScheduler_init(void)
+{
+	int ret = 1;
+
+	for (int i = 0; i < NUM_ADC_CHANNELS; i++)
+	{
+		memset(&channelState[i], 0, sizeof(channelState[i]));
+		sem_init(&channelState[i].ready, 0, 0);
+	}
+
+	if (!ads1015_init(&adcChip[GENERIC], GENERIC))
+	{
+		fprintf(stderr, "adcScheduler: ERROR initializing the sensor ADC\n");
+		ret = 0;
+	}
+
+	if (!ads1015_init(&adcChip[PULSE], PULSE))
+	{
+		fprintf(stderr, "adcScheduler: ERROR initializing the pulse ADC\n");
+		return 0;
+	}
+
+	// let the pulse chip tell us when each sample is ready
+	pulseReadyMode = 0;
+	if (pulseReadyFd < 0)
+	{
+		pulseReadyFd = eventfd(0, EFD_CLOEXEC);
+	}
+	if (pulseReadyFd >= 0 &&
+		ads1015_startContinuous(&adcChip[PULSE], PULSE_SENSOR_ADC_CHANNEL) >= 0 &&
+		gpioSetMode(PULSE_ADC_READY_GPIO_PIN, PI_INPUT) == 0 &&
+		gpioSetPullUpDown(PULSE_ADC_READY_GPIO_PIN, PI_PUD_UP) == 0 &&
+		gpioSetAlertFuncEx(PULSE_ADC_READY_GPIO_PIN, pulseReadyAlert, NULL) == 0)
+	{
+		pulseReadyMode = 1;
+		fprintf(stderr, "adcScheduler: pulse ADC paced by conversion ready on GPIO %d\n", PULSE_ADC_READY_GPIO_PIN);
+	}
+	else
+	{
+		fprintf(stderr, "adcScheduler: pulse ADC polled every %d us\n", ADC_SLOT_US);
+	}
+
+	return ret;
+}
+
+
+
+/*
+** adcScheduler_task
+**
+** Description
+**  Task that owns the I2C bus. Every slot it reads the conversions
+**  that are due and starts the next ones, so a conversion never holds
+**  the bus while it runs.
+**
+** Input Arguments:
+**  arg		string to be printed at task startup
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void *adcScheduler_task(void *arg)
+{
+	unsigned long slot = 0;
+	uint64_t now = nowNs();
+	uint64_t reportStart = now;
+	uint64_t deadline = now;
+	int readyMisses = 0;
+
+	printf("adcScheduler: Task Started %s\n", (char *)arg);
+
+	while (1)
+	{
+		// in continuous mode the pulse sample is read as soon as it is ready
+		if (pulseReadyMode)
+		{
+			uint64_t readyNs;
+
+			if (waitPulseReady(&readyNs))
+			{
+				float voltage = ads1015_getDataFromActiveChannel(&adcChip[PULSE]);
+				publishSample(ADC_CH_PULSE, voltage, readyNs);
+				readyMisses = 0;
+			}
+			else if (++readyMisses >= ADC_READY_MAX_MISSES)
+			{
+				fprintf(stderr, "adcScheduler: no conversion ready edge for %d ms, polling the pulse ADC\n",
+						ADC_READY_MAX_MISSES * ADC_READY_TIMEOUT_MS);
+				gpioSetAlertFuncEx(PULSE_ADC_READY_GPIO_PIN, NULL, NULL);
+				pulseReadyMode = 0;
+				deadline = nowNs();
+			}
+		}
+
+		// collect the conversions started in the previous slot
+		for (int i = 0; i < NUM_ADC_CHANNELS; i++)
+		{
+			adcChannelStateType *st = &channelState[i];
+
+			if (st->pending)
+			{
+				float voltage = ads1015_getDataFromActiveChannel(&adcChip[adcPlan[i].chip]);
+				publishSample((adcChannelType)i, voltage, st->pendingNs);
+				st->pending = 0;
+			}
+		}
+
+		// then start the ones due in this slot, they are read next slot
+		for (int i = 0; i < NUM_ADC_CHANNELS; i++)
+		{
+			adcChannelStateType *st = &channelState[i];
+
+			if (i == ADC_CH_PULSE && pulseReadyMode)
+			{
+				continue;
+			}
+
+			if (slot % adcPlan[i].period == adcPlan[i].phase)
+			{
+				now = nowNs();
+				if (ads1015_startConversion(&adcChip[adcPlan[i].chip], adcPlan[i].input) >= 0)
+				{
+					st->pending = 1;
+					st->pendingNs = now;
+				}
+				else
+				{
+					publishSample((adcChannelType)i, ADC_READ_ERROR, now);
+				}
+			}
+		}
+		slot++;
+
+		now = nowNs();
+		if (now - reportStart >= ADC_REPORT_PERIOD_SEC * 1000000000ULL)
+		{
+			reportStatistics((now - reportStart) / 1e9);
+			reportStart = now;
+		}
+
+		// sleep until the next slot, unless the ready edge paces us
+		if (!pulseReadyMode)
+		{
+			deadline = sleepUntilNextSlot(deadline);
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+** adcScheduler_read
+**
+** Description
+**  Waits for the next sample of a channel.
+**
+** Input Arguments:
+**  channel		channel to read
+**
+** Output Arguments:
+**  sample		the sample read
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Each channel has a single consumer.
+**
+**/
+void adcScheduler_read(adcChannelType channel, adcSampleType *sample)
+{
+	adcChannelStateType *st = &channelState[channel];
+
+	// every post matches a queued sample
+	while (sem_wait(&st->ready) < 0 && errno == EINTR);
+
+	uint32_t tail = __atomic_load_n(&st->tail, __ATOMIC_RELAXED);
+	*sample = st->sample[tail & (ADC_QUEUE_SLOTS - 1)];
+	__atomic_store_n(&st->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+
+
+/*
+** publishSample
+**
+** Description
+**  Updates the channel statistics and queues a sample for the
+**  consumer. If the consumer has fallen a full queue behind the
+**  sample is dropped.
+**
+** Input Arguments:
+**  channel		channel sampled
+**  voltage		converted value, ADC_READ_ERROR if the read failed
+**  stampNs		time the conversion was started
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Scheduler task only.
+**
+**/
+static void publishSample(adcChannelType channel, float voltage, uint64_t stampNs)
+{
+	adcChannelStateType *st = &channelState[channel];
+
+	if (voltage <= ADC_READ_ERROR)
+	{
+		st->errors++;
+	}
+
+	// rate and jitter against the nominal period of the plan
+	if (st->lastNs != 0)
+	{
+		uint64_t interval = stampNs - st->lastNs;
+		double deviationUs = ((double)interval - (double)nominalPeriodNs(channel)) / 1000.0;
+
+		if (st->minIntervalNs == 0 || interval < st->minIntervalNs)
+		{
+			st->minIntervalNs = interval;
+		}
+		if (interval > st->maxIntervalNs)
+		{
+			st->maxIntervalNs = interval;
+		}
+		st->sumSqDeviationUs += deviationUs * deviationUs;
+		st->samples++;
+	}
+	st->lastNs = stampNs;
+
+	// every sample goes to the recorder, even one the queue has no room for
+	flightRecorder_adcSample(channel, st->seq, voltage, stampNs);
+
+	uint32_t head = st->head;
+	if (head - __atomic_load_n(&st->tail, __ATOMIC_ACQUIRE) >= ADC_QUEUE_SLOTS)
+	{
+		st->overflows++;
+		return;
+	}
+
+	adcSampleType *sample = &st->sample[head & (ADC_QUEUE_SLOTS - 1)];
+	sample->voltage = voltage;
+	sample->seq = st->seq++;
+	sample->stampNs = stampNs;
+
+	__atomic_store_n(&st->head, head + 1, __ATOMIC_RELEASE);
+	sem_post(&st->ready);
+}
+
+
+
+/*
+** reportStatistics
+**
+** Description
+**  Prints the achieved sampling rate and jitter of every channel and
+**  starts a new report period.
+**
+** Input Arguments:
+**  seconds		length of the report period
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Scheduler task only.
+**
+**/
+static void reportStatistics(double seconds)
+{
+	for (int i = 0; i < NUM_ADC_CHANNELS; i++)
+	{
+		adcChannelStateType *st = &channelState[i];
+		double nominalHz = 1e9 / nominalPeriodNs(i);
+		double jitterUs = (st->samples > 0) ? sqrt(st->sumSqDeviationUs / st->samples) : 0;
+
+		fprintf(stderr, "adcScheduler: %-9s %6.1f Hz (%.1f nominal), jitter %.0f us rms, "
+				"interval %.2f..%.2f ms, %lu errors, %lu overflows, %lu missed\n",
+				adcPlan[i].name, st->samples / seconds, nominalHz, jitterUs,
+				st->minIntervalNs / 1e6, st->maxIntervalNs / 1e6, st->errors, st->overflows, st->missed);
+
+		st->samples = 0;
+		st->errors = 0;
+		st->overflows = 0;
+		st->missed = 0;
+		st->minIntervalNs = 0;
+		st->maxIntervalNs = 0;
+		st->sumSqDeviationUs = 0;
+	}
+
+	if (slotsRun > 0)
+	{
+		fprintf(stderr, "adcScheduler: %lu slots, %lu deadlines missed, wake-up latency %.0f us rms, %.0f us max\n",
+				slotsRun, deadlinesMissed, sqrt(sumSqWakeLatencyUs / slotsRun), maxWakeLatencyNs / 1e3);
+
+		slotsRun = 0;
+		deadlinesMissed = 0;
+		maxWakeLatencyNs = 0;
+		sumSqWakeLatencyUs = 0;
+	}
+}
+
+
+
+/*
+** pulseReadyAlert
+**
+** Description
+**  pigpio alert callback on the pulse ADC ALERT/RDY pin. The falling
+**  edge marks the end of a conversion: stamp it and wake up the
+**  scheduler.
+**
+** Input Arguments:
+**  gpio		pin that changed
+**  level		new level of the pin
+**  tick		pigpio time stamp of the change
+**  userdata	not used
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Runs on the pigpio alert thread.
+**
+**/
+static void pulseReadyAlert(int gpio, int level, uint32_t tick, void *userdata)
+{
+	uint64_t one = 1;
+
+	if (level == 0)
+	{
+		__atomic_store_n(&pulseReadyNs, nowNs(), __ATOMIC_RELEASE);
+		if (write(pulseReadyFd, &one, sizeof(one)) != sizeof(one))
+		{
+			perror("adcScheduler: ready edge");
+		}
+	}
+}
+
+
+
+/*
+** waitPulseReady
+**
+** Description
+**  Waits for the next pulse conversion ready edge. Edges that piled
+**  up while the scheduler was busy are counted as missed samples,
+**  the data register only holds the newest conversion.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  stampNs		time of the newest ready edge
+**
+** Function Return:
+**  1 if a conversion is ready, 0 if no edge came within
+**  ADC_READY_TIMEOUT_MS.
+**
+** Special Considerations:
+**  Scheduler task only. The timeout runs on the monotonic clock, a
+**  wall clock step (NTP at boot) does not move it.
+**
+**/
+static int waitPulseReady(uint64_t *stampNs)
+{
+	struct pollfd pfd;
+	uint64_t edges;
+
+	pfd.fd = pulseReadyFd;
+	pfd.events = POLLIN;
+
+	int ret;
+	while ((ret = poll(&pfd, 1, ADC_READY_TIMEOUT_MS)) < 0 && errno == EINTR);
+	if (ret <= 0)
+	{
+		return 0;
+	}
+
+	// reading resets the count, all but the newest edge were missed
+	if (read(pulseReadyFd, &edges, sizeof(edges)) != sizeof(edges) || edges == 0)
+	{
+		return 0;
+	}
+	channelState[ADC_CH_PULSE].missed += edges - 1;
+
+	*stampNs = __atomic_load_n(&pulseReadyNs, __ATOMIC_ACQUIRE);
+	return 1;
+}
+
+
+
+/*
+** nominalPeriodNs
+**
+** Description
+**  Sampling period the plan asks for on a channel.
+**
+** Input Arguments:
+**  channel		channel sampled
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Period in nanoseconds
+**
+** Special Considerations:
+**  In continuous mode the slots follow the pulse conversion time.
+**
+**/
+static uint64_t nominalPeriodNs(int channel)
+{
+	uint64_t slotNs = pulseReadyMode ? ADC_READY_PERIOD_NS : ADC_SLOT_US * 1000ULL;
+
+	return adcPlan[channel].period * slotNs;
+}
+
+
+
+/*
+** sleepUntilNextSlot
+**
+** Description
+**  Sleeps until the slot after the given deadline. The deadlines are
+**  absolute, so the time spent on the bus does not push the schedule
+**  back. If the slot is already over it counts as missed and the
+**  schedule skips ahead instead of running the missed slots back to
+**  back.
+**
+** Input Arguments:
+**  deadline	start time of the current slot
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Start time of the slot slept to
+**
+** Special Considerations:
+**  Scheduler task only.
+**
+**/
+static uint64_t sleepUntilNextSlot(uint64_t deadline)
+{
+	const uint64_t slotNs = ADC_SLOT_US * 1000ULL;
+	struct timespec ts;
+	uint64_t next = deadline + slotNs;
+	uint64_t now = nowNs();
+
+	if (now >= next)
+	{
+		uint64_t late = (now - next) / slotNs + 1;
+		deadlinesMissed += late;
+		next += late * slotNs;
+	}
+
+	ts.tv_sec = next / 1000000000ULL;
+	ts.tv_nsec = next % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+
+	uint64_t latency = nowNs() - next;
+	if (latency > maxWakeLatencyNs)
+	{
+		maxWakeLatencyNs = latency;
+	}
+	sumSqWakeLatencyUs += (latency / 1e3) * (latency / 1e3);
+	slotsRun++;
+
+	return next;
+}
+
+
+
+/*
+** nowNs
+**
+** Description
+**  Reads the monotonic clock.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
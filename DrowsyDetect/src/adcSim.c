@@ -0,0 +1,791 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Simulated register access backend for the ADS1015 driver.
+				Emulates the registers and the conversion timing of the
+				two chips and feeds them synthetic or recorded pulse,
+				proximity and pressure waveforms.
+ ============================================================================
+ */
+
+
+#include <math.h>
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../include/common.h"
+#include "../include/adcBackend.h"
+
+
+
+/***************************** Macros *********************************/
+
+#define SIM_BASE_ADDRESS				0x48		// generic chip, the pulse chip is 0x49
+#define SIM_NUM_CHIPS					2
+#define SIM_READY_CHIP					1			// ALERT/RDY wired to PULSE_ADC_READY_GPIO_PIN
+#define SIM_DEFAULT_RATE_HZ				500.0
+
+// config register bits the simulator looks at
+#define CONFIG_OS_SINGLE				0x8000
+#define CONFIG_MUX_SINGLE_0				0x4000
+#define CONFIG_MUX_MASK					0x7000
+#define CONFIG_MODE_SINGLE				0x0100
+#define CONFIG_DR_MASK					0x00E0
+#define CONFIG_CQUE_MASK				0x0003
+#define CONFIG_CQUE_NONE				0x0003		// comparator and ALERT/RDY off
+#define CONFIG_DEFAULT					0x8583		// power-on value
+
+
+/**************************** Data Types ******************************/
+
+
+typedef enum {
+	SIM_PULSE,
+	SIM_PROXIMITY,
+	SIM_PRESSURE,
+	NUM_SIM_SENSORS
+} simSensorType;
+
+
+typedef struct {
+
+	float *sample;				// recording in mV, NULL for the synthetic waveform
+	size_t count;
+	double rate;				// recording sample rate in Hz
+
+} simWaveformType;
+
+
+typedef struct {
+
+	int open;
+	uint16_t config;
+	uint16_t loThresh;
+	uint16_t hiThresh;
+	uint16_t conversion;		// conversion register, 12 bit result << 4
+	uint16_t pending;			// result of the single-shot in progress
+	uint64_t convDoneNs;		// end of the single-shot in progress, 0 if idle
+	uint64_t contStartNs;		// start of continuous conversions
+
+} simChipType;
+
+
+/******************** Local Function Prototypes *******************/
+static int simOpen(ads1015_t *chip, int address);
+static int simReadWord(ads1015_t *chip, uint8_t reg);
+static int simWriteWord(ads1015_t *chip, uint8_t reg, uint16_t value);
+static void simClose(ads1015_t *chip);
+static void simUpdate(simChipType *sim, int chipIndex, uint64_t now);
+static uint16_t simConvert(int chipIndex, int input, uint64_t t);
+static float simSensorValue(simSensorType sensor, double seconds);
+static uint64_t simConversionNs(uint16_t config);
+static uint16_t swapBytes(uint16_t word);
+static uint64_t nowNs(void);
+#ifdef SIMULATOR
+static int simReadyEnabled(const simChipType *sim);
+static void *simReadyThread(void *arg);
+#endif
+
+
+/*************************** Globals **********************************/
+
+const adcBackendOps adcBackend_sim = {
+	"sim",
+	simOpen,
+	simReadWord,
+	simWriteWord,
+	simClose
+};
+
+static simChipType simChip[SIM_NUM_CHIPS];
+static simWaveformType simWave[NUM_SIM_SENSORS];
+static const char *simSensorName[NUM_SIM_SENSORS] = { "pulse", "proximity", "pressure" };
+static pthread_mutex_t simLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t simStartNs = 0;
+#ifdef SIMULATOR
+static pthread_cond_t simReadyCond = PTHREAD_COND_INITIALIZER;
+static int simReadyStarted = 0;
+#endif
+
+// data rates selected by the DR bits
+static const unsigned int simDataRate[8] = { 128, 250, 490, 920, 1600, 2400, 3300, 3300 };
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** adcSim_loadWaveform
+**
+** Description
+**  Replaces the synthetic waveform of a simulated sensor with a
+**  recording. The file holds one sample per line; the last column is
+**  the reading in mV as the driver reports it, so the output of the
+**  pulse sensor saveToFile() plays back as is. The recording loops.
+**
+** Input Arguments:
+**  spec		<sensor>:<file>[@<rate>] with sensor pulse, proximity or
+**				pressure and rate the recording sample rate in Hz
+**				(default 500)
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Call before the ADCs are opened.
+**
+**/
+int adcSim_loadWaveform(const char *spec)
+{
+	char path[256];
+	char line[256];
+	int sensor = -1;
+	double rate = SIM_DEFAULT_RATE_HZ;
+
+	const char *colon = strchr(spec, ':');
+	if (colon == NULL)
+	{
+		return 0;
+	}
+
+	for (int i = 0; i < NUM_SIM_SENSORS; i++)
+	{
+		if (strlen(simSensorName[i]) == (size_t)(colon - spec) &&
+			strncmp(spec, simSensorName[i], colon - spec) == 0)
+		{
+			sensor = i;
+		}
+	}
+	if (sensor < 0)
+	{
+		return 0;
+	}
+
+	snprintf(path, sizeof(path), "%s", colon + 1);
+	char *at = strrchr(path, '@');
+	if (at != NULL)
+	{
+		*at = '\0';
+		rate = atof(at + 1);
+		if (rate <= 0)
+		{
+			return 0;
+		}
+	}
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+	{
+		fprintf(stderr, "adcSim: cannot open %s\n", path);
+		return 0;
+	}
+
+	simWaveformType *wave = &simWave[sensor];
+	size_t capacity = 0;
+	free(wave->sample);
+	wave->sample = NULL;
+	wave->count = 0;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		// the value is the last column
+		char *last = NULL;
+		for (char *tok = strtok(line, " \t\r\n,"); tok != NULL; tok = strtok(NULL, " \t\r\n,"))
+		{
+			last = tok;
+		}
+		if (last == NULL)
+		{
+			continue;
+		}
+
+		if (wave->count == capacity)
+		{
+			capacity = (capacity == 0) ? 1024 : capacity * 2;
+			wave->sample = (float *)realloc(wave->sample, capacity * sizeof(float));
+		}
+		wave->sample[wave->count++] = (float)atof(last);
+	}
+	fclose(f);
+
+	if (wave->count == 0)
+	{
+		fprintf(stderr, "adcSim: %s holds no samples\n", path);
+		free(wave->sample);
+		wave->sample = NULL;
+		return 0;
+	}
+	wave->rate = rate;
+
+	fprintf(stderr, "adcSim: %s plays %s (%lu samples at %.0f Hz)\n",
+			simSensorName[sensor], path, (unsigned long)wave->count, rate);
+	return 1;
+}
+
+
+
+/*
+** simOpen
+**
+** Description
+**  Opens a simulated chip. The chip starts with its power-on register
+**  values.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**  address		i2c slave address of the chip
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if there is no chip at address.
+**
+** Special Considerations:
+**  The chip index is kept in the fd field.
+**
+**/
+static int simOpen(ads1015_t *chip, int address)
+{
+	int index = address - SIM_BASE_ADDRESS;
+
+	if (index < 0 || index >= SIM_NUM_CHIPS)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&simLock);
+	if (simStartNs == 0)
+	{
+		simStartNs = nowNs();
+	}
+	simChipType *sim = &simChip[index];
+	if (!sim->open)
+	{
+		memset(sim, 0, sizeof(*sim));
+		sim->config = CONFIG_DEFAULT;
+		sim->loThresh = 0x8000;
+		sim->hiThresh = 0x7FFF;
+		sim->open = 1;
+	}
+	pthread_mutex_unlock(&simLock);
+
+	chip->fd = index;
+	return 1;
+}
+
+
+
+/*
+** simReadWord
+**
+** Description
+**  Reads a simulated register.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**  reg			register pointer
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Register contents in bus byte order, negative on error
+**
+** Special Considerations:
+**  None
+**
+**/
+static int simReadWord(ads1015_t *chip, uint8_t reg)
+{
+	int ret = -1;
+
+	if (chip->fd < 0 || chip->fd >= SIM_NUM_CHIPS)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&simLock);
+	simChipType *sim = &simChip[chip->fd];
+	simUpdate(sim, chip->fd, nowNs());
+
+	switch (reg)
+	{
+		case 0:		// conversion
+			ret = swapBytes(sim->conversion);
+			break;
+		case 1:		// config, OS reads 1 when no conversion is running
+			ret = swapBytes((sim->config & ~CONFIG_OS_SINGLE) | ((sim->convDoneNs == 0) ? CONFIG_OS_SINGLE : 0));
+			break;
+		case 2:
+			ret = swapBytes(sim->loThresh);
+			break;
+		case 3:
+			ret = swapBytes(sim->hiThresh);
+			break;
+		default:
+			break;
+	}
+	pthread_mutex_unlock(&simLock);
+
+	return ret;
+}
+
+
+
+/*
+** simWriteWord
+**
+** Description
+**  Writes a simulated register. Setting OS in single-shot mode starts
+**  a conversion, selecting continuous mode restarts the conversions.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**  reg			register pointer
+**  value		register contents in bus byte order
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Negative on error
+**
+** Special Considerations:
+**  None
+**
+**/
+static int simWriteWord(ads1015_t *chip, uint8_t reg, uint16_t value)
+{
+	int ret = 0;
+
+	if (chip->fd < 0 || chip->fd >= SIM_NUM_CHIPS)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&simLock);
+	simChipType *sim = &simChip[chip->fd];
+	uint64_t now = nowNs();
+	simUpdate(sim, chip->fd, now);
+	value = swapBytes(value);
+
+	switch (reg)
+	{
+		case 1:
+			sim->config = value & ~CONFIG_OS_SINGLE;
+			if (sim->config & CONFIG_MODE_SINGLE)
+			{
+				if (value & CONFIG_OS_SINGLE)
+				{
+					// the input is sampled at the start of the conversion
+					int input = (sim->config & CONFIG_MUX_MASK) - CONFIG_MUX_SINGLE_0;
+					sim->pending = simConvert(chip->fd, input >> 12, now);
+					sim->convDoneNs = now + simConversionNs(sim->config);
+				}
+			}
+			else
+			{
+				sim->contStartNs = now;
+				sim->convDoneNs = 0;
+			}
+#ifdef SIMULATOR
+			if (chip->fd == SIM_READY_CHIP && simReadyEnabled(sim))
+			{
+				pthread_t th;
+				if (!simReadyStarted && pthread_create(&th, NULL, simReadyThread, NULL) == 0)
+				{
+					pthread_detach(th);
+					simReadyStarted = 1;
+				}
+				pthread_cond_signal(&simReadyCond);
+			}
+#endif
+			break;
+		case 2:
+			sim->loThresh = value;
+			break;
+		case 3:
+			sim->hiThresh = value;
+			break;
+		default:
+			ret = -1;
+			break;
+	}
+	pthread_mutex_unlock(&simLock);
+
+	return ret;
+}
+
+
+
+/*
+** simClose
+**
+** Description
+**  Closes a simulated chip. The register state is kept, like the real
+**  chip keeps it while the bus is closed.
+**
+** Input Arguments:
+**  chip		pointer to ads1015_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void simClose(ads1015_t *chip)
+{
+	chip->fd = -1;
+}
+
+
+
+/*
+** simUpdate
+**
+** Description
+**  Brings the conversion register up to date: completes a single-shot
+**  conversion whose time is up, or latches the last conversion that
+**  finished in continuous mode.
+**
+** Input Arguments:
+**  sim			simulated chip
+**  chipIndex	index of the chip
+**  now			current time
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Called with simLock held.
+**
+**/
+static void simUpdate(simChipType *sim, int chipIndex, uint64_t now)
+{
+	if (sim->config & CONFIG_MODE_SINGLE)
+	{
+		if (sim->convDoneNs != 0 && now >= sim->convDoneNs)
+		{
+			sim->conversion = sim->pending;
+			sim->convDoneNs = 0;
+		}
+	}
+	else
+	{
+		uint64_t period = simConversionNs(sim->config);
+		uint64_t done = (now - sim->contStartNs) / period;
+		if (done > 0)
+		{
+			int input = (sim->config & CONFIG_MUX_MASK) - CONFIG_MUX_SINGLE_0;
+			sim->conversion = simConvert(chipIndex, input >> 12, sim->contStartNs + (done - 1) * period);
+		}
+	}
+}
+
+
+
+/*
+** simConvert
+**
+** Description
+**  Samples the sensor wired to a chip input and converts it the way
+**  the driver reads it back (2 mV per count).
+**
+** Input Arguments:
+**  chipIndex	0 for the sensor chip, 1 for the pulse chip
+**  input		single-ended input
+**  t			sampling time
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Conversion register contents
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint16_t simConvert(int chipIndex, int input, uint64_t t)
+{
+	double seconds = (t - simStartNs) / 1e9;
+	float mV = 0;
+
+	if (chipIndex == 1 && input == PULSE_SENSOR_ADC_CHANNEL)
+	{
+		mV = simSensorValue(SIM_PULSE, seconds);
+	}
+	else if (chipIndex == 0 && input == PROXIMITY_SENSOR_ADC_CHANNEL)
+	{
+		mV = simSensorValue(SIM_PROXIMITY, seconds);
+	}
+	else if (chipIndex == 0 && input == PRESSURE_SENSOR_ADC_CHANNEL)
+	{
+		mV = simSensorValue(SIM_PRESSURE, seconds);
+	}
+
+	int code = (int)(mV / 2.0f);
+	if (code < 0) code = 0;
+	if (code > 2047) code = 2047;
+
+	return (uint16_t)(code << 4);
+}
+
+
+
+/*
+** simSensorValue
+**
+** Description
+**  Value of a simulated sensor. Without a recording the sensors follow
+**  a synthetic script: a 72 bpm pulse, an object approaching every
+**  20 seconds and the grip released for 4 seconds every 30 seconds.
+**
+** Input Arguments:
+**  sensor		simulated sensor
+**  seconds		time since the simulation started
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Sensor reading in mV as the driver reports it
+**
+** Special Considerations:
+**  None
+**
+**/
+static float simSensorValue(simSensorType sensor, double seconds)
+{
+	simWaveformType *wave = &simWave[sensor];
+
+	if (wave->sample != NULL)
+	{
+		return wave->sample[(size_t)(seconds * wave->rate) % wave->count];
+	}
+
+	switch (sensor)
+	{
+		case SIM_PULSE:
+		{
+			// systolic peak followed by the dicrotic notch
+			double phase = fmod(seconds, 60.0 / 72.0) / (60.0 / 72.0);
+			double systolic = (phase - 0.15) / 0.05;
+			double dicrotic = (phase - 0.45) / 0.07;
+			return (float)(3300.0 + 700.0 * exp(-systolic * systolic) + 200.0 * exp(-dicrotic * dicrotic));
+		}
+
+		case SIM_PROXIMITY:
+		{
+			// far object, then a fast approach that holds for a while
+			double t = fmod(seconds, 20.0);
+			if (t < 10.0 || t >= 14.0)	return 1000.0f;
+			if (t < 10.3)				return (float)(1000.0 + (t - 10.0) / 0.3 * 2800.0);
+			if (t < 13.0)				return 3800.0f;
+			return (float)(3800.0 - (t - 13.0) * 2800.0);
+		}
+
+		case SIM_PRESSURE:
+		{
+			// firm grip, released for 4 seconds
+			double t = fmod(seconds, 30.0);
+			return (t >= 20.0 && t < 24.0) ? 1600.0f : 3500.0f;
+		}
+
+		default:
+			return 0;
+	}
+}
+
+
+
+/*
+** simConversionNs
+**
+** Description
+**  Conversion time for the data rate selected in the config register.
+**
+** Input Arguments:
+**  config		config register contents
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Conversion time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t simConversionNs(uint16_t config)
+{
+	return 1000000000ULL / simDataRate[(config & CONFIG_DR_MASK) >> 5];
+}
+
+
+
+#ifdef SIMULATOR
+/*
+** simReadyEnabled
+**
+** Description
+**  Tells whether the chip pulses ALERT/RDY at the end of every
+**  conversion: continuous mode, comparator on, Hi_thresh MSB set and
+**  Lo_thresh MSB clear.
+**
+** Input Arguments:
+**  sim			simulated chip
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the ready output is on, 0 otherwise
+**
+** Special Considerations:
+**  Called with simLock held.
+**
+**/
+static int simReadyEnabled(const simChipType *sim)
+{
+	return !(sim->config & CONFIG_MODE_SINGLE) &&
+		   (sim->config & CONFIG_CQUE_MASK) != CONFIG_CQUE_NONE &&
+		   (sim->hiThresh & 0x8000) && !(sim->loThresh & 0x8000);
+}
+
+
+
+/*
+** simReadyThread
+**
+** Description
+**  Drives the ALERT/RDY pin of the pulse chip: a falling edge at the
+**  end of each continuous conversion, on the same contStartNs grid
+**  simUpdate() latches the results on, then back high.
+**
+** Input Arguments:
+**  arg		not used
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Started by the first configuration that turns the ready output
+**  on, sleeps while it is off. The real pin stays low for about 8 us,
+**  the alert sees both edges either way.
+**
+**/
+static void *simReadyThread(void *arg)
+{
+	simChipType *sim = &simChip[SIM_READY_CHIP];
+
+	pthread_mutex_lock(&simLock);
+	while (1)
+	{
+		if (!simReadyEnabled(sim))
+		{
+			pthread_cond_wait(&simReadyCond, &simLock);
+			continue;
+		}
+
+		uint64_t start = sim->contStartNs;
+		uint64_t period = simConversionNs(sim->config);
+		uint64_t done = start + ((nowNs() - start) / period + 1) * period;
+		pthread_mutex_unlock(&simLock);
+
+		struct timespec ts;
+		ts.tv_sec = done / 1000000000ULL;
+		ts.tv_nsec = done % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+
+		// a reconfiguration while asleep restarted the conversions
+		pthread_mutex_lock(&simLock);
+		if (sim->contStartNs != start || !simReadyEnabled(sim))
+		{
+			continue;
+		}
+		pthread_mutex_unlock(&simLock);
+
+		pigpioSim_driveInput(PULSE_ADC_READY_GPIO_PIN, 0);
+		pigpioSim_driveInput(PULSE_ADC_READY_GPIO_PIN, 1);
+
+		pthread_mutex_lock(&simLock);
+	}
+
+	return NULL;
+}
+#endif
+
+
+
+/*
+** swapBytes
+**
+** Description
+**  Converts between bus and host byte order.
+**
+** Input Arguments:
+**  word		16 bit value
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The value with its bytes swapped
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint16_t swapBytes(uint16_t word)
+{
+	return (uint16_t)((word >> 8) | (word << 8));
+}
+
+
+
+/*
+** nowNs
+**
+** Description
+**  Reads the monotonic clock.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
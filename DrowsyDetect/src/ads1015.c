@@ -7,15 +7,16 @@
  */
 
 
+#include <string.h>
+
 #include "../include/ads1015.h"
+#include "../include/adcBackend.h"
 
 
 
 
 /***************************** Macros *********************************/
 
-#define I2C_BUS							"/dev/i2c-1"
-
 //#define CONFIGURE_ADC						1
 #define ADS1015_I2C_ADDRESS					0x48
 #define ADS1015_PULSE_I2C_ADDRESS			0x49
@@ -84,21 +85,18 @@
 #define  ADS1015_REG_CONFIG_CQUE_NONE    	0x0003  //Disable the comparator and put ALERT/RDY in high state (default)
 
 
-#define ENABLE_I2C_PEC						1
-#define DISABLE_I2C_PEC						0
-
-
 /**************************** Data Types ******************************/
 
 
 
 /******************** Global Variables ****************************/
 
+// register access backend shared by both chips
+static const adcBackendOps *backend = &adcBackend_i2c;
 
 
 
 /******************** Local Function Prototypes *******************/
-static int ads1015_i2cInit(ads1015_t *);
 static void byteSwap(uint16_t *word);
 
 
@@ -108,37 +106,41 @@ static void byteSwap(uint16_t *word);
 
 
 /*
-** ads1015_i2cInit
+** ads1015_setBackend
 **
 ** Description
-**  Initializes the i2c port for communication with the ads1015 chips.
-**  Opens the corresponding i2c device for read and write access.
+**  Selects how the chips are reached: "i2c" for the real chips on
+**  /dev/i2c-1, "sim" for the simulated ones.
 **
 ** Input Arguments:
-**  A pointer to ads1015_t object.
+**  name		backend name
 **
 ** Output Arguments:
-**  The opened file descriptor.
+**  None
 **
 ** Function Return:
-**  1 if operation was successful, 0 if it failed.
+**  1 if operation was successful, 0 if there is no such backend.
 **
 ** Special Considerations:
-**  None
+**  Must be called before ads1015_init.
 **
 **/
-int ads1015_i2cInit(ads1015_t *chip)
-{	
-	int fd;	
-	
-	fd = open(I2C_BUS, O_RDWR );
-	if (fd == -1)
-	{				
-		return 0;		
+int ads1015_setBackend(const char *name)
+{
+	if (strcmp(name, adcBackend_i2c.name) == 0)
+	{
+		backend = &adcBackend_i2c;
 	}
-	
-	chip->fd = fd;	
-	return 1;	
+	else if (strcmp(name, adcBackend_sim.name) == 0)
+	{
+		backend = &adcBackend_sim;
+	}
+	else
+	{
+		return 0;
+	}
+
+	return 1;
 }
 
 
@@ -172,36 +174,22 @@ int ads1015_init(ads1015_t *chip, adcType type)
 	chip->fd = -1;
 
 		
-	/* if we got a valid file descriptor configure the i2c bus */
-	if (ads1015_i2cInit(chip))
+	int address = ADS1015_I2C_ADDRESS;
+	
+	// Overwrite the address if the type is PULSE
+	if (type == PULSE)
+	{
+		address = ADS1015_PULSE_I2C_ADDRESS;
+	}
+	
+	/* open the chip through the selected backend */
+	if (backend->open(chip, address))
 	{	
-		int address = ADS1015_I2C_ADDRESS;
-		
-		// Overwrite the address if the type is PULSE
-		if (type == PULSE)
-		{
-			address = ADS1015_PULSE_I2C_ADDRESS;
-		}
-		
-		
-		
-		/* Let's register our i2c slave address in the system */
-		if (ioctl (chip->fd, I2C_SLAVE, address) < 0 )
-		{
-			return 0;
-		}
-		
-		/* Disable the error correction */
-		if (ioctl(chip->fd, I2C_PEC, DISABLE_I2C_PEC) < 0 )
-		{
-			return 0;
-		}	
-		
 		chip->active_channel = 0;	
 		
 #ifdef CONFIGURE_ADC		
 		// Read current register state
-		//int ret = i2c_smbus_read_word_data(chip->fd, (uint8_t)ADS1015_REG_POINTER_CONFIG);
+		//int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG);
 		//printf("config register init value: 0x%X\n", ret);	
 		
 		/*
@@ -236,7 +224,7 @@ int ads1015_init(ads1015_t *chip, adcType type)
 		printf("swapped command value: 0x%X\n", command);	
 		
 		// Write the configuration to the ADC chip (send 0x23C3 for one shot)
-		if ( i2c_smbus_write_word_data(chip->fd, ADS1015_REG_POINTER_CONFIG, command) < 0)
+		if ( backend->writeWord(chip, ADS1015_REG_POINTER_CONFIG, command) < 0)
 		{
 			// error
 			chip->active_channel = -1;
@@ -246,7 +234,7 @@ int ads1015_init(ads1015_t *chip, adcType type)
 		usleep(100000);
 		
 		// read back the config register
-		int ret = i2c_smbus_read_word_data(chip->fd, (uint8_t)ADS1015_REG_POINTER_CONFIG);		
+		int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG);		
 		printf("config register new value: 0x%X\n", ret);		
 		int byte1 = ret & 0x0000FF00;
 		int byte2 = ret & 0x000000FF;	
@@ -310,7 +298,7 @@ int ads1015_changeActiveChannel(ads1015_t *chip, int channel)
 	
 	
 	// Read current register state
-	int ret = i2c_smbus_read_word_data(chip->fd, (uint8_t)ADS1015_REG_POINTER_CONFIG);
+	int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG);
 	if (ret < 0)
 	{
 		return -999;
@@ -329,7 +317,7 @@ int ads1015_changeActiveChannel(ads1015_t *chip, int channel)
 	byteSwap((uint16_t *)&command);
 	
 	// Write the new register contents to the register
-	if ( i2c_smbus_write_word_data(chip->fd, (uint8_t)ADS1015_REG_POINTER_CONFIG, command) < 0)
+	if ( backend->writeWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG, command) < 0)
 	{
 		chip->active_channel = -1;
 		return -100;
@@ -341,7 +329,7 @@ int ads1015_changeActiveChannel(ads1015_t *chip, int channel)
 	}
 	
 	
-	//ret = i2c_smbus_read_word_data(chip->fd, (uint8_t)ADS1015_REG_POINTER_CONFIG);
+	//ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG);
 	//if (ret < 0)
 	//{
 		//return -999;
@@ -353,6 +341,141 @@ int ads1015_changeActiveChannel(ads1015_t *chip, int channel)
 
 
 
+/*
+** ads1015_startConversion
+**
+** Description
+**  Selects the channel and starts a single-shot conversion on it. The
+**  result can be read with ads1015_getDataFromActiveChannel once the
+**  conversion time has elapsed.
+**
+** Input Arguments:
+**   A pointer to ads1015_t object
+**   Channel to convert
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The active channel, negative on error
+**
+** Special Considerations:
+**  Unlike ads1015_changeActiveChannel the OS bit is always set, so a
+**  conversion is started even if the previous one is still running.
+**
+**/
+int ads1015_startConversion(ads1015_t *chip, int channel)
+{
+	if (channel < 0 || channel > 3)
+	{
+		return -1;
+	}
+	
+	// Read current register state
+	int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG);
+	if (ret < 0)
+	{
+		return -999;
+	}	
+	
+	// Swap the bytes
+	uint16_t command = (uint16_t)ret;
+	byteSwap(&command);
+	
+	// Select the channel and set the 'start single-conversion' bit. Force
+	// single-shot mode at the default rate in case the chip was left in
+	// continuous mode, where rewriting the config restarts the conversion
+	command = command & ~(ADS1015_REG_CONFIG_MUX_MASK | ADS1015_REG_CONFIG_OS_MASK | ADS1015_REG_CONFIG_MODE_MASK | ADS1015_REG_CONFIG_DR_MASK);
+	command |= (ADS1015_REG_CONFIG_MUX_SINGLE_0 + (channel << 12)) | ADS1015_REG_CONFIG_OS_SINGLE;
+	command |= ADS1015_REG_CONFIG_MODE_SINGLE | ADS1015_REG_CONFIG_DR_1600SPS;
+	
+	// Swap the bytes again
+	byteSwap(&command);
+	
+	if ( backend->writeWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG, command) < 0)
+	{
+		chip->active_channel = -1;
+		return -100;
+	}
+	
+	chip->active_channel = channel;
+	return chip->active_channel;
+}
+
+
+
+/*
+** ads1015_startContinuous
+**
+** Description
+**  Puts the chip in continuous conversion mode on one channel at
+**  490 samples/sec, with the comparator set up as a conversion ready
+**  signal: the ALERT/RDY pin pulses low at the end of every
+**  conversion.
+**
+** Input Arguments:
+**   A pointer to ads1015_t object
+**   Channel to convert
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The active channel, negative on error
+**
+** Special Considerations:
+**  The ALERT/RDY pin is open drain and needs a pull-up. The results
+**  are read with ads1015_getDataFromActiveChannel.
+**
+**/
+int ads1015_startContinuous(ads1015_t *chip, int channel)
+{
+	if (channel < 0 || channel > 3)
+	{
+		return -1;
+	}
+	
+	// Hi_thresh MSB set and Lo_thresh MSB clear turn the comparator
+	// into a conversion ready output
+	uint16_t hiThresh = 0x8000;
+	uint16_t loThresh = 0x0000;
+	byteSwap(&hiThresh);
+	byteSwap(&loThresh);
+	if ( backend->writeWord(chip, (uint8_t)ADS1015_REG_POINTER_HITHRESH, hiThresh) < 0 ||
+		 backend->writeWord(chip, (uint8_t)ADS1015_REG_POINTER_LOWTHRESH, loThresh) < 0)
+	{
+		return -100;
+	}
+	
+	// Read current register state, the gain is left as it is so the
+	// readings scale the same as in single-shot mode
+	int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG);
+	if (ret < 0)
+	{
+		return -999;
+	}	
+	uint16_t command = (uint16_t)ret;
+	byteSwap(&command);
+	command = command & ADS1015_REG_CONFIG_PGA_MASK;
+	
+	// Assert ALERT/RDY after every conversion, non-latching, active low,
+	// continuous mode at 490 SPS (one sample every ~2 ms)
+	command |= ADS1015_REG_CONFIG_CQUE_1CONV | ADS1015_REG_CONFIG_CLAT_NONLAT | ADS1015_REG_CONFIG_CPOL_ACTVLOW | ADS1015_REG_CONFIG_CMODE_TRAD | ADS1015_REG_CONFIG_MODE_CONTIN;
+	command |= ADS1015_REG_CONFIG_DR_490SPS | (ADS1015_REG_CONFIG_MUX_SINGLE_0 + (channel << 12));
+	
+	byteSwap(&command);
+	if ( backend->writeWord(chip, (uint8_t)ADS1015_REG_POINTER_CONFIG, command) < 0)
+	{
+		chip->active_channel = -1;
+		return -100;
+	}
+	
+	chip->active_channel = channel;
+	return chip->active_channel;
+}
+
+
+
 /*
 ** ads1015_getDataFromChannel
 **
@@ -383,7 +506,7 @@ float ads1015_getDataFromChannel(ads1015_t *chip, int channel)
 	
 	
 	// Read the data from the conversion register	
-	int ret = i2c_smbus_read_word_data (chip->fd, (uint8_t)ADS1015_REG_POINTER_CONVERT);
+	int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONVERT);
 	if (ret < 0 )
 	{
 		return -100;
@@ -434,7 +557,7 @@ float ads1015_getDataFromActiveChannel(ads1015_t *chip)
 {
 
 	// Read the data from the conversion register	
-	int ret = i2c_smbus_read_word_data (chip->fd, (uint8_t)ADS1015_REG_POINTER_CONVERT);
+	int ret = backend->readWord(chip, (uint8_t)ADS1015_REG_POINTER_CONVERT);
 	if (ret < 0 )
 	{
 		return -100;
@@ -515,7 +638,7 @@ void ads1015_close(ads1015_t *chip)
 	/* Make sure we have a valid file descriptor */
 	if ( chip->fd != -1)
 	{
-		close(chip->fd);
+		backend->close(chip);
 	}
 	return;		
 }
@@ -0,0 +1,576 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Alert scheduler. A single task owns the buzzer and plays
+				one alert pattern at a time. Requests of the level that
+				is already sounding or pending are merged into it, a
+				higher level cuts a lower one short, and the pattern
+				edges are timed by a timerfd instead of sleeping.
+ ============================================================================
+ */
+
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "../include/common.h"
+#include "../include/alertScheduler.h"
+#include "../include/flightRecorder.h"
+#include "../include/streamStats.h"
+
+
+/************************ Macros **************************************/
+
+
+
+/**************************** Data Types ******************************/
+
+
+// buzzer on for stepMs[0], off for stepMs[1], on for stepMs[2], ...
+typedef struct {
+
+	int steps;
+	unsigned int stepMs[ALERT_PATTERN_MAX_STEPS];
+
+} alertPatternType;
+
+
+typedef struct {
+
+	unsigned long requests[NUM_ALERT_LEVELS];	// alertScheduler_request calls
+	unsigned long played[NUM_ALERT_LEVELS];		// patterns started
+	unsigned long coalesced;					// requests merged into one sounding or pending
+	unsigned long preempted;					// patterns cut short by a higher level
+
+	// request to buzzer on, in usec
+	uint32_t lastLatencyUs;
+	uint32_t maxLatencyUs;						// since start-up
+	double recentLatencyUs;						// mean of the last ALERT_LATENCY_WINDOW alerts
+	uint32_t recentMaxLatencyUs;				// max of the last ALERT_LATENCY_WINDOW alerts
+
+} alertStatsType;
+
+
+/********************* LOCAL Function Prototypes **********************/
+static void serveRequests(void);
+static void startPattern(alertLevelType level, uint64_t requestNs);
+static void nextStep(void);
+static void armTimer(uint64_t deadlineNs);
+static int reportTimeoutMs(uint64_t reportNs);
+static uint64_t nowNs(void);
+
+/*************************** Globals **********************************/
+
+static const alertPatternType pattern[NUM_ALERT_LEVELS] = {
+	{ 0, { 0 } },
+	{ 1, { 200 } },									// advisory
+	{ 5, { 150, 100, 150, 100, 150 } },				// warning
+	{ 1, { 1000 } }									// critical
+};
+
+static const char *levelName[NUM_ALERT_LEVELS] = {
+	"None",
+	"Advisory",
+	"Warning",
+	"Critical"
+};
+
+static int requestfd = -1;
+static int timerfd = -1;
+
+// requests not served yet, and the statistics; taken by the
+// requesters and the task
+static pthread_mutex_t alertLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long pendingCount[NUM_ALERT_LEVELS];
+static uint64_t pendingNs[NUM_ALERT_LEVELS];	// time of the oldest pending request
+static alertStatsType stats;
+static RingWindow<uint32_t, ALERT_LATENCY_WINDOW> latencyWindow;
+static SlidingMinMax<uint32_t, ALERT_LATENCY_WINDOW> latencyRange;
+
+// pattern sounding, task only
+static alertLevelType playing = ALERT_LEVEL_NONE;
+static int step;
+static uint64_t stepEndNs;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** alertScheduler_init
+**
+** Description
+**  Creates the request eventfd and the pattern timer, and switches
+**  the buzzer off.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Must be called after gpioInitialise() and before the task is
+**  started.
+**
+**/
+int alertScheduler_init(void)
+{
+	requestfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (requestfd < 0 || timerfd < 0)
+	{
+		perror("alertScheduler: eventfd");
+		return 0;
+	}
+
+	gpioSetMode(BUZZER_GPIO_PIN, PI_OUTPUT);
+	gpioWrite(BUZZER_GPIO_PIN, 0);
+
+	return 1;
+}
+
+
+
+/*
+** alertScheduler_task
+**
+** Description
+**  Task that owns the buzzer. Sleeps until a request arrives or the
+**  current pattern step ends.
+**
+** Input Arguments:
+**  arg		string to be printed at task startup
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void *alertScheduler_task(void *arg)
+{
+	struct pollfd fds[2];
+	uint64_t count;
+	uint64_t reportNs = nowNs() + ALERT_REPORT_PERIOD_SEC * 1000000000ULL;
+	unsigned long reported = 0;
+
+	printf("alertScheduler: Task Started %s\n", (char *)arg);
+
+	fds[0].fd = requestfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = timerfd;
+	fds[1].events = POLLIN;
+
+	while (1)
+	{
+		if (poll(fds, 2, reportTimeoutMs(reportNs)) < 0)
+		{
+			if (errno != EINTR)
+			{
+				perror("alertScheduler: poll");
+			}
+			continue;
+		}
+
+		// the step that ended goes first, a request may then preempt
+		// the next one
+		if ((fds[1].revents & POLLIN) && read(timerfd, &count, sizeof(count)) == sizeof(count))
+		{
+			nextStep();
+		}
+
+		if ((fds[0].revents & POLLIN) && read(requestfd, &count, sizeof(count)) == sizeof(count))
+		{
+			serveRequests();
+		}
+
+		// report the periods that had requests
+		if (nowNs() >= reportNs)
+		{
+			unsigned long requests = 0;
+
+			pthread_mutex_lock(&alertLock);
+			for (int level = ALERT_LEVEL_NONE + 1; level < NUM_ALERT_LEVELS; level++)
+			{
+				requests += stats.requests[level];
+			}
+			pthread_mutex_unlock(&alertLock);
+
+			if (requests != reported)
+			{
+				alertScheduler_report();
+				reported = requests;
+			}
+			reportNs += ALERT_REPORT_PERIOD_SEC * 1000000000ULL;
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+** alertScheduler_request
+**
+** Description
+**  Asks for an alert. Never blocks. A request of a level that is
+**  already pending or sounding, or lower than the one sounding, is
+**  merged into it; a higher level preempts the one sounding.
+**
+** Input Arguments:
+**  level		priority of the alert, selects the buzzer pattern
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+void alertScheduler_request(alertLevelType level)
+{
+	uint64_t one = 1;
+
+	if (level <= ALERT_LEVEL_NONE || level >= NUM_ALERT_LEVELS)
+	{
+		return;
+	}
+
+	uint64_t now = nowNs();
+
+	pthread_mutex_lock(&alertLock);
+	stats.requests[level]++;
+	if (pendingCount[level]++ == 0)
+	{
+		pendingNs[level] = now;
+	}
+	pthread_mutex_unlock(&alertLock);
+
+	if (requestfd >= 0 && write(requestfd, &one, sizeof(one)) != sizeof(one))
+	{
+		perror("alertScheduler: request");
+	}
+}
+
+
+
+/*
+** alertScheduler_report
+**
+** Description
+**  Prints the request counters and the request to buzzer on latency.
+**  The task prints it every ALERT_REPORT_PERIOD_SEC that had
+**  requests, call it at exit for the last period.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+void alertScheduler_report(void)
+{
+	alertStatsType st;
+	unsigned long requests = 0;
+	unsigned long played = 0;
+
+	pthread_mutex_lock(&alertLock);
+	st = stats;
+	pthread_mutex_unlock(&alertLock);
+
+	for (int level = ALERT_LEVEL_NONE + 1; level < NUM_ALERT_LEVELS; level++)
+	{
+		requests += st.requests[level];
+		played += st.played[level];
+	}
+
+	fprintf(stderr, "alertScheduler: %lu requests (%s %lu, %s %lu, %s %lu), %lu played, %lu coalesced, %lu preempted\n",
+			requests,
+			levelName[ALERT_LEVEL_ADVISORY], st.requests[ALERT_LEVEL_ADVISORY],
+			levelName[ALERT_LEVEL_WARNING], st.requests[ALERT_LEVEL_WARNING],
+			levelName[ALERT_LEVEL_CRITICAL], st.requests[ALERT_LEVEL_CRITICAL],
+			played, st.coalesced, st.preempted);
+	if (played != 0)
+	{
+		fprintf(stderr, "alertScheduler: request to buzzer on %u us last, %.0f us mean and %u us max of the last %d, %u us max\n",
+				st.lastLatencyUs, st.recentLatencyUs, st.recentMaxLatencyUs,
+				(played < ALERT_LATENCY_WINDOW) ? (int)played : ALERT_LATENCY_WINDOW, st.maxLatencyUs);
+	}
+}
+
+
+
+/*
+** serveRequests
+**
+** Description
+**  Takes the pending requests and starts the pattern of the highest
+**  one, if it is above the level sounding. All the others are merged
+**  into it or into the one sounding.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Task only.
+**
+**/
+static void serveRequests(void)
+{
+	alertLevelType start = ALERT_LEVEL_NONE;
+	uint64_t startNs = 0;
+
+	pthread_mutex_lock(&alertLock);
+	for (int level = NUM_ALERT_LEVELS - 1; level > ALERT_LEVEL_NONE; level--)
+	{
+		if (pendingCount[level] == 0)
+		{
+			continue;
+		}
+
+		if (start == ALERT_LEVEL_NONE && level > playing)
+		{
+			start = (alertLevelType)level;
+			startNs = pendingNs[level];
+			stats.coalesced += pendingCount[level] - 1;
+		}
+		else
+		{
+			stats.coalesced += pendingCount[level];
+		}
+		pendingCount[level] = 0;
+	}
+	pthread_mutex_unlock(&alertLock);
+
+	if (start != ALERT_LEVEL_NONE)
+	{
+		startPattern(start, startNs);
+	}
+}
+
+
+
+/*
+** startPattern
+**
+** Description
+**  Switches the buzzer on for the first step of a pattern, cutting
+**  short the one sounding, and records the latency of the request.
+**
+** Input Arguments:
+**  level		alert level to play
+**  requestNs	time of the oldest request served by it
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Task only.
+**
+**/
+static void startPattern(alertLevelType level, uint64_t requestNs)
+{
+	alertLevelType cut = playing;
+
+	gpioWrite(BUZZER_GPIO_PIN, 1);		// Set gpio high
+	uint64_t onNs = nowNs();
+	uint32_t latencyUs = (uint32_t)((onNs - requestNs) / 1000);
+
+	playing = level;
+	step = 0;
+	stepEndNs = onNs + pattern[level].stepMs[0] * 1000000ULL;
+	armTimer(stepEndNs);
+
+	flightRecorder_buzzer(1, level, latencyUs);
+
+	pthread_mutex_lock(&alertLock);
+	if (cut != ALERT_LEVEL_NONE)
+	{
+		stats.preempted++;
+	}
+	stats.played[level]++;
+	stats.lastLatencyUs = latencyUs;
+	if (latencyUs > stats.maxLatencyUs)
+	{
+		stats.maxLatencyUs = latencyUs;
+	}
+	latencyWindow.push(latencyUs);
+	latencyRange.push(latencyUs);
+	stats.recentLatencyUs = latencyWindow.mean();
+	stats.recentMaxLatencyUs = latencyRange.max();
+	pthread_mutex_unlock(&alertLock);
+
+	fprintf(stderr, "alertScheduler: %s alert, buzzer on %u us after the request%s\n",
+			levelName[level], latencyUs, (cut != ALERT_LEVEL_NONE) ? ", preempting" : "");
+}
+
+
+
+/*
+** nextStep
+**
+** Description
+**  Moves the pattern sounding to its next step, switching the buzzer
+**  off at the end of the pattern.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Task only.
+**
+**/
+static void nextStep(void)
+{
+	if (playing == ALERT_LEVEL_NONE)
+	{
+		return;
+	}
+
+	const alertPatternType *p = &pattern[playing];
+
+	if (++step >= p->steps)
+	{
+		gpioWrite(BUZZER_GPIO_PIN, 0);		// Set gpio low
+		flightRecorder_buzzer(0, playing, 0);
+		playing = ALERT_LEVEL_NONE;
+		return;
+	}
+
+	// even steps sound, odd steps are the gaps
+	gpioWrite(BUZZER_GPIO_PIN, (step % 2 == 0) ? 1 : 0);
+
+	// from the planned edge, so the steps do not drift
+	stepEndNs += p->stepMs[step] * 1000000ULL;
+	armTimer(stepEndNs);
+}
+
+
+
+/*
+** armTimer
+**
+** Description
+**  Arms the pattern timer to expire at the given time.
+**
+** Input Arguments:
+**  deadlineNs	absolute CLOCK_MONOTONIC time
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void armTimer(uint64_t deadlineNs)
+{
+	struct itimerspec its;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = deadlineNs / 1000000000ULL;
+	its.it_value.tv_nsec = deadlineNs % 1000000000ULL;
+
+	timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+
+/*
+** reportTimeoutMs
+**
+** Description
+**  Time left until the next statistics report, as a poll() timeout.
+**
+** Input Arguments:
+**  reportNs	CLOCK_MONOTONIC time of the next report
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Timeout in msec, 0 if the report is due
+**
+** Special Considerations:
+**  None
+**
+**/
+static int reportTimeoutMs(uint64_t reportNs)
+{
+	uint64_t now = nowNs();
+
+	return (now >= reportNs) ? 0 : (int)((reportNs - now + 999999) / 1000000);
+}
+
+
+
+/*
+** nowNs
+**
+** Description
+**  Reads the monotonic clock.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
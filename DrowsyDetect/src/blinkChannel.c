@@ -0,0 +1,448 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Blink event channel between the blink detector and the
+				sensor fusion. A single-producer/single-consumer ring of
+				timestamped event records in shared memory, with a futex
+				to wake up the consumer.
+ ============================================================================
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "../include/blinkChannel.h"
+
+
+
+/***************************** Macros *********************************/
+
+#define BLINK_CHANNEL_MAGIC			0x424C4E4B		// "BLNK"
+#define BLINK_CHANNEL_VERSION		2
+#define SLOT_WRITING				0xFFFFFFFFu		// slot seq while being rewritten
+
+
+/**************************** Data Types ******************************/
+
+
+struct blinkChannelShm {
+
+	uint32_t magic;
+	uint32_t version;
+	uint32_t head;				// events published so far, futex word
+	uint32_t waiters;			// consumers sleeping on head
+	blinkEventType event[BLINK_CHANNEL_SLOTS];
+
+};
+
+
+/******************** Local Function Prototypes *******************/
+static long futex(uint32_t *word, int op, uint32_t val, const struct timespec *timeout);
+
+
+/*************************** Globals **********************************/
+
+// process-local channel, see blinkChannel_setLocal()
+static blinkChannelShmType localChannel;
+static blinkChannelNotifyFunc localNotify = NULL;
+static int local = 0;
+
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** blinkChannel_setLocal
+**
+** Description
+**  Makes the channel process-local, for builds that host the blink
+**  detector and the sensor fusion in one process. The channels
+**  opened afterwards share a ring in ordinary memory instead of the
+**  shared memory object, and every publish calls notify directly.
+**
+** Input Arguments:
+**  notify		called after every publish, on the publishing thread
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Call before any channel is opened. notify must not block.
+**
+**/
+void blinkChannel_setLocal(blinkChannelNotifyFunc notify)
+{
+	localNotify = notify;
+	local = 1;
+}
+
+
+
+/*
+** blinkChannel_isLocal
+**
+** Description
+**  Tells whether blinkChannel_setLocal was called.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the channel is process-local, 0 if it is shared memory.
+**
+** Special Considerations:
+**  None
+**
+**/
+int blinkChannel_isLocal(void)
+{
+	return local;
+}
+
+
+
+/*
+** blinkChannel_open
+**
+** Description
+**  Maps the shared memory channel, creating it if it does not exist
+**  yet. Either side may open first, there is no rendezvous.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  A consumer only sees the events published after it opened.
+**
+**/
+int blinkChannel_open(blinkChannel_t *ch)
+{
+	struct stat st;
+
+	ch->shm = NULL;
+	ch->readSeq = 0;
+	ch->lost = 0;
+
+	if (local)
+	{
+		// zero filled like a fresh shared memory object, the layout
+		// needs no stamp inside one binary
+		ch->shm = &localChannel;
+		ch->readSeq = __atomic_load_n(&ch->shm->head, __ATOMIC_ACQUIRE);
+		return 1;
+	}
+
+	int fd = shm_open(BLINK_CHANNEL_NAME, O_RDWR | O_CREAT, 0666);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	// a freshly created (zero filled) object is a valid, empty channel
+	if (fstat(fd, &st) < 0 ||
+		(st.st_size < (off_t)sizeof(blinkChannelShmType) && ftruncate(fd, sizeof(blinkChannelShmType)) < 0))
+	{
+		close(fd);
+		return 0;
+	}
+
+	void *mem = mmap(NULL, sizeof(blinkChannelShmType), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		return 0;
+	}
+	ch->shm = (blinkChannelShmType *)mem;
+
+	// stamp the layout, or check the one stamped by the other side
+	uint32_t magic = 0;
+	if (!__atomic_compare_exchange_n(&ch->shm->magic, &magic, BLINK_CHANNEL_MAGIC, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+	{
+		if (magic != BLINK_CHANNEL_MAGIC)
+		{
+			fprintf(stderr, "blinkChannel: bad magic 0x%X\n", magic);
+			blinkChannel_close(ch);
+			return 0;
+		}
+	}
+	else
+	{
+		ch->shm->version = BLINK_CHANNEL_VERSION;
+	}
+
+	// left behind by a build with another event layout (0 is the
+	// other side still stamping it)
+	uint32_t version = __atomic_load_n(&ch->shm->version, __ATOMIC_ACQUIRE);
+	if (version != 0 && version != BLINK_CHANNEL_VERSION)
+	{
+		fprintf(stderr, "blinkChannel: version %u, expected %u, remove /dev/shm%s\n",
+				version, BLINK_CHANNEL_VERSION, BLINK_CHANNEL_NAME);
+		blinkChannel_close(ch);
+		return 0;
+	}
+
+	ch->readSeq = __atomic_load_n(&ch->shm->head, __ATOMIC_ACQUIRE);
+
+	return 1;
+}
+
+
+
+/*
+** blinkChannel_publish
+**
+** Description
+**  Appends an event to the channel and wakes up a waiting consumer.
+**  Never blocks: if the consumer is a full ring behind, its oldest
+**  unread event is overwritten.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**  event		event to publish, the seq field is filled in
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Single producer.
+**
+**/
+void blinkChannel_publish(blinkChannel_t *ch, blinkEventType *event)
+{
+	if (ch->shm == NULL)
+	{
+		return;
+	}
+
+	blinkChannelShmType *shm = ch->shm;
+	uint32_t n = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+	blinkEventType *slot = &shm->event[n & (BLINK_CHANNEL_SLOTS - 1)];
+
+	// per-slot seqlock: a reader that races with this write sees the
+	// slot sequence change and discards its copy
+	__atomic_store_n(&slot->seq, SLOT_WRITING, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	event->seq = n;
+	slot->kind = event->kind;
+	slot->captureNs = event->captureNs;
+	slot->blinkCount = event->blinkCount;
+	slot->eyeOpenClassifier = event->eyeOpenClassifier;
+	slot->eyeOpenHybrid = event->eyeOpenHybrid;
+	slot->samples = (event->samples < BLINK_EYE_BATCH) ? event->samples : BLINK_EYE_BATCH;
+	memcpy(slot->sample, event->sample, slot->samples * sizeof(blinkEyeSampleType));
+
+	__atomic_store_n(&slot->seq, n, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->head, n + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&shm->waiters, __ATOMIC_SEQ_CST) != 0)
+	{
+		futex(&shm->head, FUTEX_WAKE, INT_MAX, NULL);
+	}
+
+	if (localNotify != NULL)
+	{
+		localNotify();
+	}
+}
+
+
+
+/*
+** blinkChannel_poll
+**
+** Description
+**  Reads the next unread event, if any.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**
+** Output Arguments:
+**  event		the event read
+**
+** Function Return:
+**  1 if an event was read, 0 if the channel is empty.
+**
+** Special Considerations:
+**  Single consumer.
+**
+**/
+int blinkChannel_poll(blinkChannel_t *ch, blinkEventType *event)
+{
+	if (ch->shm == NULL)
+	{
+		return 0;
+	}
+
+	blinkChannelShmType *shm = ch->shm;
+
+	while (1)
+	{
+		uint32_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+
+		if (head == ch->readSeq)
+		{
+			return 0;
+		}
+
+		// fell a full ring behind -- skip to the oldest event still there
+		if (head - ch->readSeq > BLINK_CHANNEL_SLOTS)
+		{
+			ch->lost += head - ch->readSeq - BLINK_CHANNEL_SLOTS;
+			ch->readSeq = head - BLINK_CHANNEL_SLOTS;
+		}
+
+		blinkEventType *slot = &shm->event[ch->readSeq & (BLINK_CHANNEL_SLOTS - 1)];
+		uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		memcpy(event, slot, sizeof(blinkEventType));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+		if (before == ch->readSeq && after == ch->readSeq)
+		{
+			event->seq = ch->readSeq++;
+			return 1;
+		}
+
+		// overwritten while we were reading it
+		ch->lost++;
+		ch->readSeq++;
+	}
+}
+
+
+
+/*
+** blinkChannel_wait
+**
+** Description
+**  Sleeps until an unread event is available or the timeout expires.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**  timeoutMs	maximum time to wait, -1 to wait forever
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if an unread event is available, 0 on timeout.
+**
+** Special Considerations:
+**  Single consumer.
+**
+**/
+int blinkChannel_wait(blinkChannel_t *ch, int timeoutMs)
+{
+	if (ch->shm == NULL)
+	{
+		return 0;
+	}
+
+	blinkChannelShmType *shm = ch->shm;
+	struct timespec ts;
+	ts.tv_sec = timeoutMs / 1000;
+	ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+
+	__atomic_add_fetch(&shm->waiters, 1, __ATOMIC_SEQ_CST);
+
+	uint32_t head = __atomic_load_n(&shm->head, __ATOMIC_SEQ_CST);
+	if (head == ch->readSeq)
+	{
+		// sleeps only while head still holds the value we saw
+		futex(&shm->head, FUTEX_WAIT, head, (timeoutMs < 0) ? NULL : &ts);
+	}
+
+	__atomic_sub_fetch(&shm->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return (__atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) != ch->readSeq);
+}
+
+
+
+/*
+** blinkChannel_close
+**
+** Description
+**  Unmaps the channel. The shared memory object is left in place for
+**  the other side.
+**
+** Input Arguments:
+**  ch			pointer to blinkChannel_t object
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void blinkChannel_close(blinkChannel_t *ch)
+{
+	if (ch->shm != NULL && ch->shm != &localChannel)
+	{
+		munmap(ch->shm, sizeof(blinkChannelShmType));
+	}
+	ch->shm = NULL;
+}
+
+
+
+/*
+** futex
+**
+** Description
+**  Thin wrapper around the futex system call. The channel lives in
+**  memory shared between processes so the non-private operations are
+**  used.
+**
+** Input Arguments:
+**  word		futex word
+**  op			FUTEX_WAIT or FUTEX_WAKE
+**  val			expected value (wait) or number of waiters to wake (wake)
+**  timeout		relative timeout for FUTEX_WAIT, NULL for none
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  System call return value
+**
+** Special Considerations:
+**  None
+**
+**/
+static long futex(uint32_t *word, int op, uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
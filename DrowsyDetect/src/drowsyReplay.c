@@ -0,0 +1,437 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Offline replay of recorded drives. Feeds the sensor values
+				and blinks of flight recorder logs through the sensor
+				fusion on a virtual clock, as fast as the logs can be
+				read, and prints every alert. Thresholds can be
+				overridden on the command line to tune them over a corpus
+				of drives.
+ ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/flightRecorder.h"
+#include "../include/sensorFusion.h"
+#include "../include/sensorEvents.h"
+
+/************************ Macros **************************************/
+
+#define DRIVE_GAP_MS			5000		// a log starting this long after the previous one is a new drive
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct {
+
+	sensorFusion_t fusion;
+	uint64_t clockMs;			// virtual clock
+	uint64_t deadline;			// next time the fusion must step, 0 if none
+	uint64_t baseNs;			// start of the drive, time origin of the printed alerts
+	uint64_t drivenMs;			// length of the drives before this one
+	int quiet;
+
+	unsigned long alerts[NUM_FUSION_DECISIONS];
+	unsigned long recordedAlerts;
+	unsigned long buzzerAlerts;	// alert patterns started live
+	double buzzerLatencySumUs;
+	uint32_t buzzerLatencyMaxUs;
+	unsigned long records;
+	unsigned long badRecords;
+	unsigned long droppedRecords;
+	int drives;
+
+} replayType;
+
+
+/********************* LOCAL Function Prototypes **********************/
+static void usage(const char *prog);
+static int replayLog(replayType *r, const sensorFusionConfigType *cfg, const char *path);
+static void advanceClock(replayType *r, uint64_t nowMs);
+static void printAlert(fusionDecisionType decision, uint64_t now, const sensorFusionInputsType *in, void *userdata);
+static double wallSeconds(void);
+
+/*************************** Globals **********************************/
+
+
+
+/*********************** Function Definitions *************************/
+
+
+
+
+
+// Main function, defines the entry point for the program.
+int main( int argc, char** argv )
+{
+	sensorFusionConfigType cfg;
+	static replayType replay;
+	int printConfig = 0;
+
+	sensorFusion_defaultConfig(&cfg);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "t:R:pqh")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				if (!sensorFusion_setParameter(&cfg, optarg))
+				{
+					fprintf(stderr, "drowsyReplay: unknown parameter or bad value %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'R':
+				if (!sensorFusion_loadRules(&cfg, optarg))
+				{
+					return 1;
+				}
+				break;
+			case 'p':
+				printConfig = 1;
+				break;
+			case 'q':
+				replay.quiet = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (printConfig)
+	{
+		sensorFusion_printParameters(&cfg, stdout);
+		printf("# fused rules, first match wins\n");
+		sensorFusion_printRules(&cfg, stdout);
+		return 0;
+	}
+
+	if (optind >= argc)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+
+	double start = wallSeconds();
+
+	for (int i = optind; i < argc; i++)
+	{
+		if (!replayLog(&replay, &cfg, argv[i]))
+		{
+			fprintf(stderr, "drowsyReplay: %s is not a flight recorder log\n", argv[i]);
+			return 1;
+		}
+	}
+
+	double elapsed = wallSeconds() - start;
+	double driven = (replay.drivenMs + replay.clockMs - replay.baseNs / 1000000ULL) / 1000.0;
+
+
+	// summary
+	unsigned long total = 0;
+	printf("alerts:");
+	for (int d = 1; d < NUM_FUSION_DECISIONS; d++)
+	{
+		if (replay.alerts[d] != 0)
+		{
+			printf(" %s %lu,", sensorFusion_decisionName((fusionDecisionType)d), replay.alerts[d]);
+		}
+		total += replay.alerts[d];
+	}
+	printf(" total %lu (recorded live: %lu)\n", total, replay.recordedAlerts);
+	if (replay.buzzerAlerts != 0)
+	{
+		printf("buzzer: %lu alert patterns, request to buzzer on %.2f ms mean, %.2f ms max (recorded live)\n",
+				replay.buzzerAlerts, replay.buzzerLatencySumUs / replay.buzzerAlerts / 1000.0,
+				replay.buzzerLatencyMaxUs / 1000.0);
+	}
+	printf("replayed %d drive(s), %lu records (%lu bad, %lu dropped by the recorder), "
+			"%.1f s of driving in %.3f s\n",
+			replay.drives, replay.records, replay.badRecords, replay.droppedRecords, driven, elapsed);
+
+	return 0;
+}
+
+
+
+
+/*
+** replayLog
+**
+** Description
+**  Replays one log. A log that starts before the virtual clock (the
+**  monotonic clock restarted) or well after it is a new drive and
+**  resets the fusion; otherwise it continues the previous log, like
+**  the rotated logs of one drive do.
+**
+** Input Arguments:
+**  r			replay state
+**  cfg			fusion configuration
+**  path		log file
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if the log cannot be read.
+**
+** Special Considerations:
+**  Give the logs of a drive oldest first (path.3 path.2 path.1 path).
+**
+**/
+static int replayLog(replayType *r, const sensorFusionConfigType *cfg, const char *path)
+{
+	flightLogHeaderType header;
+	flightRecordType rec;
+	int ret;
+
+	FILE *f = flightRecorder_openLog(path, &header);
+	if (f == NULL)
+	{
+		return 0;
+	}
+
+	uint64_t logStartMs = header.monotonicNs / 1000000ULL;
+	if (r->drives == 0 || logStartMs < r->clockMs || logStartMs > r->clockMs + DRIVE_GAP_MS)
+	{
+		if (r->drives != 0)
+		{
+			r->drivenMs += r->clockMs - r->baseNs / 1000000ULL;
+		}
+
+		sensorFusion_init(&r->fusion, cfg, printAlert, r);
+		r->clockMs = logStartMs;
+		r->deadline = 0;
+		r->baseNs = header.monotonicNs;
+		r->drives++;
+
+		if (!r->quiet)
+		{
+			time_t wall = (time_t)(header.realtimeNs / 1000000000ULL);
+			printf("--- drive %d, recorded %s", r->drives, ctime(&wall));
+		}
+	}
+
+	while ((ret = flightRecorder_readLog(f, &rec)) != 0)
+	{
+		if (ret < 0)
+		{
+			r->badRecords++;
+			continue;
+		}
+		r->records++;
+
+		switch (rec.kind)
+		{
+			case REC_SENSOR:
+				advanceClock(r, rec.stampNs / 1000000ULL);
+				if (rec.source == SENSOR_EVENT_PROXIMITY)
+				{
+					sensorFusion_proximity(&r->fusion, rec.sensor.value, rec.sensor.delta);
+				}
+				else if (rec.source == SENSOR_EVENT_PRESSURE)
+				{
+					sensorFusion_pressure(&r->fusion, rec.sensor.value, rec.sensor.delta);
+				}
+				else if (rec.source == SENSOR_EVENT_PULSE)
+				{
+					sensorFusion_pulse(&r->fusion, rec.sensor.value);
+				}
+				r->deadline = sensorFusion_step(&r->fusion, r->clockMs);
+				break;
+
+			case REC_BLINK:
+				// stamped with the capture time, which can be a frame
+				// older than the sensor record before it
+				advanceClock(r, rec.stampNs / 1000000ULL);
+				sensorFusion_blink(&r->fusion, rec.stampNs);
+				r->deadline = sensorFusion_step(&r->fusion, r->clockMs);
+				break;
+
+			case REC_EYE:
+				advanceClock(r, rec.stampNs / 1000000ULL);
+				sensorFusion_eyeOpen(&r->fusion, rec.stampNs, rec.eye.eyeOpen);
+				r->deadline = sensorFusion_step(&r->fusion, r->clockMs);
+				break;
+
+			case REC_FUSION:
+				r->recordedAlerts++;
+				break;
+
+			case REC_BUZZER:
+				// logs from before the alert scheduler have no level
+				if (rec.source == 1 && rec.buzzer.level != 0)
+				{
+					r->buzzerAlerts++;
+					r->buzzerLatencySumUs += rec.buzzer.latencyUs;
+					if (rec.buzzer.latencyUs > r->buzzerLatencyMaxUs)
+					{
+						r->buzzerLatencyMaxUs = rec.buzzer.latencyUs;
+					}
+				}
+				break;
+
+			case REC_DROPPED:
+				r->droppedRecords += rec.dropped.count;
+				break;
+
+			default:
+				// raw ADC samples are not fusion inputs
+				break;
+		}
+	}
+
+	fclose(f);
+	return 1;
+}
+
+
+
+/*
+** advanceClock
+**
+** Description
+**  Moves the virtual clock forward to the time of the next record,
+**  stepping the fusion at every deadline it passes on the way, the
+**  same as the deadline timer wakes the live fusion.
+**
+** Input Arguments:
+**  r			replay state
+**  nowMs		time of the next record
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  The clock never goes backwards.
+**
+**/
+static void advanceClock(replayType *r, uint64_t nowMs)
+{
+	while (r->deadline != 0 && r->deadline <= nowMs)
+	{
+		if (r->deadline > r->clockMs)
+		{
+			r->clockMs = r->deadline;
+		}
+		r->deadline = sensorFusion_step(&r->fusion, r->clockMs);
+	}
+
+	if (nowMs > r->clockMs)
+	{
+		r->clockMs = nowMs;
+	}
+}
+
+
+
+/*
+** printAlert
+**
+** Description
+**  Alert sink of the replayed fusion: counts and prints the alert.
+**
+** Input Arguments:
+**  decision	rule that fired
+**  now			virtual time of the alert in msec
+**  in			sensor values the decision was based on
+**  userdata	replay state
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void printAlert(fusionDecisionType decision, uint64_t now, const sensorFusionInputsType *in, void *userdata)
+{
+	replayType *r = (replayType *)userdata;
+
+	r->alerts[decision]++;
+
+	if (!r->quiet)
+	{
+		printf("%10.3f s  %-14s blink %5d ms  prox %3d  press %3d  IBI %4d ms\n",
+				(now * 1000000.0 - r->baseNs) / 1e9, sensorFusion_decisionName(decision),
+				in->blinkDelta, in->proximity, in->pressure, in->pulseIBI);
+	}
+}
+
+
+
+/*
+** wallSeconds
+**
+** Description
+**  Reads the monotonic clock.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Time in seconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static double wallSeconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+
+/*
+** usage
+**
+** Description
+**  Prints the command line options.
+**
+** Input Arguments:
+**  prog		name of the executable
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t name=value]... [-R rules] [-q] log...\n", prog);
+	fprintf(stderr, "       %s [-t name=value]... [-R rules] -p\n", prog);
+	fprintf(stderr, "  -t n=v      override a sensor fusion threshold\n");
+	fprintf(stderr, "  -R rules    fused rules file, replaces the built-in rules\n");
+	fprintf(stderr, "  -p          print the sensor fusion thresholds and rules and exit\n");
+	fprintf(stderr, "  -q          print only the summary, not every alert\n");
+	fprintf(stderr, "  log         flight recorder logs, the logs of a drive oldest first\n");
+}
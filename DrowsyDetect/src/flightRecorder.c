@@ -0,0 +1,861 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Always-on flight recorder. The sensor, blink, fusion and
+				buzzer tasks append compact binary records to a lock-free
+				ring; a background thread drains the ring to a rotating
+				log of length-prefixed, CRC protected records.
+ ============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../include/flightRecorder.h"
+
+
+
+/***************************** Macros *********************************/
+
+#define RECORDER_PATH_MAX			256
+#define RECORD_MAX_BYTES			256			// longest record a reader accepts
+
+
+/**************************** Data Types ******************************/
+
+
+// ring cell: seq tells producers and the consumer whose turn it is
+typedef struct {
+
+	uint32_t seq;
+	flightRecordType rec;
+
+} recorderCellType;
+
+
+/******************** Local Function Prototypes *******************/
+static void *flightRecorder_writer(void *arg);
+static int drain(void);
+static int writeRecord(const flightRecordType *rec);
+static int openLog(void);
+static void rotateLogs(void);
+static uint64_t nowNs(clockid_t clock);
+
+
+/*************************** Globals **********************************/
+
+// bounded multi-producer/single-consumer ring (D. Vyukov's algorithm)
+static recorderCellType ring[FLIGHT_RECORDER_SLOTS];
+static uint32_t enqueuePos;
+static uint32_t dequeuePos;				// writer thread only
+static uint32_t droppedRecords;
+
+static int enabled = 0;
+static volatile int running = 0;
+static pthread_t writerThread;
+
+static char logPath[RECORDER_PATH_MAX];
+static FILE *logFile = NULL;
+static long logBytes = 0;
+
+static uint32_t crcTable[256];
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** flightRecorder_init
+**
+** Description
+**  Rotates the logs of the previous run, opens a new log and starts
+**  the writer thread.
+**
+** Input Arguments:
+**  path		log file, the rotated logs are path.1, path.2, ...
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Until this succeeds the record functions do nothing.
+**
+**/
+int flightRecorder_init(const char *path)
+{
+	for (uint32_t i = 0; i < FLIGHT_RECORDER_SLOTS; i++)
+	{
+		ring[i].seq = i;
+	}
+	enqueuePos = 0;
+	dequeuePos = 0;
+	droppedRecords = 0;
+
+	snprintf(logPath, sizeof(logPath), "%s", path);
+	rotateLogs();
+	if (!openLog())
+	{
+		return 0;
+	}
+
+	running = 1;
+	if (pthread_create(&writerThread, NULL, flightRecorder_writer, NULL) != 0)
+	{
+		running = 0;
+		fclose(logFile);
+		logFile = NULL;
+		return 0;
+	}
+
+	__atomic_store_n(&enabled, 1, __ATOMIC_RELEASE);
+	fprintf(stderr, "flightRecorder: recording to %s\n", logPath);
+
+	return 1;
+}
+
+
+
+/*
+** flightRecorder_record
+**
+** Description
+**  Appends a record to the ring. Wait-free for a single caller,
+**  lock-free with many: never sleeps and never touches the disk.
+**
+** Input Arguments:
+**  rec			record to append
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the record was queued, 0 if it was dropped.
+**
+** Special Considerations:
+**  Safe to call from any thread.
+**
+**/
+int flightRecorder_record(const flightRecordType *rec)
+{
+	if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE))
+	{
+		return 0;
+	}
+
+	uint32_t pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+	recorderCellType *cell;
+
+	while (1)
+	{
+		cell = &ring[pos & (FLIGHT_RECORDER_SLOTS - 1)];
+		uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		int32_t dif = (int32_t)(seq - pos);
+
+		if (dif == 0)
+		{
+			// the cell is free, claim it
+			if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (dif < 0)
+		{
+			// full: the writer has not caught up with the cell yet
+			__atomic_add_fetch(&droppedRecords, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		else
+		{
+			// another producer claimed it first
+			pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->rec = *rec;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+
+/*
+** flightRecorder_adcSample
+**
+** Description
+**  Records an ADC sample.
+**
+** Input Arguments:
+**  channel		adcChannelType
+**  seq			sample sequence number of the channel
+**  voltage		sample value in V
+**  stampNs		end of the conversion
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void flightRecorder_adcSample(int channel, uint32_t seq, float voltage, uint64_t stampNs)
+{
+	flightRecordType rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = REC_ADC_SAMPLE;
+	rec.source = (uint16_t)channel;
+	rec.stampNs = stampNs;
+	rec.adc.seq = seq;
+	rec.adc.voltage = voltage;
+
+	flightRecorder_record(&rec);
+}
+
+
+
+/*
+** flightRecorder_sensor
+**
+** Description
+**  Records a value a sensor task published to the fusion.
+**
+** Input Arguments:
+**  source		sensorEventSourceType
+**  value		published value (scaled reading, or the IBI in ms)
+**  delta		change since the previous reading, 0 if not used
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void flightRecorder_sensor(int source, int value, int delta)
+{
+	flightRecordType rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = REC_SENSOR;
+	rec.source = (uint16_t)source;
+	rec.stampNs = nowNs(CLOCK_MONOTONIC);
+	rec.sensor.value = value;
+	rec.sensor.delta = delta;
+
+	flightRecorder_record(&rec);
+}
+
+
+
+/*
+** flightRecorder_blink
+**
+** Description
+**  Records a blink event.
+**
+** Input Arguments:
+**  blinkCount			blinks since the detector started
+**  eyeOpenClassifier	eye-open score of the eye classifier
+**  eyeOpenHybrid		eye-open score of the hybrid detector
+**  captureNs			capture time of the frame
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void flightRecorder_blink(uint32_t blinkCount, float eyeOpenClassifier, float eyeOpenHybrid, uint64_t captureNs)
+{
+	flightRecordType rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = REC_BLINK;
+	rec.stampNs = captureNs;
+	rec.blink.blinkCount = blinkCount;
+	rec.blink.eyeOpenClassifier = eyeOpenClassifier;
+	rec.blink.eyeOpenHybrid = eyeOpenHybrid;
+
+	flightRecorder_record(&rec);
+}
+
+
+
+/*
+** flightRecorder_eye
+**
+** Description
+**  Records the eye openness of one frame.
+**
+** Input Arguments:
+**  eyeOpen				0 (closed) to 1 (open), negative if the eye was not seen
+**  captureNs			capture time of the frame
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void flightRecorder_eye(float eyeOpen, uint64_t captureNs)
+{
+	flightRecordType rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = REC_EYE;
+	rec.stampNs = captureNs;
+	rec.eye.eyeOpen = eyeOpen;
+
+	flightRecorder_record(&rec);
+}
+
+
+
+/*
+** flightRecorder_fusion
+**
+** Description
+**  Records an alert raised by the sensor fusion, with the inputs it
+**  was based on.
+**
+** Input Arguments:
+**  decision	rule that fired
+**  blinkDelta	last blink interval in ms
+**  proximity	scaled proximity reading
+**  pressure	scaled pressure reading
+**  pulseIBI	last inter-beat interval in ms
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void flightRecorder_fusion(fusionDecisionType decision, int blinkDelta, int proximity, int pressure, int pulseIBI)
+{
+	flightRecordType rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = REC_FUSION;
+	rec.source = (uint16_t)decision;
+	rec.stampNs = nowNs(CLOCK_MONOTONIC);
+	rec.fusion.blinkDelta = blinkDelta;
+	rec.fusion.proximity = proximity;
+	rec.fusion.pressure = pressure;
+	rec.fusion.pulseIBI = pulseIBI;
+
+	flightRecorder_record(&rec);
+}
+
+
+
+/*
+** flightRecorder_buzzer
+**
+** Description
+**  Records an alert pattern starting or ending on the buzzer.
+**
+** Input Arguments:
+**  on			1 if the pattern started, 0 if it ended
+**  level		alertLevelType of the pattern
+**  latencyUs	time from the alert request to the buzzer on, 0 when
+**				it ended
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void flightRecorder_buzzer(int on, int level, uint32_t latencyUs)
+{
+	flightRecordType rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.kind = REC_BUZZER;
+	rec.source = (uint16_t)(on != 0);
+	rec.stampNs = nowNs(CLOCK_MONOTONIC);
+	rec.buzzer.level = level;
+	rec.buzzer.latencyUs = latencyUs;
+
+	flightRecorder_record(&rec);
+}
+
+
+
+/*
+** flightRecorder_close
+**
+** Description
+**  Stops the writer thread after it drained the ring, and closes the
+**  log.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Records appended after this are dropped.
+**
+**/
+void flightRecorder_close(void)
+{
+	if (!__atomic_exchange_n(&enabled, 0, __ATOMIC_ACQ_REL))
+	{
+		return;
+	}
+
+	running = 0;
+	pthread_join(writerThread, NULL);
+
+	if (logFile != NULL)
+	{
+		fclose(logFile);
+		logFile = NULL;
+	}
+}
+
+
+
+/*
+** flightRecorder_openLog
+**
+** Description
+**  Opens a log for reading and checks its header.
+**
+** Input Arguments:
+**  path		log file
+**
+** Output Arguments:
+**  header		header of the log
+**
+** Function Return:
+**  The open log, NULL if it cannot be opened or is not a log.
+**
+** Special Considerations:
+**  Close with fclose.
+**
+**/
+FILE *flightRecorder_openLog(const char *path, flightLogHeaderType *header)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		return NULL;
+	}
+
+	if (fread(header, sizeof(*header), 1, f) != 1 ||
+		header->magic != FLIGHT_RECORDER_MAGIC ||
+		header->version != FLIGHT_RECORDER_VERSION)
+	{
+		fclose(f);
+		return NULL;
+	}
+
+	return f;
+}
+
+
+
+/*
+** flightRecorder_readLog
+**
+** Description
+**  Reads the next record of a log.
+**
+** Input Arguments:
+**  f			log opened with flightRecorder_openLog
+**
+** Output Arguments:
+**  rec			the record read
+**
+** Function Return:
+**  1 if a record was read, 0 at the end of the log, -1 if the record
+**  failed its CRC check (rec is not valid, reading can go on).
+**
+** Special Considerations:
+**  A torn record at the end of the log counts as the end. Records
+**  longer than flightRecordType (from a newer writer) are truncated,
+**  shorter ones are zero filled.
+**
+**/
+int flightRecorder_readLog(FILE *f, flightRecordType *rec)
+{
+	uint8_t buf[RECORD_MAX_BYTES];
+	uint32_t length;
+	uint32_t crc;
+
+	if (fread(&length, sizeof(length), 1, f) != 1 ||
+		length > RECORD_MAX_BYTES ||
+		fread(buf, length, 1, f) != 1 ||
+		fread(&crc, sizeof(crc), 1, f) != 1)
+	{
+		return 0;
+	}
+
+	if (crc != flightRecorder_crc32(buf, length))
+	{
+		return -1;
+	}
+
+	memset(rec, 0, sizeof(*rec));
+	memcpy(rec, buf, (length < sizeof(*rec)) ? length : sizeof(*rec));
+
+	return 1;
+}
+
+
+
+/*
+** flightRecorder_crc32
+**
+** Description
+**  CRC-32 (IEEE 802.3) of a buffer, as stored after every record.
+**
+** Input Arguments:
+**  data		buffer
+**  length		buffer length in bytes
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The CRC
+**
+** Special Considerations:
+**  The table is built on first use, by the writer thread in the
+**  application.
+**
+**/
+uint32_t flightRecorder_crc32(const void *data, uint32_t length)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t crc = 0xFFFFFFFFu;
+
+	// reflected CRC-32 table
+	if (crcTable[1] == 0)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+			}
+			crcTable[i] = c;
+		}
+	}
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		crc = crcTable[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc ^ 0xFFFFFFFFu;
+}
+
+
+
+/*
+** flightRecorder_writer
+**
+** Description
+**  Writer thread: drains the ring to the log every
+**  FLIGHT_RECORDER_FLUSH_MS and flushes the log, so at most that much
+**  is lost on a power cut.
+**
+** Input Arguments:
+**  arg			unused
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  The only thread that touches the log file.
+**
+**/
+static void *flightRecorder_writer(void *arg)
+{
+	struct timespec period;
+	period.tv_sec = FLIGHT_RECORDER_FLUSH_MS / 1000;
+	period.tv_nsec = (FLIGHT_RECORDER_FLUSH_MS % 1000) * 1000000L;
+
+	while (running)
+	{
+		nanosleep(&period, NULL);
+
+		if (drain() > 0)
+		{
+			fflush(logFile);
+		}
+	}
+
+	// what was queued before close
+	drain();
+	fflush(logFile);
+
+	return 0;
+}
+
+
+
+/*
+** drain
+**
+** Description
+**  Writes out everything queued in the ring, preceded by a dropped
+**  record if producers found the ring full since the last drain.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Number of records written
+**
+** Special Considerations:
+**  Writer thread only.
+**
+**/
+static int drain(void)
+{
+	int written = 0;
+
+	uint32_t dropped = __atomic_exchange_n(&droppedRecords, 0, __ATOMIC_RELAXED);
+	if (dropped != 0)
+	{
+		flightRecordType rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.kind = REC_DROPPED;
+		rec.stampNs = nowNs(CLOCK_MONOTONIC);
+		rec.dropped.count = dropped;
+		written += writeRecord(&rec);
+	}
+
+	while (1)
+	{
+		recorderCellType *cell = &ring[dequeuePos & (FLIGHT_RECORDER_SLOTS - 1)];
+		uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+
+		if (seq != dequeuePos + 1)
+		{
+			// empty, or the producer that claimed the cell is still filling it
+			break;
+		}
+
+		written += writeRecord(&cell->rec);
+
+		// hand the cell back to the producers for the next lap
+		__atomic_store_n(&cell->seq, dequeuePos + FLIGHT_RECORDER_SLOTS, __ATOMIC_RELEASE);
+		dequeuePos++;
+	}
+
+	return written;
+}
+
+
+
+/*
+** writeRecord
+**
+** Description
+**  Appends one record to the log as length, record bytes, CRC-32, and
+**  rotates the log when it is full.
+**
+** Input Arguments:
+**  rec			record to write
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if the record was written, 0 on error
+**
+** Special Considerations:
+**  Writer thread only.
+**
+**/
+static int writeRecord(const flightRecordType *rec)
+{
+	uint32_t length = sizeof(flightRecordType);
+	uint32_t crc = flightRecorder_crc32(rec, length);
+
+	if (logFile == NULL)
+	{
+		return 0;
+	}
+
+	if (fwrite(&length, sizeof(length), 1, logFile) != 1 ||
+		fwrite(rec, length, 1, logFile) != 1 ||
+		fwrite(&crc, sizeof(crc), 1, logFile) != 1)
+	{
+		return 0;
+	}
+	logBytes += sizeof(length) + length + sizeof(crc);
+
+	if (logBytes >= FLIGHT_RECORDER_FILE_BYTES)
+	{
+		fclose(logFile);
+		logFile = NULL;
+		rotateLogs();
+		openLog();
+	}
+
+	return 1;
+}
+
+
+
+/*
+** openLog
+**
+** Description
+**  Creates a new log and writes its header.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  None
+**
+**/
+static int openLog(void)
+{
+	flightLogHeaderType header;
+
+	logFile = fopen(logPath, "wb");
+	if (logFile == NULL)
+	{
+		perror("flightRecorder: fopen");
+		return 0;
+	}
+
+	header.magic = FLIGHT_RECORDER_MAGIC;
+	header.version = FLIGHT_RECORDER_VERSION;
+	header.monotonicNs = nowNs(CLOCK_MONOTONIC);
+	header.realtimeNs = nowNs(CLOCK_REALTIME);
+	fwrite(&header, sizeof(header), 1, logFile);
+	logBytes = sizeof(header);
+
+	return 1;
+}
+
+
+
+/*
+** rotateLogs
+**
+** Description
+**  Shifts path.N-2 to path.N-1, ..., path to path.1, dropping the
+**  oldest log.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Missing logs are skipped.
+**
+**/
+static void rotateLogs(void)
+{
+	char from[RECORDER_PATH_MAX + 8];
+	char to[RECORDER_PATH_MAX + 8];
+
+	for (int i = FLIGHT_RECORDER_FILES - 1; i > 0; i--)
+	{
+		if (i == 1)
+		{
+			snprintf(from, sizeof(from), "%s", logPath);
+		}
+		else
+		{
+			snprintf(from, sizeof(from), "%s.%d", logPath, i - 1);
+		}
+		snprintf(to, sizeof(to), "%s.%d", logPath, i);
+		rename(from, to);
+	}
+}
+
+
+
+/*
+** nowNs
+**
+** Description
+**  Reads a clock.
+**
+** Input Arguments:
+**  clock		CLOCK_MONOTONIC or CLOCK_REALTIME
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Time in nanoseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t nowNs(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -18,69 +18,64 @@
 #include "../include/pulseSensor.h"
 #include "../include/proximitySensor.h"
 #include "../include/pressureSensor.h"
+#include "../include/blinkChannel.h"
+#include "../include/sensorEvents.h"
+#include "../include/adcScheduler.h"
+#include "../include/adcBackend.h"
+#include "../include/alertScheduler.h"
+#include "../include/flightRecorder.h"
+#include "../include/sensorFusion.h"
+#include "../include/sensorSnapshot.h"
+#include "../include/drowsyDetect.h"
 
 /************************ Macros **************************************/
-#define MAX_BUF 					5
-#define PULSE_CIRCULAR_BUF_SIZE 	15
-
-#define BLINKDETECT_PIPE
+#define BLINKDETECT_CHANNEL
 
 
 
 /**************************** Data Types ******************************/
 
 
-typedef enum {
-	PRESSURE_IDLE, 
-	PRESSURE_NO_GRIP,
-	PRESSURE_ALERT,
-	PRESSURE_DISABLE_ALERT
-} pressureStatesType;
-
-
-typedef struct 
-{
- int deltaProximity;
- int pressure;
- int blinkDelta;
- int pulseIBI;
-} sensorDataType;
-
 
 /********************* LOCAL Function Prototypes **********************/
 int testADC(void);
 void exitingFunction(int signo);
-void *buzzer_task(void *arg);
-void sensorFusionAlgorithm(void);
-void pressureStateMachine(int counter);
-void fuseSensorData(int *blinkDeltaHistory, char newBlinkData, unsigned int counter);
+void *blinkBridge_task(void *arg);
+void alertBuzzer(fusionDecisionType decision, uint64_t now, const sensorFusionInputsType *in, void *userdata);
+static void usage(const char *prog);
 
 /*************************** Globals **********************************/
 
-sem_t mutex_adc;
 sem_t mutex_gpio;
-sem_t sem_buzzer;
-char BuzzerONFlag = 0;
-
-
-volatile int DeltaProximity = 0;
-volatile int Proximity = 0;
-volatile int DeltaPressure = 0;
-volatile int Pressure = 0;
-volatile int Pulse_IBI = 0;
-volatile char Pulse_newIBIvalue = 0;
-
-//sensorDataType SensorData;
 
 
 static pthread_t *p1;
 static pthread_t *p2;
 static pthread_t *p3;
 static pthread_t *p4;
-
-
-static int fifofd = -1;
-static char myfifo[] = "/tmp/blinkDfifo";
+static pthread_t *p6;
+static pthread_t *p5 = NULL;
+
+
+static blinkChannel_t blinkEvents;
+static sensorFusionConfigType fusionConfig;
+
+// buzzer pattern of every alert: the fused rules, where two sensors
+// agree, go first
+static const alertLevelType alertLevel[NUM_FUSION_DECISIONS] = {
+	ALERT_LEVEL_NONE,
+	ALERT_LEVEL_WARNING,		// proximity
+	ALERT_LEVEL_ADVISORY,		// pressure
+	ALERT_LEVEL_ADVISORY,		// blink
+	ALERT_LEVEL_CRITICAL,		// blink & proximity
+	ALERT_LEVEL_CRITICAL,		// blink & pressure
+	ALERT_LEVEL_CRITICAL,		// proximity & pressure
+	ALERT_LEVEL_CRITICAL,		// blink & pulse
+	ALERT_LEVEL_CRITICAL,		// proximity & pulse
+	ALERT_LEVEL_CRITICAL,		// pressure & pulse
+	ALERT_LEVEL_WARNING,		// PERCLOS
+	ALERT_LEVEL_WARNING			// long blink
+};
 
 
 /************************** Namespaces ********************************/
@@ -94,38 +89,181 @@ using namespace std;
 
 
 
+#ifndef INTEGRATED
 // Main function, defines the entry point for the program.
+// The integrated build (blinkDetect and drowsyDetect in one process)
+// brings its own.
 int main( int argc, char** argv )
+{
+	if (!drowsyDetect_start(argc, argv))
+	{
+		return 1;
+	}
+	
+	// run sensor fusion algorithm
+	sensorFusionAlgorithm();
+	
+	
+	fprintf(stderr,"drowsyDetect Main - ERROR. Not supposed to be here!\n"); 
+	
+	
+	// Wait for the threads to terminate
+	pthread_join(*p1, NULL);
+	pthread_join(*p4, NULL);
+    pthread_join(*p2, NULL);
+    pthread_join(*p3, NULL);
+    pthread_join(*p6, NULL);
+#ifdef BLINKDETECT_CHANNEL	
+	if (p5 != NULL)
+	{
+		pthread_join(*p5, NULL);
+	}
+#endif
+    
+	
+	alertScheduler_report();
+	
+	// terminate the gpio module
+	gpioTerminate();
+	
+	// destroy the semaphore
+	sem_destroy(&mutex_gpio);
+	
+	blinkChannel_close(&blinkEvents);
+	sensorEvents_close();
+	flightRecorder_close();
+	
+	return 0;
+	
+}
+#endif
+
+
+
+/*
+** drowsyDetect_start
+**
+** Description
+**  Parses the command line, initialises the hardware, the flight
+**  recorder and the sensor events, and starts the sensor, ADC and
+**  buzzer tasks.
+**
+** Input Arguments:
+**  argc		number of arguments
+**  argv		command line
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Uses getopt, reset optind before parsing another command line.
+**
+**/
+int drowsyDetect_start(int argc, char** argv)
 {
 	// Welcome message
 	fprintf(stderr,"drowsyDetect Main\n"); 
 	
+#ifdef SIMULATOR
+	const char *adcBackend = "sim";
+#else
+	const char *adcBackend = "i2c";
+#endif
+	const char *recorderPath = FLIGHT_RECORDER_DEFAULT_PATH;
+	
+	sensorFusion_defaultConfig(&fusionConfig);
+	
+	int opt;
+	while ((opt = getopt(argc, argv, "a:w:r:t:R:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a':
+				adcBackend = optarg;
+				break;
+			case 'w':
+				if (!adcSim_loadWaveform(optarg))
+				{
+					fprintf(stderr, "main: Could not load waveform %s\n", optarg);
+					return 0;
+				}
+				break;
+			case 'r':
+				recorderPath = optarg;
+				break;
+			case 't':
+				if (!sensorFusion_setParameter(&fusionConfig, optarg))
+				{
+					fprintf(stderr, "main: Unknown fusion parameter %s\n", optarg);
+					sensorFusion_printParameters(&fusionConfig, stderr);
+					return 0;
+				}
+				break;
+			case 'R':
+				if (!sensorFusion_loadRules(&fusionConfig, optarg))
+				{
+					fprintf(stderr, "main: Could not load the fusion rules %s\n", optarg);
+					return 0;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 0;
+		}
+	}
+	
+	if (!ads1015_setBackend(adcBackend))
+	{
+		usage(argv[0]);
+		return 0;
+	}
+	
 	
 	// initialize the semaphore
-	sem_init(&mutex_adc, 0, 1); 
 	sem_init(&mutex_gpio, 0, 1);
-	sem_init(&sem_buzzer, 0, 0);
+	
+	// start recording before any task produces data
+	if (strcmp(recorderPath, "none") != 0 && !flightRecorder_init(recorderPath))
+	{
+		fprintf(stderr, "main: Could not start the flight recorder, running without it\n");
+	}
+	
+	// the sensor tasks notify the sensor fusion through these
+	if (!sensorEvents_init())
+	{
+		fprintf(stderr, "main: Could not create the sensor events\n");
+		return 0;
+	}
 	
 	// initialize the GPIO module
 	if (gpioInitialise() < 0)
 	{
 		// pigpio initialisation failed.
 		fprintf(stderr, "main: Could not initialize GPIOs\n");
-		return -1;
+		return 0;
 	}
 	
 	// Set GPIOs as output.
 	gpioSetMode(PULSE_SENSOR_GPIO_PIN, PI_OUTPUT); 
 	gpioSetMode(PRESSURE_SENSOR_GPIO_PIN, PI_OUTPUT);
 	gpioSetMode(PROXIMITY_SENSOR_GPIO_PIN, PI_OUTPUT); 
-	gpioSetMode(BUZZER_GPIO_PIN, PI_OUTPUT); 
 	
-	// reset the gpio state of the buzzer
-	gpioWrite(BUZZER_GPIO_PIN, 0);		// Set gpio low
+	// reset the gpio state of the sensors
 	gpioWrite(PULSE_SENSOR_GPIO_PIN, 0);		// Set gpio low
 	gpioWrite(PRESSURE_SENSOR_GPIO_PIN, 0);		// Set gpio low
 	gpioWrite(PROXIMITY_SENSOR_GPIO_PIN, 0);		// Set gpio low
 	
+	// the alert scheduler owns the buzzer; before any task starts, so
+	// a failure leaves nothing running
+	if (!alertScheduler_init())
+	{
+		fprintf(stderr, "main: Could not initialize the alert scheduler\n");
+		return 0;
+	}
+	
 	
 	
 	// Register a function to be called when SIGINT occurs
@@ -133,10 +271,17 @@ int main( int argc, char** argv )
 	
 
 
+	// the ADC scheduler owns the I2C bus and feeds the sensor tasks
+	if (!adcScheduler_init())
+	{
+		fprintf(stderr, "main: Could not initialize the ADCs\n");
+	}
+	p6 = gpioStartThread(adcScheduler_task, (void *)"thread 6 - ADC SCHEDULER"); 
+	
 	p1 = gpioStartThread(pulseSensor_task, (void *)"thread 1 - PULSE SENSOR"); 
 	sleep(1);
 	
-	p4 = gpioStartThread(buzzer_task, (void *)"thread 4 - BUZZER"); 
+	p4 = gpioStartThread(alertScheduler_task, (void *)"thread 4 - ALERT SCHEDULER"); 
 	sleep(1);
 
 	p2 = gpioStartThread(pressureSensor_task, (void *)"thread 2 - PRESSURE SENSOR"); 
@@ -145,49 +290,26 @@ int main( int argc, char** argv )
 	p3 = gpioStartThread(proximitySensor_task, (void *)"thread 3 - PROXIMITY SENSOR"); 
 	sleep(1);
 
-#ifdef BLINKDETECT_PIPE	
-	// wait until the named pipe has been created and then open the pipe (FIFO)
-	fprintf(stderr,"drowsyDetect Main - Waiting for pipe creation\n"); 
-	while(fifofd < 0)
+#ifdef BLINKDETECT_CHANNEL	
+	// open the blink event channel, the blink detector may start before
+	// or after us
+	if (!blinkChannel_open(&blinkEvents))
 	{
-		fifofd = open(myfifo, O_RDONLY);
-		usleep(1000);
+		fprintf(stderr,"drowsyDetect Main - ERROR opening the blink channel\n"); 
 	}
 	
-	//This will force the read() to be a non blocking system call
-	int flags = fcntl(fifofd, F_GETFL, 0);
-	fcntl(fifofd, F_SETFL, flags | O_NONBLOCK);
+	// in one process the detector notifies the fusion itself, the
+	// bridge is only needed across processes
+	if (!blinkChannel_isLocal())
+	{
+		p5 = gpioStartThread(blinkBridge_task, (void *)"thread 5 - BLINK BRIDGE"); 
+	}
 #endif
 	
 	// Inform user we are ready
     fprintf(stderr,"drowsyDetect Main - Init OK. Ready to start Sensor Fusion Algorith\n"); 
 	
-	// run sensor fusion algorithm
-	sensorFusionAlgorithm();
-	
-	
-	fprintf(stderr,"drowsyDetect Main - ERROR. Not supposed to be here!\n"); 
-	
-	
-	// Wait for the threads to terminate
-	pthread_join(*p1, NULL);
-	pthread_join(*p4, NULL);
-    pthread_join(*p2, NULL);
-    pthread_join(*p3, NULL);
-    
-	
-	// terminate the gpio module
-	gpioTerminate();
-	
-	// destroy the semaphore
-	sem_destroy(&mutex_gpio);
-	sem_destroy(&mutex_adc);
-	sem_destroy(&sem_buzzer);
-	
-	close(fifofd); 
-	
-	return 0;
-	
+	return 1;
 }
 
 
@@ -197,7 +319,10 @@ int main( int argc, char** argv )
 **
 ** Description
 **  Function that executes the sensor fusion algorithm 
-**  for the system
+**  for the system. The loop sleeps until a sensor task publishes
+**  new data or one of the hold-off deadlines expires, hands the new
+**  data to the fusion rules (sensorFusion.c) and steps them on the
+**  monotonic clock.
 **
 ** Input Arguments:
 **  None
@@ -209,176 +334,85 @@ int main( int argc, char** argv )
 **  None
 **
 ** Special Considerations:
-**  None
+**  All times are CLOCK_MONOTONIC milliseconds.
 **
 **/
 void sensorFusionAlgorithm(void)
 {
-	unsigned int counter = 0;
-	unsigned int proximityCounter = 0;
-	unsigned int blinkCountPrev = 0;
-	unsigned int blinkDeltaHistory[5] = {0,0,0,0,0};
-	//float blinkAvg = 0;
-	unsigned int blinkTimeoutCounter = 0;
-	unsigned int blinkbuzzerFlag = 0;
-	int buzzerFlag = 0;
-	int fifo_return_val = 0;
-	int pulseIBICircularBuffer[PULSE_CIRCULAR_BUF_SIZE];
-	float pulseIBIAvg = 0;
-	int index = 0;
-	char newBlinkData = 0;
-	
-	// initialize the pulse circular buffer
-	for(int i=0; i < PULSE_CIRCULAR_BUF_SIZE; i++)
-	{
-		pulseIBICircularBuffer[i] = 400;
-	}
+	sensorFusion_t fusion;
+	sensorDataType snapshot;
+	sensorDataType seen;
+	blinkEventType blinkEvent;
+	unsigned int events = 0;
+	uint64_t now = 0;
+	uint64_t deadline = 0;
 	
-	// Initialize the sensor data structure
-	/*
-	SensorData.deltaProximity = 0;
-	SensorData.pressure = 0;
-	SensorData.blinkDelta = 0;
-	SensorData.pulseIBI = 0;
-	*/
+	sensorFusion_init(&fusion, &fusionConfig, alertBuzzer, NULL);
+	fusion.verbose = 1;
+	memset(&seen, 0, sizeof(seen));
 	
 	
 	while(1)
 	{
-		usleep(2000);
+		// sleep until there is something to do
+		events = sensorEvents_wait(-1);
+		now = sensorEvents_nowMs();
 		
+		// one consistent view of the sensors; hand the fusion the
+		// readings published since the last pass
+		sensorSnapshot_read(&snapshot);
 		
-		/////////////////////////
-		// Detect approaching object
-		/////////////////////////
-		if (DeltaProximity > 130 && buzzerFlag == 0)
-		{
-			sem_post(&sem_buzzer);
-			buzzerFlag = 1;
-			proximityCounter = counter;
-			fprintf(stderr,"Prox Event!\n"); 
-		}
-		else
+		if (snapshot.sensor[SENSOR_PROXIMITY].updates != seen.sensor[SENSOR_PROXIMITY].updates)
 		{
-			if ((unsigned int)(counter - proximityCounter) >= 500) // wait for 1 second
-			{
-				buzzerFlag = 0;
-			}
+			sensorFusion_proximity(&fusion, snapshot.sensor[SENSOR_PROXIMITY].value, snapshot.sensor[SENSOR_PROXIMITY].delta);
 		}
-		
-		
-		
-		/////////////////////////
-		// Execute the pressure sensor state machine to detect pressure events
-		/////////////////////////
-		pressureStateMachine(counter);
-	
-	
-	
-		/////////////////////////
-		// Check the blink detector for new data
-		/////////////////////////
-		if (read(fifofd, (void *)&fifo_return_val, sizeof(int)) > 0)
+		if (snapshot.sensor[SENSOR_PRESSURE].updates != seen.sensor[SENSOR_PRESSURE].updates)
 		{
-			newBlinkData = 1;
-			
-			//blinkAvg = 0;
-			//fprintf(stderr,"FIFO Received: %d\n", fifo_return_val); 
-			
-			// shift the values
-			for(int i = 0; i < 4; i++)
-			{
-				blinkDeltaHistory[i] = blinkDeltaHistory[i+1];
-				//blinkAvg += blinkDeltaHistory[i];
-			}
-			blinkDeltaHistory[4] = (counter - blinkCountPrev );
-			
-			//blinkAvg = blinkAvg / 4;
-			
-			fprintf(stderr,"D blink: %d\n", (counter - blinkCountPrev )); 
-			
-			// save the current counter value
-			blinkCountPrev = counter;
-			
-			
-			//if (blinkDeltaHistory[3] < 200 &&  blinkDeltaHistory[4] < 200)
-			//if (blinkDeltaHistory[4] < ((int)(blinkAvg * 0.7))
-			if (blinkDeltaHistory[4] < 160 && blinkbuzzerFlag == 0)
-			{
-				//buzzer
-				sem_post(&sem_buzzer);
-				blinkbuzzerFlag = 1;
-				blinkTimeoutCounter = counter;
-				fprintf(stderr,"Blink Event!\n"); 
-			}
-			else
-			{
-				if ((unsigned int)(counter - blinkTimeoutCounter) >= 500) // wait for 1 second
-				{
-					blinkbuzzerFlag = 0;
-				}
-			}
+			sensorFusion_pressure(&fusion, snapshot.sensor[SENSOR_PRESSURE].value, snapshot.sensor[SENSOR_PRESSURE].delta);
 		}
-		else
+		if (snapshot.sensor[SENSOR_PULSE].updates != seen.sensor[SENSOR_PULSE].updates)
 		{
-			// no new blink detection data
-			newBlinkData = 0;
+			sensorFusion_pulse(&fusion, snapshot.sensor[SENSOR_PULSE].value);
 		}
+		seen = snapshot;
 		
-		
-		
-		/////////////////////////
-		//  Check the IBI of the pulse sensor
-		/////////////////////////
-		if (Pulse_newIBIvalue)
+		while ((events & SENSOR_EVENT_BIT(SENSOR_EVENT_BLINK)) && blinkChannel_poll(&blinkEvents, &blinkEvent))
 		{
-			// reset the flag
-			Pulse_newIBIvalue = 0;
-			pulseIBIAvg = 0.0;
-			
-			//fprintf(stderr,"IBI: %d\n", Pulse_IBI); 
-			
-			for(int i=0; i < PULSE_CIRCULAR_BUF_SIZE; i++)
-			{
-				pulseIBIAvg = pulseIBIAvg + (float)pulseIBICircularBuffer[i];
-			}
-			pulseIBIAvg = pulseIBIAvg / (float)PULSE_CIRCULAR_BUF_SIZE;
-			if (Pulse_IBI < (int)(pulseIBIAvg - 100))
-			{
-				// IBI is less than average IBI
-				
-			} 
-			pulseIBICircularBuffer[index++] = Pulse_IBI;
-			if (index >= MAX_BUF)
+			if (blinkEvent.kind == BLINK_EVENT_EYE_SAMPLES)
 			{
-				index = 0;
+				for (uint32_t i = 0; i < blinkEvent.samples && i < BLINK_EYE_BATCH; i++)
+				{
+					uint64_t captureNs = blinkEvent.captureNs + blinkEvent.sample[i].offsetUs * 1000ULL;
+					flightRecorder_eye(blinkEvent.sample[i].eyeOpen, captureNs);
+					sensorFusion_eyeOpen(&fusion, captureNs, blinkEvent.sample[i].eyeOpen);
+				}
+				continue;
 			}
-			//fprintf(stderr,"IBI: %d\n", Pulse_IBI); 
-			//fprintf(stderr,"IBI avg: %d\n", (int)pulseIBIAvg); 
+			flightRecorder_blink(blinkEvent.blinkCount, blinkEvent.eyeOpenClassifier, blinkEvent.eyeOpenHybrid, blinkEvent.captureNs);
+			sensorFusion_blink(&fusion, blinkEvent.captureNs);
 		}
 		
+		deadline = sensorFusion_step(&fusion, now);
 		
-		/////////////////////////
-		//  Fuse sensor data
-		/////////////////////////
-		fuseSensorData((int *)blinkDeltaHistory, newBlinkData, counter);
-		
-		
-		// increase the counter
-		counter++;
+		// wake up again when the pressure state machine is due
+		sensorEvents_setDeadline(deadline);
 	}	
 }
 
 
 
 /*
-** buzzer_task
+** alertBuzzer
 **
 ** Description
-**  Task for triggering the buzzer
+**  Alert sink of the live sensor fusion: logs the alert and asks the
+**  alert scheduler for the buzzer pattern of its level.
 **
 ** Input Arguments:
-**  arg		string to be printed at task startup
+**  decision	rule that fired
+**  now			time of the alert in msec
+**  in			sensor values the decision was based on
+**  userdata	unused
 **
 ** Output Arguments:
 **  None
@@ -390,35 +424,25 @@ void sensorFusionAlgorithm(void)
 **  None
 **
 **/
-void *buzzer_task(void *arg)
+void alertBuzzer(fusionDecisionType decision, uint64_t now, const sensorFusionInputsType *in, void *userdata)
 {
-	printf("buzzer: Task Started %s\n", (char *)arg);
-	
-	
-	while(1)
-	{
-		sem_wait(&sem_buzzer);
-		BuzzerONFlag = 1;
-		gpioWrite(BUZZER_GPIO_PIN, 1);		// Set gpio high
-		usleep(1000000);
-		gpioWrite(BUZZER_GPIO_PIN, 0);		// Set gpio low
-		BuzzerONFlag = 0;
-	}
-	
-	return 0;
+	alertScheduler_request(alertLevel[decision]);
+	fprintf(stderr,"%s Event!\n", sensorFusion_decisionName(decision)); 
+	flightRecorder_fusion(decision, in->blinkDelta, in->proximity, in->pressure, in->pulseIBI);
 }
 
 
 
-
 /*
-** fuseSensorData
+** blinkBridge_task
 **
 ** Description
-**  Combines sensor data to produce an event 
+**  Task that turns blink channel wakeups into sensor events, so the
+**  sensor fusion waits on a single set of descriptors. The events
+**  themselves are read by the sensor fusion on its own handle.
 **
 ** Input Arguments:
-**  
+**  arg		string to be printed at task startup
 **
 ** Output Arguments:
 **  None
@@ -430,205 +454,33 @@ void *buzzer_task(void *arg)
 **  None
 **
 **/
-void fuseSensorData(int *blinkDeltaHistory, char newBlinkData, unsigned int counter)
+void *blinkBridge_task(void *arg)
 {
-	char eventFlag = 0;
-	char fuseSensorWaitFlag = 0;
-	unsigned int fuseSensorCounter = 0;
-	
-	
-	// blink delta 850 to 890 msec is normal for driving, if blink 
-	// delta is lower alert!!! -- 150ms is eyes closed (condition 
-	// in main loop)
-	
-	const int blinkTHRESHOLD = 500;
-	const int proximityTHRESHOLD = 180; // length of a car is 4.45 meter avg. [15 m - 4.45m = 10.5 m]. 255 (max val) * 0.7 (10.5m of 15m) = 178.5
-	const int pressureTHRESHOLD = 85;   // 85 = 1/3 of max value (255)
-	const int pulseTHRESHOLD = 1000;  // typical IBI is 600 to 700
+	blinkChannel_t channel;
+	blinkEventType event;
 	
-	// If there is a high priority event taking place do not execute this function
-	if (BuzzerONFlag == 1)
-	{
-		return;
-	}
+	printf("blinkBridge: Task Started %s\n", (char *)arg);
 	
-	
-	// blink & proximity
-	if (blinkDeltaHistory[4] < blinkTHRESHOLD && Proximity > proximityTHRESHOLD && newBlinkData == 1)
-	{
-		eventFlag = 1;
-		fprintf(stderr,"Blink & Prox Event!\n"); 
-	}
-	// blink & low grip
-	else if (blinkDeltaHistory[4] < blinkTHRESHOLD && Pressure < pressureTHRESHOLD && newBlinkData == 1)
-	{
-		eventFlag = 1;
-		fprintf(stderr,"Blink & Press Event!\n"); 
-	}
-	// proximity & low grip
-	else if (Proximity > proximityTHRESHOLD && Pressure < pressureTHRESHOLD )
+	if (!blinkChannel_open(&channel))
 	{
-		eventFlag = 1;
-		fprintf(stderr,"Prox & Press Event!\n"); 
-	}
-	// blink & low heart rate	
-	else if (blinkDeltaHistory[4] < blinkTHRESHOLD && Pulse_IBI > pulseTHRESHOLD && newBlinkData == 1)
-	{
-		eventFlag = 1;
-		fprintf(stderr,"Blink & Heart Event!\n"); 
-	}
-	// proximity & low heart rate	
-	else if (Proximity > proximityTHRESHOLD && Pulse_IBI > pulseTHRESHOLD )
-	{
-		eventFlag = 1;
-		fprintf(stderr,"Prox & Heart Event!\n"); 
-	}
-	// low grip & low heart rate	
-	else if (Pressure < pressureTHRESHOLD  && Pulse_IBI > pulseTHRESHOLD )
-	{
-		eventFlag = 1;
-		fprintf(stderr,"Press & Heart Event!\n"); 
+		fprintf(stderr,"blinkBridge: ERROR opening the blink channel\n"); 
+		return 0;
 	}
 	
-	
-	// If one of the conditions was met, ALERT the user
-	if (eventFlag == 1 && fuseSensorWaitFlag == 0)
-	{
-		//buzzer
-		sem_post(&sem_buzzer);
-		fuseSensorCounter = counter;
-		fuseSensorWaitFlag = 1;
-	}
-	else
+	while(1)
 	{
-		if ((unsigned int)(counter - fuseSensorCounter) >= 1500) // wait for 3 second
+		if (blinkChannel_wait(&channel, -1))
 		{
-			fuseSensorWaitFlag = 0;
+			// only our own cursor moves, the data is read by the fusion
+			while (blinkChannel_poll(&channel, &event));
+			sensorEvents_notify(SENSOR_EVENT_BLINK);
 		}
 	}
 	
-	
+	return 0;
 }
 
 
-/*
-** pressureStateMachine
-**
-** Description
-**  Function that implements the state machine for detecting
-**  pressure sensor events. The state machine will detect a low
-**  or no grip on the pressure sensor for at least 3 seconds and
-**  alert the user. 
-**
-** Input Arguments:
-**  counter		running counter of 2ms periods elapsed
-**
-** Output Arguments:
-**  None
-**
-** Function Return:
-**  None
-**
-** Special Considerations:
-**  None
-**
-**/
-void pressureStateMachine(int counter)
-{
-	
-	static pressureStatesType pressureState = PRESSURE_IDLE;
-	static unsigned int pressureCounter = 0;
-	//static int buzzerPressureFlag = 0;
-	
-	switch(pressureState)
-	{
-		case PRESSURE_IDLE:
-		
-			if (Pressure < 60 )
-			{
-				// low or no grip detected -- let's take a closer look
-				pressureState = PRESSURE_NO_GRIP;
-				pressureCounter = counter;
-			}
-			else
-			{
-				// Everything normal
-				pressureState = PRESSURE_IDLE;
-			}
-			break;
-			
-		case PRESSURE_NO_GRIP:	
-		
-			if (Pressure < 60 )
-			{
-				// Still no grip detected
-				if ((unsigned int)(counter - pressureCounter) >= 1500)  // wait for 3 seconds
-				{
-					// low or no grip detected for more than 5 seconds -- alert the user!
-					pressureState = PRESSURE_ALERT;	
-				}
-				else
-				{
-					pressureState = PRESSURE_NO_GRIP;
-				}
-			}
-			else
-			{
-				// grip detected - break
-				pressureState = PRESSURE_IDLE;
-			}
-			break;
-			
-		case PRESSURE_ALERT:
-		
-			// alert the user -- pressure event
-			sem_post(&sem_buzzer);
-			//buzzerPressureFlag = 1;
-			pressureCounter = counter;
-			pressureState = PRESSURE_DISABLE_ALERT;
-			fprintf(stderr,"Pressure Event!\n"); 
-			break;
-			
-		case PRESSURE_DISABLE_ALERT:
-
-			if ((unsigned int)(counter - pressureCounter) >= 1000) // wait for 2 seconds
-			{
-				// done waiting -- we can listen for pressure events again
-				//buzzerPressureFlag = 0;
-				pressureState = PRESSURE_IDLE;
-			}
-			else
-			{
-				// continue ignoring pressure events
-				pressureState = PRESSURE_DISABLE_ALERT;
-			}
-			break;
-			
-		default:
-			fprintf(stderr,"drowsyDetect Main - ERROR - Unknown PRESSURE state!\n"); 
-			pressureState = PRESSURE_IDLE;
-			break;
-	}
-	
-		//// detect decrease in grip pressure
-		//if (Pressure < 60 && buzzerPressureFlag == 0)
-		//{
-			//sem_post(&sem_buzzer);
-			//buzzerPressureFlag = 1;
-			//pressureCounter = counter;
-			////fprintf(stderr,"!\n");
-		//}
-		//else
-		//{
-			////fprintf(stderr,"+\n");
-			//if ((unsigned int)(counter - pressureCounter) >= 1000) // wait for 2 second
-			//{
-				//buzzerPressureFlag = 0;
-				////fprintf(stderr,"*\n");
-			//}
-		//}
-}	
-
 
 
 /*
@@ -657,6 +509,7 @@ void exitingFunction(int signo)
 	gpioStopThread(p3); sleep(3);
 	gpioStopThread(p2); sleep(3);
 	gpioStopThread(p1); sleep(3);
+	alertScheduler_report();
 	gpioTerminate();
 	printf("Good bye!\n");
 	exit(1);
@@ -723,3 +576,37 @@ int testADC(void)
 	return 1;
 	
 }
+
+
+
+
+/*
+** usage
+**
+** Description
+**  Prints the command line options.
+**
+** Input Arguments:
+**  prog		name of the executable
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-a adc] [-w sensor:file[@rate]]... [-r file] [-t name=value]... [-R rules]\n", prog);
+	fprintf(stderr, "  -a adc      ADC backend: i2c (real chips), sim (simulated chips)\n");
+	fprintf(stderr, "  -w spec     play a recording on a simulated sensor (pulse, proximity,\n");
+	fprintf(stderr, "              pressure); the last column of the file is the reading in mV\n");
+	fprintf(stderr, "              and rate the sample rate in Hz (default 500)\n");
+	fprintf(stderr, "  -r file     flight recorder log (default %s), none to disable\n", FLIGHT_RECORDER_DEFAULT_PATH);
+	fprintf(stderr, "  -t n=v      override a sensor fusion threshold, see drowsyReplay -p\n");
+	fprintf(stderr, "  -R rules    fused rules file, replaces the built-in rules (fusion.rules)\n");
+}
@@ -0,0 +1,511 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Stand-in for the subset of the pigpio library used by the
+				application, for simulator builds on machines without
+				the GPIO hardware.
+ ============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+
+#include "../include/pigpioSim.h"
+
+
+
+/***************************** Macros *********************************/
+
+#define SIM_NUM_GPIOS			54
+
+
+/*************************** Globals **********************************/
+
+static unsigned char gpioMode[SIM_NUM_GPIOS];
+static unsigned char gpioLevel[SIM_NUM_GPIOS];
+static unsigned char gpioDuty[SIM_NUM_GPIOS];
+static gpioAlertFuncEx_t gpioAlert[SIM_NUM_GPIOS];
+static void *gpioAlertData[SIM_NUM_GPIOS];
+static pthread_mutex_t alertLock = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec tickStart;
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** gpioInitialise
+**
+** Description
+**  Starts the simulated GPIOs and the tick counter.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0, the simulator cannot fail
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioInitialise(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &tickStart);
+	fprintf(stderr, "pigpioSim: simulated GPIOs, no hardware is driven\n");
+
+	return 0;
+}
+
+
+
+/*
+** gpioTerminate
+**
+** Description
+**  Releases the simulated GPIOs. Nothing to release.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioTerminate(void)
+{
+}
+
+
+
+/*
+** gpioSetMode
+**
+** Description
+**  Remembers the mode of a GPIO.
+**
+** Input Arguments:
+**  gpio		GPIO number
+**  mode		PI_INPUT or PI_OUTPUT
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0 if operation was successful, PI_BAD_GPIO if gpio is out of range
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioSetMode(unsigned gpio, unsigned mode)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	gpioMode[gpio] = (unsigned char)mode;
+	return 0;
+}
+
+
+
+/*
+** gpioSetPullUpDown
+**
+** Description
+**  Sets the pull resistor of a GPIO. An input with nothing attached
+**  reads the level the resistor pulls it to.
+**
+** Input Arguments:
+**  gpio		GPIO number
+**  pud		PI_PUD_OFF, PI_PUD_DOWN or PI_PUD_UP
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0 if operation was successful, PI_BAD_GPIO if gpio is out of range
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioSetPullUpDown(unsigned gpio, unsigned pud)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	// a pulled up input with nothing attached reads high
+	if (gpioMode[gpio] == PI_INPUT)
+	{
+		gpioLevel[gpio] = (pud == PI_PUD_UP);
+	}
+	return 0;
+}
+
+
+
+/*
+** gpioRead
+**
+** Description
+**  Reads the level of a GPIO.
+**
+** Input Arguments:
+**  gpio		GPIO number
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Level last written or pulled to, PI_BAD_GPIO if gpio is out of
+**  range
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioRead(unsigned gpio)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	return gpioLevel[gpio];
+}
+
+
+
+/*
+** gpioWrite
+**
+** Description
+**  Sets the level of a GPIO, which also ends any PWM on it.
+**
+** Input Arguments:
+**  gpio		GPIO number
+**  level		0 low, otherwise high
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0 if operation was successful, PI_BAD_GPIO if gpio is out of range
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioWrite(unsigned gpio, unsigned level)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	gpioLevel[gpio] = (level != 0);
+	gpioDuty[gpio] = (level != 0) ? 255 : 0;
+	return 0;
+}
+
+
+
+/*
+** gpioPWM
+**
+** Description
+**  Remembers the PWM duty cycle of a GPIO. The GPIO reads high while
+**  the duty cycle is not 0.
+**
+** Input Arguments:
+**  gpio		GPIO number
+**  dutycycle	0 (off) to 255 (fully on)
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0 if operation was successful, PI_BAD_GPIO if gpio is out of range
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioPWM(unsigned gpio, unsigned dutycycle)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	gpioDuty[gpio] = (unsigned char)dutycycle;
+	gpioLevel[gpio] = (dutycycle != 0);
+	return 0;
+}
+
+
+
+/*
+** gpioStartThread
+**
+** Description
+**  Starts a thread, as pigpio does.
+**
+** Input Arguments:
+**  f		thread function
+**  userdata	passed to f
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The thread, to pass to gpioStopThread, NULL if it could not be
+**  started
+**
+** Special Considerations:
+**  None
+**
+**/
+pthread_t *gpioStartThread(gpioThreadFunc_t f, void *userdata)
+{
+	pthread_t *pth = (pthread_t *)malloc(sizeof(pthread_t));
+
+	if (pth == NULL || pthread_create(pth, NULL, f, userdata) != 0)
+	{
+		free(pth);
+		return NULL;
+	}
+	return pth;
+}
+
+
+
+/*
+** gpioStopThread
+**
+** Description
+**  Cancels a thread started by gpioStartThread and waits for it.
+**
+** Input Arguments:
+**  pth		the thread, may be NULL
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void gpioStopThread(pthread_t *pth)
+{
+	if (pth != NULL)
+	{
+		pthread_cancel(*pth);
+		pthread_join(*pth, NULL);
+		free(pth);
+	}
+}
+
+
+
+/*
+** gpioTick
+**
+** Description
+**  Microseconds since gpioInitialise.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Tick in microseconds, wraps every 72 minutes like the real tick
+**
+** Special Considerations:
+**  None
+**
+**/
+uint32_t gpioTick(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	// microseconds since gpioInitialise, wraps like the real tick
+	return (uint32_t)((ts.tv_sec - tickStart.tv_sec) * 1000000LL + (ts.tv_nsec - tickStart.tv_nsec) / 1000);
+}
+
+
+
+/*
+** gpioSleep
+**
+** Description
+**  Sleeps for, or until, the given time.
+**
+** Input Arguments:
+**  timetype	PI_TIME_RELATIVE or PI_TIME_ABSOLUTE
+**  seconds		seconds
+**  micros		microseconds
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0 if operation was successful, an error number if interrupted
+**
+** Special Considerations:
+**  An absolute time is CLOCK_REALTIME, as in pigpio.
+**
+**/
+int gpioSleep(unsigned timetype, int seconds, int micros)
+{
+	struct timespec ts;
+	ts.tv_sec = seconds;
+	ts.tv_nsec = micros * 1000L;
+
+	if (timetype == PI_TIME_ABSOLUTE)
+	{
+		return clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL);
+	}
+	return nanosleep(&ts, NULL);
+}
+
+
+
+/*
+** gpioSetAlertFuncEx
+**
+** Description
+**  Registers the function called on every level change of a GPIO.
+**
+** Input Arguments:
+**  gpio		GPIO to watch
+**  f		callback, NULL to cancel
+**  userdata	passed to the callback
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0, or PI_BAD_GPIO
+**
+** Special Considerations:
+**  Only the simulated devices change inputs, through
+**  pigpioSim_driveInput().
+**
+**/
+int gpioSetAlertFuncEx(unsigned gpio, gpioAlertFuncEx_t f, void *userdata)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	pthread_mutex_lock(&alertLock);
+	gpioAlert[gpio] = f;
+	gpioAlertData[gpio] = userdata;
+	pthread_mutex_unlock(&alertLock);
+
+	return 0;
+}
+
+
+
+/*
+** pigpioSim_driveInput
+**
+** Description
+**  Drives an input from a simulated device and calls its alert
+**  function if the level changed.
+**
+** Input Arguments:
+**  gpio		GPIO driven
+**  level		0 or 1
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0, or PI_BAD_GPIO
+**
+** Special Considerations:
+**  The alert function runs on the calling thread, which stands in for
+**  the pigpio alert thread.
+**
+**/
+int pigpioSim_driveInput(unsigned gpio, unsigned level)
+{
+	if (gpio >= SIM_NUM_GPIOS)
+	{
+		return PI_BAD_GPIO;
+	}
+
+	pthread_mutex_lock(&alertLock);
+	level = (level != 0);
+	gpioAlertFuncEx_t f = NULL;
+	void *userdata = gpioAlertData[gpio];
+	if (gpioLevel[gpio] != level)
+	{
+		gpioLevel[gpio] = (unsigned char)level;
+		f = gpioAlert[gpio];
+	}
+	pthread_mutex_unlock(&alertLock);
+
+	if (f != NULL)
+	{
+		f((int)gpio, (int)level, gpioTick(), userdata);
+	}
+	return 0;
+}
+
+
+
+/*
+** gpioSetSignalFunc
+**
+** Description
+**  Installs a signal handler.
+**
+** Input Arguments:
+**  signum		signal number
+**  f		handler
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  0
+**
+** Special Considerations:
+**  None
+**
+**/
+int gpioSetSignalFunc(unsigned signum, gpioSignalFunc_t f)
+{
+	signal(signum, f);
+	return 0;
+}
@@ -10,17 +10,19 @@
 
 
 #include "../include/common.h"
+#include "../include/sensorEvents.h"
+#include "../include/adcScheduler.h"
+#include "../include/flightRecorder.h"
+#include "../include/sensorSnapshot.h"
+#include "../include/streamStats.h"
 
 
 /************************ Macros **************************************/
 
 
 /*************************** Globals **********************************/
-extern sem_t mutex_adc;
 extern sem_t mutex_gpio;
 
-extern int DeltaPressure;
-extern int Pressure;
 
 
 /********************* LOCAL Function Prototypes **********************/
@@ -35,33 +37,25 @@ void *pressureSensor_task(void *arg)
 	
 	printf("pressure: Task Started %s\n", (char *)arg);
 	
-	ads1015_t ads;
-	ads1015_init(&ads, GENERIC);
-	
+	adcSampleType sample;
 	float voltage = 0;
 	int scaledVoltage = 0;
 	//float pressure = 0;
 	int prev_value = 0;
 	
-	int index = 0;
 	float avg = 0;
 	int delta = 0;
-	int window[5];
-	for(int i = 0; i < 5; i++)
-	{
-		// Initialize to middle value
-		window[i] = 128;
-	}
+	RingWindow<int, SENSOR_AVG_WINDOW_SIZE> window;
+	
+	// Initialize to middle value
+	window.fill(128);
 	
 	while(1)
 	{
 	
-		// read the pulse sensor signal
-		sem_wait(&mutex_adc);
-		voltage = ads1015_getDataFromChannel(&ads, PRESSURE_SENSOR_ADC_CHANNEL);
-		usleep(400);
-		voltage = ads1015_getDataFromChannel(&ads, PRESSURE_SENSOR_ADC_CHANNEL);
-		sem_post(&mutex_adc);
+		// wait for the next sensor sample
+		adcScheduler_read(ADC_CH_PRESSURE, &sample);
+		voltage = sample.voltage;
 		
 		//printf("d= %f\n", voltage);
 		
@@ -89,30 +83,22 @@ void *pressureSensor_task(void *arg)
 			
 			
 			// determine delta
-			avg = 0;
-			for(int i = 0; i < 5; i++)
-			{
-				avg = avg + window[i];
-			}
-			avg = avg / 5;
+			avg = window.mean();
 			delta = (scaledVoltage - avg);
 			//fprintf(stderr,"d= %d\n", delta );
 			//fprintf(stderr,"d= %d\n", scaledVoltage );
 			
 			// report to main thread
-			DeltaPressure = delta;
-			Pressure = scaledVoltage;
+			sensorSnapshot_publish(SENSOR_PRESSURE, scaledVoltage, delta, sample.stampNs);
+			sensorEvents_notify(SENSOR_EVENT_PRESSURE);
+			flightRecorder_sensor(SENSOR_EVENT_PRESSURE, scaledVoltage, delta);
 			
 			
 			// Put current value into the averaging window
-			window[index++] = scaledVoltage;
-			if (index >= 5) index = 0;
+			window.push(scaledVoltage);
 			
 		}
 		
-		// sleep for 230 ms
-		usleep(230000);
-		
 	
 	}
 	
@@ -10,17 +10,18 @@
 
 
 #include "../include/common.h"
+#include "../include/sensorEvents.h"
+#include "../include/adcScheduler.h"
+#include "../include/flightRecorder.h"
+#include "../include/sensorSnapshot.h"
+#include "../include/streamStats.h"
 
 
 /************************ Macros **************************************/
 
 /*************************** Globals **********************************/
-extern sem_t mutex_adc;
 extern sem_t mutex_gpio;
 
-extern int DeltaProximity;
-extern int Proximity;
-
 /********************* LOCAL Function Prototypes **********************/
 static long map(long x, long in_min, long in_max, long out_min, long out_max);
 
@@ -32,33 +33,25 @@ void *proximitySensor_task(void *arg)
 	
 	printf("proximity: Task Started %s\n", (char *)arg);
 	
-	ads1015_t ads;
-	ads1015_init(&ads, GENERIC);
-	
+	adcSampleType sample;
 	float voltage = 0;
 	int scaledVoltage = 0;
 	int prev_value = 0;
 	
 	
-	int index = 0;
 	float avg = 0;
 	int delta = 0;
-	int window[5];
-	for(int i = 0; i < 5; i++)
-	{
-		// Initialize to middle value
-		window[i] = 128;
-	}
+	RingWindow<int, SENSOR_AVG_WINDOW_SIZE> window;
+	
+	// Initialize to middle value
+	window.fill(128);
 	
 	while(1)
 	{
 	
-		// read the pulse sensor signal
-		sem_wait(&mutex_adc);
-		voltage = ads1015_getDataFromChannel(&ads, PROXIMITY_SENSOR_ADC_CHANNEL);
-		usleep(400);
-		voltage = ads1015_getDataFromChannel(&ads, PROXIMITY_SENSOR_ADC_CHANNEL);
-		sem_post(&mutex_adc);
+		// wait for the next sensor sample
+		adcScheduler_read(ADC_CH_PROXIMITY, &sample);
+		voltage = sample.voltage;
 		
 		if (voltage > 0)
 		{
@@ -86,22 +79,17 @@ void *proximitySensor_task(void *arg)
 			
 			
 			// determine delta
-			avg = 0;
-			for(int i = 0; i < 5; i++)
-			{
-				avg = avg + window[i];
-			}
-			avg = avg / 5;
+			avg = window.mean();
 			delta = (scaledVoltage - avg);
 			//fprintf(stderr,"d= %d\n", delta );
 			
 			// report to main thread
-			DeltaProximity = delta;
-			Proximity = scaledVoltage;
+			sensorSnapshot_publish(SENSOR_PROXIMITY, scaledVoltage, delta, sample.stampNs);
+			sensorEvents_notify(SENSOR_EVENT_PROXIMITY);
+			flightRecorder_sensor(SENSOR_EVENT_PROXIMITY, scaledVoltage, delta);
 			
 			// Put current value into the averaging window
-			window[index++] = scaledVoltage;
-			if (index >= 5) { index = 0; }
+			window.push(scaledVoltage);
 			
 			
 			
@@ -114,10 +102,6 @@ void *proximitySensor_task(void *arg)
 		
 		}
 		
-		// sleep for 100 ms
-		usleep(100300);
-		//usleep(2000);
-		//gpioSleep(PI_TIME_RELATIVE, 0, 100000);
 	
 	}
 	
@@ -12,18 +12,20 @@
 
 
 #include "../include/common.h"
+#include "../include/sensorEvents.h"
+#include "../include/adcScheduler.h"
+#include "../include/flightRecorder.h"
+#include "../include/sensorSnapshot.h"
+#include "../include/streamStats.h"
 
 
 /************************ Macros **************************************/
 
 
 /*************************** Globals **********************************/
-extern sem_t mutex_adc;
 extern sem_t mutex_gpio;
 char retBuf[10];
 
-extern int Pulse_IBI;
-extern char Pulse_newIBIvalue;
 
 
 /********************* LOCAL Function Prototypes **********************/
@@ -58,7 +60,7 @@ void *pulseSensor_task(void *arg)
     int N = 0;
 	volatile unsigned long sampleCounter = 0;          // used to determine pulse timing
 	volatile unsigned long lastBeatTime = 0;           // used to find the inter beat interval
-	volatile int rate[10];                    // used to hold last ten IBI values
+	RingWindow<int, 10> rate;                 // used to hold last ten IBI values
 	//volatile int P =512;                      // used to find peak in pulse wave
 	//volatile int T = 512;                     // used to find trough in pulse wave
 	//volatile int thresh = 512;                // used to find instant moment of heart beat
@@ -81,28 +83,25 @@ void *pulseSensor_task(void *arg)
 	
 	
 	
-	// system ticks in milliseconds
-	sampleCounter = gpioTick() / 1000;
+	// the time of every sample comes from the ADC scheduler, in mS
 
 	
-	ads1015_t ads;
-	ads1015_init(&ads, PULSE);
+	adcSampleType sample;
 	float sig = 0;
 	
 	while (1)
 	{
-		// read the pulse sensor signal
-		sem_wait(&mutex_adc);
-		//sig = ads1015_getDataFromChannel(&ads, PULSE_SENSOR_ADC_CHANNEL);
-		//usleep(400);
-		sig = ads1015_getDataFromChannel(&ads, PULSE_SENSOR_ADC_CHANNEL) * 1000.0;
-		sem_post(&mutex_adc);
+		// read the pulse sensor signal, the ADC scheduler delivers
+		// one sample every 2 ms
+		adcScheduler_read(ADC_CH_PULSE, &sample);
+		sig = sample.voltage * 1000.0;
 		
 		Signal = (int)sig;
 		
 		
-		// keep track of the time in mS with this variable
-		sampleCounter += 2;   
+		// keep track of the time in mS with this variable, from the
+		// sample time stamp so late samples do not skew the IBI
+		sampleCounter = (unsigned long)(sample.stampNs / 1000000ULL);
 
 		
 		N = sampleCounter - lastBeatTime;       // monitor the time since the last beat to avoid noise
@@ -150,26 +149,12 @@ void *pulseSensor_task(void *arg)
 					if(secondBeat)
 					{                        		// if this is the second beat, if secondBeat == TRUE
 						secondBeat = 0;             // clear secondBeat flag
-						for(int i=0; i<=9; i++)
-						{         
-							// seed the running total to get a realisitic BPM at startup
-							rate[i] = IBI;                      
-						}
+						rate.fill(IBI);             // seed the running total to get a realisitic BPM at startup
 					}
 				  
 					// keep a running total of the last 10 IBI values
-					int runningTotal = 0;                   // clear the runningTotal variable    
-	
-					for(int i=0; i<=8; i++)
-					{                					  	// shift data in the rate array
-						rate[i] = rate[i+1];              	// and drop the oldest IBI value 
-						runningTotal += rate[i];          	// add up the 9 oldest IBI values
-					}
-				
-					rate[9] = IBI;                          // add the latest IBI to the rate array
-					runningTotal += rate[9];                // add the latest IBI to runningTotal
-					//runningTotal /= 10;                   // average the last 10 IBI values
-					float rtotal = runningTotal / 10.0;
+					rate.push(IBI);                         // add the latest IBI and drop the oldest one
+					float rtotal = rate.mean();             // average the last 10 IBI values
 					 
 					BPM = (int)(60000.0/rtotal);            // how many beats can fit into a minute? that's BPM!
 					QS = 1;                              	// set Quantified Self flag 
@@ -178,8 +163,9 @@ void *pulseSensor_task(void *arg)
 					//printf("IBI: %d\n", IBI);
 					
 					// pass the IBI information to the main thread
-					Pulse_IBI = IBI;
-					Pulse_newIBIvalue = 1;
+					sensorSnapshot_publish(SENSOR_PULSE, IBI, 0, sample.stampNs);
+					sensorEvents_notify(SENSOR_EVENT_PULSE);
+					flightRecorder_sensor(SENSOR_EVENT_PULSE, IBI, 0);
 					
 					
 					// QS FLAG IS NOT CLEARED INSIDE THIS ISR
@@ -216,11 +202,6 @@ void *pulseSensor_task(void *arg)
 			secondBeat = 1;                     // when we get the heartbeat back
 		}  
 		
-		// sleep for 2 ms
-		usleep(2000);
-		
-		
-		
 		//struct timespec ts, rem;  
 		//ts.tv_sec = 0;
 		//ts.tv_nsec = 2 * 1E6;
@@ -0,0 +1,280 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : New sensor data notifications for the sensor fusion. Every
+				producer signals its own eventfd, the fusion thread
+				blocks on all of them plus a timerfd for its hold-off
+				deadlines.
+ ============================================================================
+ */
+
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "../include/sensorEvents.h"
+
+
+/*************************** Globals **********************************/
+
+static int epollfd = -1;
+static int eventfds[NUM_SENSOR_EVENTS] = { -1, -1, -1, -1, -1 };
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** sensorEvents_init
+**
+** Description
+**  Creates the notification eventfds, the deadline timer and the
+**  epoll set that waits on all of them.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if it failed.
+**
+** Special Considerations:
+**  Must be called before any producer task is started.
+**
+**/
+int sensorEvents_init(void)
+{
+	struct epoll_event ev;
+
+	epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollfd < 0)
+	{
+		perror("sensorEvents: epoll_create1");
+		return 0;
+	}
+
+	for (int i = 0; i < NUM_SENSOR_EVENTS; i++)
+	{
+		if (i == SENSOR_EVENT_TIMER)
+		{
+			eventfds[i] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		}
+		else
+		{
+			eventfds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		}
+
+		if (eventfds[i] < 0)
+		{
+			perror("sensorEvents: eventfd");
+			sensorEvents_close();
+			return 0;
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, eventfds[i], &ev) < 0)
+		{
+			perror("sensorEvents: epoll_ctl");
+			sensorEvents_close();
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+
+/*
+** sensorEvents_notify
+**
+** Description
+**  Signals that the given producer has published new data.
+**
+** Input Arguments:
+**  src			producer that has new data
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  May be called from any thread. Notifications that arrive before
+**  the fusion thread wakes up are merged.
+**
+**/
+void sensorEvents_notify(sensorEventSourceType src)
+{
+	uint64_t one = 1;
+
+	if (eventfds[src] >= 0 && write(eventfds[src], &one, sizeof(one)) != sizeof(one))
+	{
+		perror("sensorEvents: notify");
+	}
+}
+
+
+
+/*
+** sensorEvents_wait
+**
+** Description
+**  Blocks until at least one producer has new data or the deadline
+**  timer expires.
+**
+** Input Arguments:
+**  timeoutMs	maximum time to wait, -1 to wait forever
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Mask of SENSOR_EVENT_BIT() of the sources that fired, 0 on timeout.
+**
+** Special Considerations:
+**  Call from the fusion thread only.
+**
+**/
+unsigned int sensorEvents_wait(int timeoutMs)
+{
+	struct epoll_event ev[NUM_SENSOR_EVENTS];
+	unsigned int mask = 0;
+	uint64_t count;
+
+	int n = epoll_wait(epollfd, ev, NUM_SENSOR_EVENTS, timeoutMs);
+	if (n < 0 && errno != EINTR)
+	{
+		perror("sensorEvents: epoll_wait");
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		// reading resets the eventfd counter (or timer expirations)
+		if (read(eventfds[ev[i].data.u32], &count, sizeof(count)) == sizeof(count))
+		{
+			mask |= SENSOR_EVENT_BIT(ev[i].data.u32);
+		}
+	}
+
+	return mask;
+}
+
+
+
+/*
+** sensorEvents_setDeadline
+**
+** Description
+**  Arms the deadline timer to fire SENSOR_EVENT_TIMER at the given
+**  time, replacing any previous deadline.
+**
+** Input Arguments:
+**  deadlineMs	absolute time from sensorEvents_nowMs(), 0 to disarm
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  A deadline already in the past fires immediately.
+**
+**/
+void sensorEvents_setDeadline(uint64_t deadlineMs)
+{
+	struct itimerspec its;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = deadlineMs / 1000;
+	its.it_value.tv_nsec = (deadlineMs % 1000) * 1000000L;
+
+	// an all zero it_value disarms the timer, keep past deadlines armed
+	if (deadlineMs != 0 && its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+	{
+		its.it_value.tv_nsec = 1;
+	}
+
+	timerfd_settime(eventfds[SENSOR_EVENT_TIMER], TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+
+/*
+** sensorEvents_nowMs
+**
+** Description
+**  Reads the monotonic clock the deadlines are expressed in.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  CLOCK_MONOTONIC time in milliseconds
+**
+** Special Considerations:
+**  None
+**
+**/
+uint64_t sensorEvents_nowMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+/*
+** sensorEvents_close
+**
+** Description
+**  Releases the file descriptors.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorEvents_close(void)
+{
+	for (int i = 0; i < NUM_SENSOR_EVENTS; i++)
+	{
+		if (eventfds[i] >= 0)
+		{
+			close(eventfds[i]);
+			eventfds[i] = -1;
+		}
+	}
+
+	if (epollfd >= 0)
+	{
+		close(epollfd);
+		epollfd = -1;
+	}
+}
@@ -0,0 +1,1278 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Sensor fusion algorithm of the drowsiness detection system.
+				The fusion runs on a clock supplied by the caller and
+				reports alerts through a callback, so the same code runs
+				live on the sensor tasks and offline on recorded drives.
+ ============================================================================
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "../include/sensorFusion.h"
+#include "../include/sensorEvents.h"
+
+
+
+/***************************** Macros *********************************/
+
+#define FUSION_PARAMETER(field)		{ #field, offsetof(sensorFusionConfigType, field) }
+
+
+/**************************** Data Types ******************************/
+
+
+typedef struct {
+
+	const char *name;
+	size_t offset;
+
+} fusionParameterType;
+
+
+/******************** Local Function Prototypes *******************/
+static void raiseAlert(sensorFusion_t *f, fusionDecisionType decision, uint64_t now);
+static void fuseSensorData(sensorFusion_t *f, unsigned int changed, uint64_t now);
+static int inputValue(const sensorFusion_t *f, fusionInputType input);
+static int resolveValue(const sensorFusionConfigType *cfg, const fusionValueType *v);
+static int parseValue(const char *token, fusionValueType *v);
+static int parseRule(const char *line, fusionRuleType *rule, const char **error);
+static void printValue(const fusionValueType *v, FILE *f);
+static uint64_t pressureStateMachine(sensorFusion_t *f, uint64_t now);
+
+
+/*************************** Globals **********************************/
+
+static const fusionParameterType fusionParameter[] = {
+	FUSION_PARAMETER(proximityDeltaThreshold),
+	FUSION_PARAMETER(proximityHoldOffMs),
+	FUSION_PARAMETER(blinkEventThreshold),
+	FUSION_PARAMETER(blinkHoldOffMs),
+	FUSION_PARAMETER(noGripThreshold),
+	FUSION_PARAMETER(noGripTimeMs),
+	FUSION_PARAMETER(pressureHoldOffMs),
+	FUSION_PARAMETER(blinkThreshold),
+	FUSION_PARAMETER(proximityThreshold),
+	FUSION_PARAMETER(pressureThreshold),
+	FUSION_PARAMETER(pulseThreshold),
+	FUSION_PARAMETER(fuseHoldOffMs),
+	FUSION_PARAMETER(eyeClosedThreshold),
+	FUSION_PARAMETER(eyeOpenThreshold),
+	FUSION_PARAMETER(perclosWindowMs),
+	FUSION_PARAMETER(perclosThreshold),
+	FUSION_PARAMETER(longBlinkMs),
+	FUSION_PARAMETER(eyeHoldOffMs)
+};
+
+static const char *decisionName[NUM_FUSION_DECISIONS] = {
+	"?",
+	"Prox",
+	"Pressure",
+	"Blink",
+	"Blink & Prox",
+	"Blink & Press",
+	"Prox & Press",
+	"Blink & Heart",
+	"Prox & Heart",
+	"Press & Heart",
+	"PERCLOS",
+	"Long blink"
+};
+
+// names of the alerts and inputs in rules files
+static const char *decisionKey[NUM_FUSION_DECISIONS] = {
+	"?",
+	"proximity",
+	"pressure",
+	"blink",
+	"blinkProximity",
+	"blinkPressure",
+	"proximityPressure",
+	"blinkPulse",
+	"proximityPulse",
+	"pressurePulse",
+	"perclos",
+	"longBlink"
+};
+
+static const char *inputName[NUM_FUSION_INPUTS] = {
+	"blink",
+	"proximity",
+	"proximityDelta",
+	"pressure",
+	"pressureDelta",
+	"pulse",
+	"perclos",
+	"blinkDuration"
+};
+
+// the fused rules the system was tuned with, first match wins
+static const char *defaultRule[] = {
+	"blinkProximity     fuseHoldOffMs  blink<blinkThreshold     proximity>proximityThreshold",
+	"blinkPressure      fuseHoldOffMs  blink<blinkThreshold     pressure<pressureThreshold",
+	"proximityPressure  fuseHoldOffMs  proximity>proximityThreshold  pressure<pressureThreshold",
+	"blinkPulse         fuseHoldOffMs  blink<blinkThreshold     pulse>pulseThreshold",
+	"proximityPulse     fuseHoldOffMs  proximity>proximityThreshold  pulse>pulseThreshold",
+	"pressurePulse      fuseHoldOffMs  pressure<pressureThreshold    pulse>pulseThreshold"
+};
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** sensorFusion_defaultConfig
+**
+** Description
+**  Fills in the thresholds the system was tuned with.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  cfg			default configuration
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_defaultConfig(sensorFusionConfigType *cfg)
+{
+	cfg->proximityDeltaThreshold = 130;
+	cfg->proximityHoldOffMs = 1000;
+	cfg->blinkEventThreshold = 320;
+	cfg->blinkHoldOffMs = 1000;
+	cfg->noGripThreshold = 60;
+	cfg->noGripTimeMs = 3000;
+	cfg->pressureHoldOffMs = 2000;
+
+	// blink delta 850 to 890 msec is normal for driving, if blink
+	// delta is lower alert!!! -- 150ms is eyes closed (condition
+	// in main loop)
+	cfg->blinkThreshold = 1000;			// msec
+	cfg->proximityThreshold = 180;		// length of a car is 4.45 meter avg. [15 m - 4.45m = 10.5 m]. 255 (max val) * 0.7 (10.5m of 15m) = 178.5
+	cfg->pressureThreshold = 85;		// 85 = 1/3 of max value (255)
+	cfg->pulseThreshold = 1000;			// typical IBI is 600 to 700
+	cfg->fuseHoldOffMs = 3000;
+
+	// PERCLOS counts the eye closed when it is at least 80% shut;
+	// closures longer than a normal blink (100 to 400 msec) alert
+	cfg->eyeClosedThreshold = 20;		// percent open
+	cfg->eyeOpenThreshold = 50;
+	cfg->perclosWindowMs = 60000;
+	cfg->perclosThreshold = 15;			// percent of the window
+	cfg->longBlinkMs = 500;
+	cfg->eyeHoldOffMs = 5000;
+
+	const char *error;
+	cfg->rules = 0;
+	for (size_t i = 0; i < sizeof(defaultRule) / sizeof(defaultRule[0]); i++)
+	{
+		if (parseRule(defaultRule[i], &cfg->rule[cfg->rules], &error) > 0)
+		{
+			cfg->rules++;
+		}
+	}
+}
+
+
+
+/*
+** sensorFusion_setParameter
+**
+** Description
+**  Overrides one configuration value by name, e.g.
+**  "blinkThreshold=900".
+**
+** Input Arguments:
+**  cfg			configuration to change
+**  assignment	name=value
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if the name is not known or the
+**  value is not a number.
+**
+** Special Considerations:
+**  None
+**
+**/
+int sensorFusion_setParameter(sensorFusionConfigType *cfg, const char *assignment)
+{
+	const char *eq = strchr(assignment, '=');
+	char *end;
+
+	if (eq == NULL)
+	{
+		return 0;
+	}
+
+	long value = strtol(eq + 1, &end, 10);
+	if (end == eq + 1 || *end != '\0')
+	{
+		return 0;
+	}
+
+	for (size_t i = 0; i < sizeof(fusionParameter) / sizeof(fusionParameter[0]); i++)
+	{
+		if (strlen(fusionParameter[i].name) == (size_t)(eq - assignment) &&
+			strncmp(assignment, fusionParameter[i].name, eq - assignment) == 0)
+		{
+			*(int *)((char *)cfg + fusionParameter[i].offset) = (int)value;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+** sensorFusion_printParameters
+**
+** Description
+**  Prints every configuration value as name=value.
+**
+** Input Arguments:
+**  cfg			configuration
+**  f			output stream
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_printParameters(const sensorFusionConfigType *cfg, FILE *f)
+{
+	for (size_t i = 0; i < sizeof(fusionParameter) / sizeof(fusionParameter[0]); i++)
+	{
+		fprintf(f, "%s=%d\n", fusionParameter[i].name, *(const int *)((const char *)cfg + fusionParameter[i].offset));
+	}
+}
+
+
+
+/*
+** sensorFusion_loadRules
+**
+** Description
+**  Replaces the fused rules with the ones of a rules file.
+**
+** Input Arguments:
+**  cfg			configuration to change
+**  path		rules file
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  1 if operation was successful, 0 if the file could not be read or
+**  has errors; the errors are printed and cfg is left unchanged.
+**
+** Special Considerations:
+**  See sensorFusion.h for the format.
+**
+**/
+int sensorFusion_loadRules(sensorFusionConfigType *cfg, const char *path)
+{
+	char line[256];
+	int lineNo = 0;
+	int rules = 0;
+	int ok = 1;
+	fusionRuleType rule[SENSOR_FUSION_MAX_RULES];
+
+	FILE *in = fopen(path, "r");
+	if (in == NULL)
+	{
+		fprintf(stderr, "sensorFusion: cannot open %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), in) != NULL)
+	{
+		const char *error = NULL;
+		fusionRuleType r;
+		lineNo++;
+
+		char *comment = strchr(line, '#');
+		if (comment != NULL)
+		{
+			*comment = '\0';
+		}
+
+		int ret = parseRule(line, &r, &error);
+		if (ret > 0 && rules == SENSOR_FUSION_MAX_RULES)
+		{
+			ret = -1;
+			error = "too many rules";
+		}
+		if (ret < 0)
+		{
+			fprintf(stderr, "sensorFusion: %s:%d: %s\n", path, lineNo, error);
+			ok = 0;
+		}
+		else if (ret > 0)
+		{
+			rule[rules++] = r;
+		}
+	}
+	fclose(in);
+
+	if (!ok)
+	{
+		return 0;
+	}
+
+	cfg->rules = rules;
+	memcpy(cfg->rule, rule, rules * sizeof(fusionRuleType));
+	return 1;
+}
+
+
+
+/*
+** sensorFusion_printRules
+**
+** Description
+**  Prints the fused rules in the format of a rules file.
+**
+** Input Arguments:
+**  cfg			configuration
+**  f			output stream
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_printRules(const sensorFusionConfigType *cfg, FILE *f)
+{
+	for (int i = 0; i < cfg->rules; i++)
+	{
+		const fusionRuleType *rule = &cfg->rule[i];
+
+		fprintf(f, "%-18s ", decisionKey[rule->decision]);
+		printValue(&rule->holdOffMs, f);
+		for (int c = 0; c < rule->conditions; c++)
+		{
+			fprintf(f, " %s%c", inputName[rule->condition[c].input], rule->condition[c].op);
+			printValue(&rule->condition[c].threshold, f);
+		}
+		fprintf(f, "\n");
+	}
+}
+
+
+
+/*
+** sensorFusion_init
+**
+** Description
+**  Resets the fusion state.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  cfg			thresholds, copied
+**  alert		called for every alert
+**  userdata	passed to alert
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_init(sensorFusion_t *f, const sensorFusionConfigType *cfg, sensorFusionAlertFunc alert, void *userdata)
+{
+	// plain fields zeroed, the windows emptied by their constructors
+	*f = sensorFusion_t();
+	f->cfg = *cfg;
+	f->alert = alert;
+	f->userdata = userdata;
+	f->pressureState = PRESSURE_IDLE;
+
+	// initialize the pulse circular buffer
+	f->pulseIBIWindow.fill(400);
+	f->blinkDeltaHistory.fill(0);
+
+	// resolve the parameters of the fused rules
+	for (int i = 0; i < f->cfg.rules; i++)
+	{
+		const fusionRuleType *rule = &f->cfg.rule[i];
+
+		for (int c = 0; c < rule->conditions; c++)
+		{
+			f->ruleInputs[i] |= FUSION_INPUT_BIT(rule->condition[c].input);
+			f->ruleThreshold[i][c] = resolveValue(&f->cfg, &rule->condition[c].threshold);
+		}
+		f->ruleHoldOffMs[i] = resolveValue(&f->cfg, &rule->holdOffMs);
+	}
+}
+
+
+
+/*
+** sensorFusion_proximity
+**
+** Description
+**  Hands a new proximity reading to the fusion.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  value		scaled reading
+**  delta		change over the recent average
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_proximity(sensorFusion_t *f, int value, int delta)
+{
+	f->in.proximity = value;
+	f->in.deltaProximity = delta;
+	f->updated |= SENSOR_EVENT_BIT(SENSOR_EVENT_PROXIMITY);
+	f->changed |= FUSION_INPUT_BIT(FUSION_INPUT_PROXIMITY) | FUSION_INPUT_BIT(FUSION_INPUT_PROXIMITY_DELTA);
+}
+
+
+
+/*
+** sensorFusion_pressure
+**
+** Description
+**  Hands a new pressure reading to the fusion.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  value		scaled reading
+**  delta		change over the recent average
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_pressure(sensorFusion_t *f, int value, int delta)
+{
+	f->in.pressure = value;
+	f->in.deltaPressure = delta;
+	f->updated |= SENSOR_EVENT_BIT(SENSOR_EVENT_PRESSURE);
+	f->changed |= FUSION_INPUT_BIT(FUSION_INPUT_PRESSURE) | FUSION_INPUT_BIT(FUSION_INPUT_PRESSURE_DELTA);
+}
+
+
+
+/*
+** sensorFusion_pulse
+**
+** Description
+**  Hands a new inter-beat interval to the fusion.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  ibi			inter-beat interval in msec
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+void sensorFusion_pulse(sensorFusion_t *f, int ibi)
+{
+	f->in.pulseIBI = ibi;
+	f->updated |= SENSOR_EVENT_BIT(SENSOR_EVENT_PULSE);
+	f->changed |= FUSION_INPUT_BIT(FUSION_INPUT_PULSE);
+}
+
+
+
+/*
+** sensorFusion_blink
+**
+** Description
+**  Hands a blink to the fusion.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  captureNs	capture time of the frame the blink was seen in
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Blinks beyond SENSOR_FUSION_BLINK_QUEUE per step are dropped.
+**
+**/
+void sensorFusion_blink(sensorFusion_t *f, uint64_t captureNs)
+{
+	if (f->blinks < SENSOR_FUSION_BLINK_QUEUE)
+	{
+		f->blinkCaptureNs[f->blinks++] = captureNs;
+	}
+	f->updated |= SENSOR_EVENT_BIT(SENSOR_EVENT_BLINK);
+}
+
+
+
+/*
+** sensorFusion_eyeOpen
+**
+** Description
+**  Hands the eye openness of one frame to the fusion. Slides the
+**  PERCLOS window over it and times the eye closures.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  captureNs	capture time of the frame
+**  eyeOpen		0 (closed) to 1 (open), negative if the eye was not seen
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Constant time per sample. When the window holds more than
+**  SENSOR_FUSION_EYE_WINDOW frames the oldest ones drop out early.
+**
+**/
+void sensorFusion_eyeOpen(sensorFusion_t *f, uint64_t captureNs, float eyeOpen)
+{
+	const sensorFusionConfigType *cfg = &f->cfg;
+	uint64_t ms = captureNs / 1000000ULL;
+
+	if (eyeOpen < 0)
+	{
+		// lost the eye, a closure in progress cannot be timed
+		f->eyeClosed = 0;
+		return;
+	}
+
+	int open = (int)(eyeOpen * 100.0f + 0.5f);
+	int closed = (open <= cfg->eyeClosedThreshold);
+
+	// slide the PERCLOS window
+	while (!f->eyeSampleMs.empty() && ms - f->eyeSampleMs.oldest() > (uint64_t)cfg->perclosWindowMs)
+	{
+		f->eyeSampleMs.pop();
+		f->eyeSampleClosed.pop();
+	}
+	f->eyeSampleMs.push(ms);
+	f->eyeSampleClosed.push(closed);
+	f->in.perclos = (int)(f->eyeSampleClosed.total() * 100 / f->eyeSampleClosed.size());
+
+	// time the closure, it ends once the eye is well open again
+	if (!f->eyeClosed && closed)
+	{
+		f->eyeClosed = 1;
+		f->eyeClosedMs = ms;
+		f->in.blinkDurationMs = 0;
+	}
+	else if (f->eyeClosed)
+	{
+		int duration = (int)(ms - f->eyeClosedMs);
+
+		if (duration > cfg->longBlinkMs && f->in.blinkDurationMs <= cfg->longBlinkMs)
+		{
+			f->longBlink = 1;
+		}
+		f->in.blinkDurationMs = duration;
+		if (open >= cfg->eyeOpenThreshold)
+		{
+			f->eyeClosed = 0;
+		}
+	}
+
+	f->updated |= SENSOR_EVENT_BIT(SENSOR_EVENT_BLINK);
+	f->changed |= FUSION_INPUT_BIT(FUSION_INPUT_PERCLOS) | FUSION_INPUT_BIT(FUSION_INPUT_BLINK_DURATION);
+}
+
+
+
+/*
+** sensorFusion_step
+**
+** Description
+**  Runs the rules on the values handed in since the last step, plus
+**  the time driven parts (hold-offs, the pressure state machine).
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  now			current time in msec, must not go backwards
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Time the fusion must step again even if no sensor publishes, 0 if
+**  it only needs to step on new data.
+**
+** Special Considerations:
+**  None
+**
+**/
+uint64_t sensorFusion_step(sensorFusion_t *f, uint64_t now)
+{
+	unsigned int events = f->updated;
+	unsigned int changed = f->changed;
+	uint64_t deadline = 0;
+
+	f->updated = 0;
+	f->changed = 0;
+
+
+	/////////////////////////
+	// Detect approaching object
+	/////////////////////////
+	if (events & SENSOR_EVENT_BIT(SENSOR_EVENT_PROXIMITY))
+	{
+		if (f->in.deltaProximity > f->cfg.proximityDeltaThreshold && f->proximityFlag == 0)
+		{
+			f->proximityFlag = 1;
+			f->proximityTime = now;
+			raiseAlert(f, FUSION_PROXIMITY, now);
+		}
+		else
+		{
+			if (now - f->proximityTime >= (uint64_t)f->cfg.proximityHoldOffMs)
+			{
+				f->proximityFlag = 0;
+			}
+		}
+	}
+
+
+
+	/////////////////////////
+	// Execute the pressure sensor state machine to detect pressure events
+	/////////////////////////
+	deadline = pressureStateMachine(f, now);
+
+
+
+	/////////////////////////
+	// Blinks handed in since the last step
+	/////////////////////////
+	for (int n = 0; n < f->blinks; n++)
+	{
+		// the interval is measured between frame captures
+		unsigned int blinkDelta = (unsigned int)((f->blinkCaptureNs[n] - f->blinkCapturePrev) / 1000000ULL);
+
+		f->blinkDeltaHistory.push(blinkDelta);
+		f->in.blinkDelta = (int)blinkDelta;
+
+		if (f->verbose)
+		{
+			fprintf(stderr,"D blink: %u ms\n", blinkDelta);
+		}
+
+		// save the capture time of this blink
+		f->blinkCapturePrev = f->blinkCaptureNs[n];
+
+		if (blinkDelta < (unsigned int)f->cfg.blinkEventThreshold && f->blinkFlag == 0)
+		{
+			f->blinkFlag = 1;
+			f->blinkTimeoutTime = now;
+			raiseAlert(f, FUSION_BLINK, now);
+		}
+		else
+		{
+			if (now - f->blinkTimeoutTime >= (uint64_t)f->cfg.blinkHoldOffMs)
+			{
+				f->blinkFlag = 0;
+			}
+		}
+
+		// every blink is fused on its own
+		fuseSensorData(f, FUSION_INPUT_BIT(FUSION_INPUT_BLINK), now);
+	}
+	f->blinks = 0;
+
+
+
+	/////////////////////////
+	// Eye openness: PERCLOS and long eye closures
+	/////////////////////////
+	if (events & SENSOR_EVENT_BIT(SENSOR_EVENT_BLINK))
+	{
+		// PERCLOS only counts once the window is half full
+		int perclosValid = (!f->eyeSampleMs.empty() &&
+			f->eyeSampleMs.newest() - f->eyeSampleMs.oldest() >= (uint64_t)f->cfg.perclosWindowMs / 2);
+
+		if (f->eyeFlag == 0 && (f->longBlink || (perclosValid && f->in.perclos > f->cfg.perclosThreshold)))
+		{
+			f->eyeFlag = 1;
+			f->eyeTime = now;
+			raiseAlert(f, f->longBlink ? FUSION_LONG_BLINK : FUSION_PERCLOS, now);
+		}
+		else
+		{
+			if (now - f->eyeTime >= (uint64_t)f->cfg.eyeHoldOffMs)
+			{
+				f->eyeFlag = 0;
+			}
+		}
+		f->longBlink = 0;
+	}
+
+
+
+	/////////////////////////
+	//  Check the IBI of the pulse sensor
+	/////////////////////////
+	if (events & SENSOR_EVENT_BIT(SENSOR_EVENT_PULSE))
+	{
+		float pulseIBIAvg = f->pulseIBIWindow.mean();
+
+		if (f->in.pulseIBI < (int)(pulseIBIAvg - 100))
+		{
+			// IBI is less than average IBI
+
+		}
+		f->pulseIBIWindow.push(f->in.pulseIBI);
+	}
+
+
+	/////////////////////////
+	//  Fuse sensor data
+	/////////////////////////
+	if (changed != 0)
+	{
+		fuseSensorData(f, changed, now);
+	}
+
+	return deadline;
+}
+
+
+
+/*
+** sensorFusion_decisionName
+**
+** Description
+**  Short name of an alert.
+**
+** Input Arguments:
+**  decision	rule that fired
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The name
+**
+** Special Considerations:
+**  None
+**
+**/
+const char *sensorFusion_decisionName(fusionDecisionType decision)
+{
+	if (decision <= 0 || decision >= NUM_FUSION_DECISIONS)
+	{
+		return decisionName[0];
+	}
+	return decisionName[decision];
+}
+
+
+
+/*
+** raiseAlert
+**
+** Description
+**  Reports an alert. What the buzzer does with it is up to the alert
+**  sink, the fusion only holds off each rule on its own.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  decision	rule that fired
+**  now			current time in msec
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void raiseAlert(sensorFusion_t *f, fusionDecisionType decision, uint64_t now)
+{
+	if (f->alert != NULL)
+	{
+		f->alert(decision, now, &f->in, f->userdata);
+	}
+}
+
+
+
+/*
+** fuseSensorData
+**
+** Description
+**  Runs the fused rules that read one of the changed inputs, in
+**  priority order, and raises the alert of the first one whose
+**  conditions all hold and whose hold-off has passed.
+**
+** Input Arguments:
+**  f				pointer to sensorFusion_t object
+**  changed			FUSION_INPUT_BIT of the inputs with new values
+**  now				current time in msec
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  A rule that tests the blink only runs for a new blink. At most one
+**  alert per call.
+**
+**/
+static void fuseSensorData(sensorFusion_t *f, unsigned int changed, uint64_t now)
+{
+	for (int i = 0; i < f->cfg.rules; i++)
+	{
+		const fusionRuleType *rule = &f->cfg.rule[i];
+		unsigned int inputs = f->ruleInputs[i];
+
+		// nothing new for this rule
+		if ((inputs & changed) == 0 ||
+			((inputs & FUSION_INPUT_BIT(FUSION_INPUT_BLINK)) && !(changed & FUSION_INPUT_BIT(FUSION_INPUT_BLINK))))
+		{
+			continue;
+		}
+
+		if (f->ruleAlerted[i] && now - f->ruleAlertTime[i] < (uint64_t)f->ruleHoldOffMs[i])
+		{
+			continue;
+		}
+
+		int match = 1;
+		for (int c = 0; c < rule->conditions && match; c++)
+		{
+			int value = inputValue(f, rule->condition[c].input);
+			int threshold = f->ruleThreshold[i][c];
+
+			match = (rule->condition[c].op == '<') ? (value < threshold) : (value > threshold);
+		}
+
+		if (match)
+		{
+			f->ruleAlerted[i] = 1;
+			f->ruleAlertTime[i] = now;
+			raiseAlert(f, rule->decision, now);
+			return;
+		}
+	}
+}
+
+
+
+/*
+** inputValue
+**
+** Description
+**  Current value of a rule input.
+**
+** Input Arguments:
+**  f				pointer to sensorFusion_t object
+**  input			the input
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The value
+**
+** Special Considerations:
+**  None
+**
+**/
+static int inputValue(const sensorFusion_t *f, fusionInputType input)
+{
+	switch (input)
+	{
+		case FUSION_INPUT_BLINK:			return (int)f->blinkDeltaHistory.newest();
+		case FUSION_INPUT_PROXIMITY:		return f->in.proximity;
+		case FUSION_INPUT_PROXIMITY_DELTA:	return f->in.deltaProximity;
+		case FUSION_INPUT_PRESSURE:			return f->in.pressure;
+		case FUSION_INPUT_PRESSURE_DELTA:	return f->in.deltaPressure;
+		case FUSION_INPUT_PULSE:			return f->in.pulseIBI;
+		case FUSION_INPUT_PERCLOS:			return f->in.perclos;
+		case FUSION_INPUT_BLINK_DURATION:	return f->in.blinkDurationMs;
+		default:							return 0;
+	}
+}
+
+
+
+/*
+** resolveValue
+**
+** Description
+**  Value of a rule number or parameter.
+**
+** Input Arguments:
+**  cfg				configuration
+**  v				number or parameter
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  The value
+**
+** Special Considerations:
+**  None
+**
+**/
+static int resolveValue(const sensorFusionConfigType *cfg, const fusionValueType *v)
+{
+	if (v->parameter < 0)
+	{
+		return v->value;
+	}
+	return *(const int *)((const char *)cfg + fusionParameter[v->parameter].offset);
+}
+
+
+
+/*
+** parseValue
+**
+** Description
+**  Parses a rule number or parameter name.
+**
+** Input Arguments:
+**  token			the text
+**
+** Output Arguments:
+**  v				the number or parameter
+**
+** Function Return:
+**  1 if operation was successful, 0 if it is neither.
+**
+** Special Considerations:
+**  None
+**
+**/
+static int parseValue(const char *token, fusionValueType *v)
+{
+	char *end;
+	long value = strtol(token, &end, 10);
+
+	if (end != token && *end == '\0')
+	{
+		v->parameter = -1;
+		v->value = (int)value;
+		return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(fusionParameter) / sizeof(fusionParameter[0]); i++)
+	{
+		if (strcmp(token, fusionParameter[i].name) == 0)
+		{
+			v->parameter = (int)i;
+			v->value = 0;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*
+** parseRule
+**
+** Description
+**  Parses one line of a rules file.
+**
+** Input Arguments:
+**  line			the line, comments already stripped
+**
+** Output Arguments:
+**  rule			the rule
+**  error			what is wrong with the line
+**
+** Function Return:
+**  1 if a rule was read, 0 if the line is blank, -1 on an error.
+**
+** Special Considerations:
+**  None
+**
+**/
+static int parseRule(const char *line, fusionRuleType *rule, const char **error)
+{
+	char buf[256];
+	char *save = NULL;
+	char *token;
+
+	strncpy(buf, line, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	memset(rule, 0, sizeof(*rule));
+
+	// alert
+	if ((token = strtok_r(buf, " \t\r\n", &save)) == NULL)
+	{
+		return 0;
+	}
+	rule->decision = (fusionDecisionType)0;
+	for (int d = 1; d < NUM_FUSION_DECISIONS; d++)
+	{
+		if (strcmp(token, decisionKey[d]) == 0)
+		{
+			rule->decision = (fusionDecisionType)d;
+		}
+	}
+	if (rule->decision == 0)
+	{
+		*error = "unknown alert";
+		return -1;
+	}
+
+	// hold-off
+	if ((token = strtok_r(NULL, " \t\r\n", &save)) == NULL || !parseValue(token, &rule->holdOffMs))
+	{
+		*error = "hold-off is not a number or parameter";
+		return -1;
+	}
+
+	// conditions
+	while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+	{
+		char *op = strpbrk(token, "<>");
+		if (op == NULL || rule->conditions == FUSION_RULE_MAX_CONDITIONS)
+		{
+			*error = (op == NULL) ? "condition is not <input><op><threshold>" : "too many conditions";
+			return -1;
+		}
+
+		fusionConditionType *c = &rule->condition[rule->conditions];
+		c->op = *op;
+		*op = '\0';
+
+		int input = -1;
+		for (int i = 0; i < NUM_FUSION_INPUTS; i++)
+		{
+			if (strcmp(token, inputName[i]) == 0)
+			{
+				input = i;
+			}
+		}
+		if (input < 0)
+		{
+			*error = "unknown input";
+			return -1;
+		}
+		c->input = (fusionInputType)input;
+
+		if (!parseValue(op + 1, &c->threshold))
+		{
+			*error = "threshold is not a number or parameter";
+			return -1;
+		}
+		rule->conditions++;
+	}
+
+	if (rule->conditions == 0)
+	{
+		*error = "rule has no conditions";
+		return -1;
+	}
+
+	return 1;
+}
+
+
+
+/*
+** printValue
+**
+** Description
+**  Prints a rule number or parameter.
+**
+** Input Arguments:
+**  v				number or parameter
+**  f				output stream
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  None
+**
+**/
+static void printValue(const fusionValueType *v, FILE *f)
+{
+	if (v->parameter < 0)
+	{
+		fprintf(f, "%d", v->value);
+	}
+	else
+	{
+		fprintf(f, "%s", fusionParameter[v->parameter].name);
+	}
+}
+
+
+
+/*
+** pressureStateMachine
+**
+** Description
+**  Function that implements the state machine for detecting
+**  pressure sensor events. The state machine will detect a low
+**  or no grip on the pressure sensor for at least 3 seconds and
+**  alert the user.
+**
+** Input Arguments:
+**  f			pointer to sensorFusion_t object
+**  now			current time in msec
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  Time the state machine must run again even if the pressure does
+**  not change, 0 if it only needs to run on new pressure data.
+**
+** Special Considerations:
+**  None
+**
+**/
+static uint64_t pressureStateMachine(sensorFusion_t *f, uint64_t now)
+{
+	const sensorFusionConfigType *cfg = &f->cfg;
+	uint64_t deadline = 0;
+
+	switch(f->pressureState)
+	{
+		case PRESSURE_IDLE:
+
+			if (f->in.pressure < cfg->noGripThreshold )
+			{
+				// low or no grip detected -- let's take a closer look
+				f->pressureState = PRESSURE_NO_GRIP;
+				f->pressureTime = now;
+				deadline = f->pressureTime + cfg->noGripTimeMs;
+			}
+			else
+			{
+				// Everything normal
+				f->pressureState = PRESSURE_IDLE;
+			}
+			break;
+
+		case PRESSURE_NO_GRIP:
+
+			if (f->in.pressure < cfg->noGripThreshold )
+			{
+				// Still no grip detected
+				if (now - f->pressureTime >= (uint64_t)cfg->noGripTimeMs)
+				{
+					// low or no grip detected for too long -- alert the user!
+					f->pressureState = PRESSURE_ALERT;
+					deadline = now;
+				}
+				else
+				{
+					f->pressureState = PRESSURE_NO_GRIP;
+					deadline = f->pressureTime + cfg->noGripTimeMs;
+				}
+			}
+			else
+			{
+				// grip detected - break
+				f->pressureState = PRESSURE_IDLE;
+			}
+			break;
+
+		case PRESSURE_ALERT:
+
+			// alert the user -- pressure event
+			f->pressureTime = now;
+			f->pressureState = PRESSURE_DISABLE_ALERT;
+			deadline = f->pressureTime + cfg->pressureHoldOffMs;
+			raiseAlert(f, FUSION_PRESSURE, now);
+			break;
+
+		case PRESSURE_DISABLE_ALERT:
+
+			if (now - f->pressureTime >= (uint64_t)cfg->pressureHoldOffMs)
+			{
+				// done waiting -- we can listen for pressure events again
+				f->pressureState = PRESSURE_IDLE;
+				deadline = now;
+			}
+			else
+			{
+				// continue ignoring pressure events
+				f->pressureState = PRESSURE_DISABLE_ALERT;
+				deadline = f->pressureTime + cfg->pressureHoldOffMs;
+			}
+			break;
+
+		default:
+			fprintf(stderr,"sensorFusion - ERROR - Unknown PRESSURE state!\n");
+			f->pressureState = PRESSURE_IDLE;
+			break;
+	}
+
+	return deadline;
+}
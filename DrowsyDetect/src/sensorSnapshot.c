@@ -0,0 +1,146 @@
+/*
+ =============================================================================
+ Author      : William A Irizarry
+ Version     : 1
+ Description : Latest reading of every sensor, published by the sensor
+				tasks and read by the sensor fusion as one consistent,
+				timestamped snapshot, double buffered per sensor.
+ ============================================================================
+ */
+
+
+#include <string.h>
+
+#include "../include/sensorSnapshot.h"
+
+
+
+/**************************** Data Types ******************************/
+
+
+// one sensor: the writer fills copy[latest ^ 1] and then flips latest
+typedef struct {
+
+	uint32_t latest;					// index of the newest complete copy
+	uint32_t seq[2];					// per copy, odd while it is being written
+	sensorReadingType copy[2];
+
+} sensorSlotType;
+
+
+/*************************** Globals **********************************/
+
+static sensorSlotType snapshotSlot[NUM_SENSORS];
+
+
+/*********************** Function Definitions *************************/
+
+
+
+/*
+** sensorSnapshot_publish
+**
+** Description
+**  Publishes a new reading of one sensor.
+**
+** Input Arguments:
+**  sensor		sensor the reading comes from
+**  value		scaled reading, or the inter-beat interval in msec
+**  delta		change over the recent average
+**  stampNs		time of the sample the value came from
+**
+** Output Arguments:
+**  None
+**
+** Function Return:
+**  None
+**
+** Special Considerations:
+**  Each sensor must be published by a single thread, its sensor
+**  task. Never waits for anything.
+**
+**/
+void sensorSnapshot_publish(sensorIdType sensor, int value, int delta, uint64_t stampNs)
+{
+	if (sensor < 0 || sensor >= NUM_SENSORS)
+	{
+		return;
+	}
+
+	sensorSlotType *slot = &snapshotSlot[sensor];
+	uint32_t cur = __atomic_load_n(&slot->latest, __ATOMIC_RELAXED);
+	uint32_t next = cur ^ 1;
+
+	// readers are directed to cur, the seq only catches one that
+	// loaded the index before the previous flip and is still copying
+	uint32_t seq = __atomic_load_n(&slot->seq[next], __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq[next], seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	sensorReadingType *reading = &slot->copy[next];
+	reading->value = value;
+	reading->delta = delta;
+	reading->stampNs = stampNs;
+	reading->updates = slot->copy[cur].updates + 1;
+
+	__atomic_store_n(&slot->seq[next], seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&slot->latest, next, __ATOMIC_RELEASE);
+}
+
+
+
+/*
+** sensorSnapshot_read
+**
+** Description
+**  Copies the latest complete reading of every sensor.
+**
+** Input Arguments:
+**  None
+**
+** Output Arguments:
+**  snapshot	the readings
+**
+** Function Return:
+**  Number of attempts it took, 1 unless a writer published twice
+**  during the copy of its sensor.
+**
+** Special Considerations:
+**  Never blocks a writer and never waits on one. Compare the update
+**  counts with a previous snapshot to find the sensors that published
+**  since.
+**
+**/
+int sensorSnapshot_read(sensorDataType *snapshot)
+{
+	int attempts = 1;
+
+	snapshot->version = 0;
+	for (int i = 0; i < NUM_SENSORS; i++)
+	{
+		sensorSlotType *slot = &snapshotSlot[i];
+
+		while (1)
+		{
+			uint32_t index = __atomic_load_n(&slot->latest, __ATOMIC_ACQUIRE);
+			uint32_t before = __atomic_load_n(&slot->seq[index], __ATOMIC_ACQUIRE);
+
+			// odd: the writer already flipped away from this copy and is
+			// refilling it, the other one is complete
+			if (!(before & 1))
+			{
+				memcpy(&snapshot->sensor[i], &slot->copy[index], sizeof(sensorReadingType));
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+				if (__atomic_load_n(&slot->seq[index], __ATOMIC_RELAXED) == before)
+				{
+					break;
+				}
+			}
+			attempts++;
+		}
+		snapshot->version += snapshot->sensor[i].updates;
+	}
+
+	return attempts;
+}